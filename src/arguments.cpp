@@ -1,5 +1,6 @@
 #include "arguments.hpp"
 
+#include <charconv>
 #include <iostream>
 #include <optional>
 
@@ -46,6 +47,62 @@ bool ProgramArguments::try_parse_impl(const std::vector<std::string> &arguments)
 			conflict_resolution = ConflictResolutionMode::rename;
 		} else if (argument == "--copy-configs" || argument == "--copy-configurations") {
 			copy_configurations = true;
+		} else if (argument == "--reflink" || argument.starts_with("--reflink=")) {
+			// a bare flag means "always", as in cp
+			const std::string value = argument == "--reflink" ? "always" : argument.substr(std::string("--reflink=").size());
+			const std::optional<ReflinkMode> reflink = try_parse_reflink_mode(value);
+			if (!reflink.has_value()) {
+				std::cerr << "Error: --reflink expects one of: auto, always, never." << std::endl;
+				return false;
+			}
+			reflink_mode = *reflink;
+		} else if (argument == "--delta") {
+			delta_transfer = true;
+		} else if (argument == "--checksum") {
+			checksum = true;
+		} else if (argument == "--pipeline") {
+			pipelined = true;
+		} else if (argument == "--manifest") {
+			manifest = true;
+		} else if (argument == "--prune") {
+			// the directory records are stored in the manifest
+			prune_directories = true;
+			manifest = true;
+		} else if (argument == "--full-scan") {
+			full_scan = true;
+		} else if (argument == "--config-cache" || argument.starts_with("--config-cache=")) {
+			config_cache = true;
+			if (argument != "--config-cache")
+				config_cache_path = argument.substr(std::string("--config-cache=").size());
+		} else if (argument == "--state" || argument.starts_with("--state=")) {
+			state = true;
+			if (argument != "--state")
+				state_path = argument.substr(std::string("--state=").size());
+		} else if (argument == "--watch" || argument.starts_with("--watch=")) {
+			watch = true;
+			if (argument != "--watch") {
+				const std::string value = argument.substr(std::string("--watch=").size());
+				const std::optional<std::size_t> debounce = try_parse_milliseconds(value);
+				if (!debounce.has_value()) {
+					std::cerr << "Error: --watch expects the debounce window in milliseconds." << std::endl;
+					return false;
+				}
+				watch_debounce_milliseconds = *debounce;
+			}
+		} else if (argument == "-j" || argument == "--jobs" || argument.starts_with("--jobs=")) {
+			std::string value;
+			if (argument.starts_with("--jobs=")) {
+				value = argument.substr(std::string("--jobs=").size());
+			} else if (arg_iter + 1 != arguments.end()) {
+				value = *(++arg_iter);
+			}
+
+			const std::optional<std::size_t> count = try_parse_job_count(value);
+			if (!count.has_value()) {
+				std::cerr << "Error: " << argument << " expects a positive number of jobs." << std::endl;
+				return false;
+			}
+			job_count = *count;
 		} else {
 			std::cerr << "Error: Unknown argument: " << argument << std::endl;
 			return false;
@@ -58,6 +115,26 @@ bool ProgramArguments::try_parse_impl(const std::vector<std::string> &arguments)
 		std::cerr << "Warning: --delete-extra is disabled, because it is incompatible with --bi|--bidirectional.\n";
 	}
 
+	if (!is_one_way_synchronization && pipelined) {
+		pipelined = false;
+		std::cerr << "Warning: --pipeline is disabled, because it is incompatible with --bi|--bidirectional.\n";
+	}
+
+	if (!is_one_way_synchronization && manifest) {
+		manifest = false;
+		std::cerr << "Warning: --manifest is disabled, because it is incompatible with --bi|--bidirectional.\n";
+	}
+
+	if (!is_one_way_synchronization && prune_directories) {
+		prune_directories = false;
+		std::cerr << "Warning: --prune is disabled, because it is incompatible with --bi|--bidirectional.\n";
+	}
+
+	if (is_one_way_synchronization && state) {
+		state = false;
+		std::cerr << "Warning: --state is disabled, because it requires --bi|--bidirectional.\n";
+	}
+
 	if (mode == ProgramMode::help || mode == ProgramMode::test) {
 		if (arg_iter != arguments.end())
 			std::cerr << "Warning: ignoring specified positional arguments." << std::endl;
@@ -81,6 +158,40 @@ bool ProgramArguments::try_parse_impl(const std::vector<std::string> &arguments)
 	return true;
 }
 
+std::optional<std::size_t> ProgramArguments::try_parse_job_count(const std::string &value) {
+	std::size_t count = 0;
+	const char *end = value.data() + value.size();
+	const auto [parsed_end, error] = std::from_chars(value.data(), end, count);
+	if (error != std::errc() || parsed_end != end || count == 0)
+		return std::nullopt;
+	return count;
+}
+
+std::optional<std::size_t> ProgramArguments::try_parse_milliseconds(const std::string &value) {
+	std::size_t milliseconds = 0;
+	const char *end = value.data() + value.size();
+	const auto [parsed_end, error] = std::from_chars(value.data(), end, milliseconds);
+	if (error != std::errc() || parsed_end != end || value.empty())
+		return std::nullopt;
+	return milliseconds;
+}
+
+std::optional<ReflinkMode> ProgramArguments::try_parse_reflink_mode(const std::string &value) {
+	if (value == "auto") return ReflinkMode::automatic;
+	if (value == "always") return ReflinkMode::always;
+	if (value == "never") return ReflinkMode::never;
+	return std::nullopt;
+}
+
+const char *reflink_mode_to_string(const ReflinkMode mode) {
+	switch (mode) {
+		case ReflinkMode::never: return "never";
+		case ReflinkMode::automatic: return "auto";
+		case ReflinkMode::always: return "always";
+	}
+	return "unknown";
+}
+
 const char *flag_to_string(const bool enabled) {
 	return enabled ? "enabled" : "disabled";
 }
@@ -99,6 +210,17 @@ std::ostream &ProgramArguments::operator<<(std::ostream &stream) const {
 	stream << "    dry run: " << flag_to_string(dry_run) << std::endl;
 	stream << "Copy configs:" << flag_to_string(copy_configurations) << std::endl;
 	stream << "Delete extra:" << flag_to_string(delete_extra_target_files) << std::endl;
+	stream << "Jobs: " << job_count << std::endl;
+	stream << "Pipeline: " << flag_to_string(pipelined) << std::endl;
+	stream << "Manifest: " << flag_to_string(manifest) << std::endl;
+	stream << "Prune directories: " << flag_to_string(prune_directories) << std::endl;
+	stream << "Full scan: " << flag_to_string(full_scan) << std::endl;
+	stream << "Config cache: " << flag_to_string(config_cache) << std::endl;
+	stream << "State: " << flag_to_string(state) << std::endl;
+	stream << "Watch: " << flag_to_string(watch) << std::endl;
+	stream << "Reflink: " << reflink_mode_to_string(reflink_mode) << std::endl;
+	stream << "Delta transfer: " << flag_to_string(delta_transfer) << std::endl;
+	stream << "Checksum: " << flag_to_string(checksum) << std::endl;
 	stream << "Source dir: " << string_or_empty(source_directory) << std::endl;
 	stream << "Target dir: " << string_or_empty(target_directory) << std::endl;
 	return stream;
@@ -22,6 +22,16 @@ enum class ConflictResolutionMode {
 	rename,
 };
 
+/** Whether file contents are cloned (reflinked) on copy-on-write filesystems
+ * instead of being copied, see `--reflink`. */
+enum class ReflinkMode {
+	never,
+	/** Clone when the filesystem supports it, copy otherwise. */
+	automatic,
+	/** Clone, or fail if the filesystem does not support it. */
+	always,
+};
+
 /** The program arguments class, storing parsed flags and positional arguments.
  * Based on an instance of this class, the whole program and synchronization
  * is configured. */
@@ -36,6 +46,28 @@ class ProgramArguments {
 
 	bool is_one_way_synchronization = true;
 
+	std::size_t job_count = 1;
+	bool pipelined = false;
+	bool manifest = false;
+	bool prune_directories = false;
+	bool full_scan = false;
+
+	bool config_cache = false;
+	/** Empty for the default per-user cache file. */
+	std::string config_cache_path;
+
+	bool state = false;
+	/** Empty for the default per-user state file of the directory pair. */
+	std::string state_path;
+
+	bool watch = false;
+	/** Changes are collected until none arrives for this many milliseconds. */
+	std::size_t watch_debounce_milliseconds = 500;
+
+	ReflinkMode reflink_mode = ReflinkMode::automatic;
+	bool delta_transfer = false;
+	bool checksum = false;
+
 	ConflictResolutionMode conflict_resolution = ConflictResolutionMode::overwrite_with_newer;
 
 	std::string source_directory;
@@ -53,6 +85,34 @@ class ProgramArguments {
 	bool should_delete_extra_target_files() const { return delete_extra_target_files; }
 
 	bool is_one_way() const { return is_one_way_synchronization; }
+	/** Number of threads used for synchronization, one means the serial algorithm. */
+	std::size_t get_job_count() const { return job_count; }
+	bool is_parallel() const { return job_count > 1; }
+	/** Whether one-way synchronization runs as a scan / plan / execute pipeline. */
+	bool is_pipelined() const { return pipelined; }
+	/** Whether one-way synchronization keeps a manifest of written files in the target root. */
+	bool uses_manifest() const { return manifest; }
+	/** Whether unchanged source directories (recorded in the manifest) are skipped. */
+	bool prunes_directories() const { return prune_directories; }
+	/** Whether this run examines every directory, refreshing the pruning records. */
+	bool is_full_scan() const { return full_scan; }
+	/** Whether parsed directory configurations are kept in a persistent cache file. */
+	bool uses_config_cache() const { return config_cache; }
+	/** The cache file, empty for the default per-user location. */
+	const std::string &get_config_cache_path() const { return config_cache_path; }
+	/** Whether two-way synchronization reconciles with the recorded state of the last run. */
+	bool uses_state() const { return state; }
+	/** The state file, empty for the default per-user location. */
+	const std::string &get_state_path() const { return state_path; }
+	/** Whether the directories are kept synchronized after the first run, see `watch_directories`. */
+	bool watches() const { return watch; }
+	std::size_t get_watch_debounce_milliseconds() const { return watch_debounce_milliseconds; }
+	ReflinkMode get_reflink_mode() const { return reflink_mode; }
+	/** Whether overwritten large files are updated by an rsync-style delta transfer. */
+	bool uses_delta_transfer() const { return delta_transfer; }
+	/** Whether existing files are compared by their sizes and contents (hashes) besides their last write times,
+	 * so touched but identical files are not copied and changes keeping the last write time are not missed. */
+	bool uses_checksum() const { return checksum; }
 	ConflictResolutionMode get_conflict_resolution_mode() const {
 		return conflict_resolution;
 	}
@@ -79,6 +139,9 @@ class ProgramArguments {
 
 	private:
 	bool try_parse_impl(const std::vector<std::string> &arguments);
+	static std::optional<std::size_t> try_parse_job_count(const std::string &value);
+	static std::optional<ReflinkMode> try_parse_reflink_mode(const std::string &value);
+	static std::optional<std::size_t> try_parse_milliseconds(const std::string &value);
 
 	friend class ProgramArgumentsBuilder;
 
@@ -112,6 +175,10 @@ class ProgramArgumentsBuilder {
 		arguments.is_one_way_synchronization = false;
 		return *this;
 	}
+	Self &set_delete_extra(const bool d) {
+		arguments.delete_extra_target_files = d;
+		return *this;
+	}
 	Self &set_verbosity(const bool v) {
 		arguments.verbose = v;
 		return *this;
@@ -120,6 +187,56 @@ class ProgramArgumentsBuilder {
 		arguments.conflict_resolution = mode;
 		return *this;
 	}
+	Self &set_job_count(const std::size_t count) {
+		arguments.job_count = count;
+		return *this;
+	}
+	Self &set_reflink_mode(const ReflinkMode m) {
+		arguments.reflink_mode = m;
+		return *this;
+	}
+	Self &set_delta_transfer(const bool d) {
+		arguments.delta_transfer = d;
+		return *this;
+	}
+	Self &set_checksum(const bool c) {
+		arguments.checksum = c;
+		return *this;
+	}
+	Self &set_pipelined(const bool p) {
+		arguments.pipelined = p;
+		return *this;
+	}
+	Self &set_manifest(const bool m) {
+		arguments.manifest = m;
+		return *this;
+	}
+	Self &set_prune_directories(const bool p) {
+		arguments.prune_directories = p;
+		if (p) arguments.manifest = true;
+		return *this;
+	}
+	Self &set_full_scan(const bool f) {
+		arguments.full_scan = f;
+		return *this;
+	}
+	/** Enables the configuration cache, an empty path means the default per-user location. */
+	Self &set_config_cache(const bool c, const std::string &path = "") {
+		arguments.config_cache = c;
+		arguments.config_cache_path = path;
+		return *this;
+	}
+	Self &set_watch(const bool w, const std::size_t debounce_milliseconds = 500) {
+		arguments.watch = w;
+		arguments.watch_debounce_milliseconds = debounce_milliseconds;
+		return *this;
+	}
+	/** Enables the synchronization state, an empty path means the default per-user location. */
+	Self &set_state(const bool s, const std::string &path = "") {
+		arguments.state = s;
+		arguments.state_path = path;
+		return *this;
+	}
 };
 
 #endif // DIRSYNC_ARGUMENTS_HPP
@@ -0,0 +1,79 @@
+#ifndef DIRSYNC_BOUNDED_QUEUE_HPP
+#define DIRSYNC_BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+/** A blocking multi-producer multi-consumer FIFO queue with a fixed capacity.
+ * Producers wait while the queue is full, consumers wait while it is empty.
+ * After `close`, producers are rejected and consumers drain the remaining items. */
+template<typename T>
+class BoundedQueue {
+	std::mutex mutex;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+	std::deque<T> items;
+	const std::size_t capacity;
+	bool closed = false;
+
+	public:
+	explicit BoundedQueue(const std::size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+	BoundedQueue(const BoundedQueue &) = delete;
+	BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+	/** Blocks until there is free space.
+	 * @return false if the queue was closed and the item was not enqueued */
+	bool push(T item) {
+		std::unique_lock lock(mutex);
+		not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+		if (closed) return false;
+
+		items.push_back(std::move(item));
+		lock.unlock();
+		not_empty.notify_one();
+		return true;
+	}
+
+	/** Enqueues the item only if there is free space, never blocks.
+	 * The item is moved from only on success. */
+	bool try_push(T &&item) {
+		std::unique_lock lock(mutex);
+		if (closed || items.size() >= capacity) return false;
+
+		items.push_back(std::move(item));
+		lock.unlock();
+		not_empty.notify_one();
+		return true;
+	}
+
+	/** Blocks until an item is available.
+	 * @return no value if the queue was closed and is fully drained */
+	std::optional<T> pop() {
+		std::unique_lock lock(mutex);
+		not_empty.wait(lock, [this] { return closed || !items.empty(); });
+		if (items.empty()) return std::nullopt;
+
+		std::optional<T> item(std::move(items.front()));
+		items.pop_front();
+		lock.unlock();
+		not_full.notify_one();
+		return item;
+	}
+
+	/** Rejects further pushes and wakes up every waiting thread. */
+	void close() {
+		{
+			std::lock_guard lock(mutex);
+			closed = true;
+		}
+		not_empty.notify_all();
+		not_full.notify_all();
+	}
+};
+
+#endif //DIRSYNC_BOUNDED_QUEUE_HPP
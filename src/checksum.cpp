@@ -0,0 +1,415 @@
+#include "checksum.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "file_descriptor.hpp"
+#else
+#include <fstream>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace {
+	constexpr std::size_t LANE_COUNT = 8;
+	constexpr std::size_t STRIPE_SIZE = LANE_COUNT * sizeof(std::uint64_t);
+	constexpr std::size_t STRIPES_PER_BLOCK = 16;
+
+	// every stripe of a block is mixed with its own window of keys, so swapped stripes change the sum
+	constexpr std::size_t SCRAMBLE_KEYS = 24;
+	constexpr std::size_t MERGE_KEYS = 32;
+	constexpr std::size_t KEY_COUNT = 48;
+	static_assert(STRIPES_PER_BLOCK - 1 + LANE_COUNT <= SCRAMBLE_KEYS);
+
+	constexpr std::uint64_t PRIME32_1 = 0x9e3779b1;
+	constexpr std::uint64_t PRIME64_1 = 0x9e3779b185ebca87;
+	constexpr std::uint64_t PRIME64_2 = 0xc2b2ae3d27d4eb4f;
+
+	/** Read from the files at once; a multiple of the stripe size and of the usual page and block sizes. */
+	constexpr std::size_t CHUNK_SIZE = 1 << 20;
+	constexpr std::size_t CHUNK_ALIGNMENT = 4096;
+
+	/** Pseudo-random keys from splitmix64. */
+	constexpr std::array<std::uint64_t, KEY_COUNT> generate_keys() {
+		std::array<std::uint64_t, KEY_COUNT> keys {};
+		std::uint64_t state = PRIME64_2;
+		for (std::uint64_t &key : keys) {
+			state += 0x9e3779b97f4a7c15;
+			std::uint64_t mixed = state;
+			mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9;
+			mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111eb;
+			key = mixed ^ (mixed >> 31);
+		}
+		return keys;
+	}
+
+	alignas(64) constexpr std::array<std::uint64_t, KEY_COUNT> KEYS = generate_keys();
+
+	std::uint64_t load64(const std::byte *data) {
+		std::uint64_t value;
+		std::memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	/** The upper and the lower half of the 128-bit product, combined. */
+	std::uint64_t multiply_fold(const std::uint64_t first, const std::uint64_t second) {
+#if defined(__SIZEOF_INT128__)
+		const unsigned __int128 product = static_cast<unsigned __int128>(first) * second;
+		return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+#else
+		const std::uint64_t low_low = (first & 0xffffffff) * (second & 0xffffffff);
+		const std::uint64_t high_low = (first >> 32) * (second & 0xffffffff);
+		const std::uint64_t low_high = (first & 0xffffffff) * (second >> 32);
+		const std::uint64_t high_high = (first >> 32) * (second >> 32);
+		const std::uint64_t cross = (low_low >> 32) + (high_low & 0xffffffff) + low_high;
+		const std::uint64_t upper = high_high + (high_low >> 32) + (cross >> 32);
+		const std::uint64_t lower = (cross << 32) | (low_low & 0xffffffff);
+		return lower ^ upper;
+#endif
+	}
+
+	std::uint64_t avalanche(std::uint64_t hash) {
+		hash ^= hash >> 37;
+		hash *= 0x165667919e3779f9;
+		return hash ^ (hash >> 32);
+	}
+
+	/** Accumulates whole stripes of one block.
+	 * @param first_stripe the position of the first stripe in its block, which selects the keys */
+	using AccumulateFunction = void (*)(std::uint64_t *accumulators, const std::byte *data, std::size_t stripe_count, std::size_t first_stripe);
+	/** Scrambles the accumulators after a block, so the order of blocks matters. */
+	using ScrambleFunction = void (*)(std::uint64_t *accumulators);
+
+	struct HashKernel {
+		const char *name;
+		AccumulateFunction accumulate;
+		ScrambleFunction scramble;
+	};
+
+	[[maybe_unused]] void accumulate_scalar(
+		std::uint64_t *accumulators,
+		const std::byte *data,
+		const std::size_t stripe_count,
+		const std::size_t first_stripe
+	) {
+		for (std::size_t stripe = 0; stripe < stripe_count; stripe++) {
+			const std::byte *stripe_data = data + stripe * STRIPE_SIZE;
+			const std::uint64_t *keys = KEYS.data() + first_stripe + stripe;
+			for (std::size_t lane = 0; lane < LANE_COUNT; lane++) {
+				const std::uint64_t value = load64(stripe_data + lane * sizeof(std::uint64_t));
+				const std::uint64_t neighbour = load64(stripe_data + (lane ^ 1) * sizeof(std::uint64_t));
+				const std::uint64_t mixed = value ^ keys[lane];
+				accumulators[lane] += neighbour + (mixed & 0xffffffff) * (mixed >> 32);
+			}
+		}
+	}
+
+	[[maybe_unused]] void scramble_scalar(std::uint64_t *accumulators) {
+		for (std::size_t lane = 0; lane < LANE_COUNT; lane++) {
+			std::uint64_t accumulator = accumulators[lane];
+			accumulator ^= accumulator >> 47;
+			accumulator ^= KEYS[SCRAMBLE_KEYS + lane];
+			accumulators[lane] = accumulator * PRIME32_1;
+		}
+	}
+
+#if defined(__x86_64__) || defined(_M_X64)
+	// SSE2 is a part of x86-64, two lanes per register
+	void accumulate_sse2(
+		std::uint64_t *accumulators,
+		const std::byte *data,
+		const std::size_t stripe_count,
+		const std::size_t first_stripe
+	) {
+		__m128i *const accumulator_vectors = reinterpret_cast<__m128i *>(accumulators);
+		__m128i sums[LANE_COUNT / 2];
+		for (std::size_t i = 0; i < LANE_COUNT / 2; i++) sums[i] = _mm_loadu_si128(accumulator_vectors + i);
+
+		for (std::size_t stripe = 0; stripe < stripe_count; stripe++) {
+			const __m128i *values = reinterpret_cast<const __m128i *>(data + stripe * STRIPE_SIZE);
+			const __m128i *keys = reinterpret_cast<const __m128i *>(KEYS.data() + first_stripe + stripe);
+			for (std::size_t i = 0; i < LANE_COUNT / 2; i++) {
+				const __m128i value = _mm_loadu_si128(values + i);
+				const __m128i mixed = _mm_xor_si128(value, _mm_loadu_si128(keys + i));
+				// the low 32 bits of every lane times its high 32 bits
+				const __m128i product = _mm_mul_epu32(mixed, _mm_shuffle_epi32(mixed, _MM_SHUFFLE(0, 3, 0, 1)));
+				const __m128i neighbour = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+				sums[i] = _mm_add_epi64(sums[i], _mm_add_epi64(product, neighbour));
+			}
+		}
+
+		for (std::size_t i = 0; i < LANE_COUNT / 2; i++) _mm_storeu_si128(accumulator_vectors + i, sums[i]);
+	}
+
+	void scramble_sse2(std::uint64_t *accumulators) {
+		__m128i *const accumulator_vectors = reinterpret_cast<__m128i *>(accumulators);
+		const __m128i *keys = reinterpret_cast<const __m128i *>(KEYS.data() + SCRAMBLE_KEYS);
+		const __m128i prime = _mm_set1_epi32(static_cast<int>(PRIME32_1));
+
+		for (std::size_t i = 0; i < LANE_COUNT / 2; i++) {
+			__m128i accumulator = _mm_loadu_si128(accumulator_vectors + i);
+			accumulator = _mm_xor_si128(accumulator, _mm_srli_epi64(accumulator, 47));
+			accumulator = _mm_xor_si128(accumulator, _mm_loadu_si128(keys + i));
+			// a 64-bit product from two 32-bit ones
+			const __m128i low = _mm_mul_epu32(accumulator, prime);
+			const __m128i high = _mm_mul_epu32(_mm_srli_epi64(accumulator, 32), prime);
+			_mm_storeu_si128(accumulator_vectors + i, _mm_add_epi64(low, _mm_slli_epi64(high, 32)));
+		}
+	}
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	// compiled for AVX2 regardless of the target flags, only called if the processor supports it
+	__attribute__((target("avx2"))) void accumulate_avx2(
+		std::uint64_t *accumulators,
+		const std::byte *data,
+		const std::size_t stripe_count,
+		const std::size_t first_stripe
+	) {
+		__m256i *const accumulator_vectors = reinterpret_cast<__m256i *>(accumulators);
+		__m256i sums[LANE_COUNT / 4];
+		for (std::size_t i = 0; i < LANE_COUNT / 4; i++) sums[i] = _mm256_loadu_si256(accumulator_vectors + i);
+
+		for (std::size_t stripe = 0; stripe < stripe_count; stripe++) {
+			const __m256i *values = reinterpret_cast<const __m256i *>(data + stripe * STRIPE_SIZE);
+			const __m256i *keys = reinterpret_cast<const __m256i *>(KEYS.data() + first_stripe + stripe);
+			for (std::size_t i = 0; i < LANE_COUNT / 4; i++) {
+				const __m256i value = _mm256_loadu_si256(values + i);
+				const __m256i mixed = _mm256_xor_si256(value, _mm256_loadu_si256(keys + i));
+				const __m256i product = _mm256_mul_epu32(mixed, _mm256_shuffle_epi32(mixed, _MM_SHUFFLE(0, 3, 0, 1)));
+				const __m256i neighbour = _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+				sums[i] = _mm256_add_epi64(sums[i], _mm256_add_epi64(product, neighbour));
+			}
+		}
+
+		for (std::size_t i = 0; i < LANE_COUNT / 4; i++) _mm256_storeu_si256(accumulator_vectors + i, sums[i]);
+	}
+
+	__attribute__((target("avx2"))) void scramble_avx2(std::uint64_t *accumulators) {
+		__m256i *const accumulator_vectors = reinterpret_cast<__m256i *>(accumulators);
+		const __m256i *keys = reinterpret_cast<const __m256i *>(KEYS.data() + SCRAMBLE_KEYS);
+		const __m256i prime = _mm256_set1_epi32(static_cast<int>(PRIME32_1));
+
+		for (std::size_t i = 0; i < LANE_COUNT / 4; i++) {
+			__m256i accumulator = _mm256_loadu_si256(accumulator_vectors + i);
+			accumulator = _mm256_xor_si256(accumulator, _mm256_srli_epi64(accumulator, 47));
+			accumulator = _mm256_xor_si256(accumulator, _mm256_loadu_si256(keys + i));
+			const __m256i low = _mm256_mul_epu32(accumulator, prime);
+			const __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(accumulator, 32), prime);
+			_mm256_storeu_si256(accumulator_vectors + i, _mm256_add_epi64(low, _mm256_slli_epi64(high, 32)));
+		}
+	}
+#endif
+
+	const HashKernel &selected_kernel() {
+		static const HashKernel kernel = [] {
+#if defined(__x86_64__) && defined(__GNUC__)
+			if (__builtin_cpu_supports("avx2")) return HashKernel {"avx2", accumulate_avx2, scramble_avx2};
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+			return HashKernel {"sse2", accumulate_sse2, scramble_sse2};
+#else
+			return HashKernel {"scalar", accumulate_scalar, scramble_scalar};
+#endif
+		}();
+		return kernel;
+	}
+
+	struct AlignedDelete {
+		void operator()(std::byte *buffer) const { ::operator delete[](buffer, std::align_val_t(CHUNK_ALIGNMENT)); }
+	};
+
+	/** Two chunks per thread, allocated once: fresh pages of a large allocation would be faulted in per file. */
+	std::span<std::byte> chunk_buffers() {
+		thread_local const std::unique_ptr<std::byte[], AlignedDelete> buffer(
+			static_cast<std::byte *>(::operator new[](2 * CHUNK_SIZE, std::align_val_t(CHUNK_ALIGNMENT)))
+		);
+		return {buffer.get(), 2 * CHUNK_SIZE};
+	}
+
+	/** Reads a file sequentially in whole chunks. */
+	class ChunkReader {
+#if defined(__unix__) || defined(__APPLE__)
+		UniqueDescriptor fd;
+#else
+		std::ifstream file;
+#endif
+
+		public:
+		std::error_code open(const fs::path &path) {
+#if defined(__unix__) || defined(__APPLE__)
+			fd = UniqueDescriptor(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+			if (!fd.valid()) return last_error();
+#if defined(__linux__)
+			// a larger read-ahead window
+			::posix_fadvise(fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+			file.open(path, std::ios::binary);
+			if (!file) return std::make_error_code(std::errc::io_error);
+#endif
+			return {};
+		}
+
+		/** Fills the chunk; it is shorter only at the end of the file.
+		 * @param size output parameter, the number of bytes read */
+		std::error_code read(const std::span<std::byte> chunk, std::size_t &size) {
+			size = 0;
+#if defined(__unix__) || defined(__APPLE__)
+			while (size < chunk.size()) {
+				const ssize_t count = ::read(fd.get(), chunk.data() + size, chunk.size() - size);
+				if (count < 0) {
+					if (errno == EINTR) continue;
+					return last_error();
+				}
+				if (count == 0) break;
+				size += static_cast<std::size_t>(count);
+			}
+#else
+			file.read(reinterpret_cast<char *>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+			if (file.bad()) return std::make_error_code(std::errc::io_error);
+			size = static_cast<std::size_t>(file.gcount());
+#endif
+			return {};
+		}
+	};
+}
+
+ContentHasher::ContentHasher() : accumulators {
+	// the initial accumulators of XXH3
+	0xc2b2ae3d, PRIME64_1, PRIME64_2, 0x165667b19e3779f9,
+	0x85ebca77c2b2ae63, 0x85ebca77, 0x27d4eb2f165667c5, PRIME32_1
+} {}
+
+void ContentHasher::accumulate_stripes(const std::byte *data, std::size_t stripe_count) {
+	const HashKernel &kernel = selected_kernel();
+	while (stripe_count > 0) {
+		const std::size_t count = std::min(stripe_count, STRIPES_PER_BLOCK - block_stripes);
+		kernel.accumulate(accumulators.data(), data, count, block_stripes);
+		data += count * STRIPE_SIZE;
+		stripe_count -= count;
+
+		block_stripes += count;
+		if (block_stripes == STRIPES_PER_BLOCK) {
+			kernel.scramble(accumulators.data());
+			block_stripes = 0;
+		}
+	}
+}
+
+void ContentHasher::update(std::span<const std::byte> data) {
+	length += data.size();
+
+	if (pending_size > 0) {
+		const std::size_t taken = std::min(data.size(), STRIPE_SIZE - pending_size);
+		std::memcpy(pending.data() + pending_size, data.data(), taken);
+		pending_size += taken;
+		data = data.subspan(taken);
+		if (pending_size < STRIPE_SIZE) return;
+
+		accumulate_stripes(pending.data(), 1);
+		pending_size = 0;
+	}
+
+	const std::size_t stripe_count = data.size() / STRIPE_SIZE;
+	accumulate_stripes(data.data(), stripe_count);
+	data = data.subspan(stripe_count * STRIPE_SIZE);
+
+	if (!data.empty()) std::memcpy(pending.data(), data.data(), data.size());
+	pending_size = data.size();
+}
+
+ContentDigest ContentHasher::digest() const {
+	std::array<std::uint64_t, LANE_COUNT> final_accumulators = accumulators;
+	if (pending_size > 0) {
+		// padded with zeros, the length tells the padding apart from data
+		std::array<std::byte, STRIPE_SIZE> last_stripe {};
+		std::memcpy(last_stripe.data(), pending.data(), pending_size);
+		selected_kernel().accumulate(final_accumulators.data(), last_stripe.data(), 1, block_stripes);
+	}
+
+	ContentDigest digest;
+	digest.low = length * PRIME64_1;
+	digest.high = ~length * PRIME64_2;
+	for (std::size_t lane = 0; lane < LANE_COUNT; lane += 2) {
+		digest.low += multiply_fold(
+			final_accumulators[lane] ^ KEYS[MERGE_KEYS + lane],
+			final_accumulators[lane + 1] ^ KEYS[MERGE_KEYS + lane + 1]
+		);
+		digest.high += multiply_fold(
+			final_accumulators[lane] ^ KEYS[MERGE_KEYS + LANE_COUNT + lane],
+			final_accumulators[lane + 1] ^ KEYS[MERGE_KEYS + LANE_COUNT + lane + 1]
+		);
+	}
+	digest.low = avalanche(digest.low);
+	digest.high = avalanche(digest.high);
+	return digest;
+}
+
+bool ContentHasher::has_equal_state(const ContentHasher &other) const {
+	return length == other.length
+		&& accumulators == other.accumulators
+		&& std::memcmp(pending.data(), other.pending.data(), pending_size) == 0;
+}
+
+const char *ContentHasher::implementation_name() {
+	return selected_kernel().name;
+}
+
+std::error_code compare_file_contents(
+	const fs::path &first,
+	const fs::path &second,
+	bool &equal,
+	RunStatistics &statistics
+) {
+	const std::chrono::steady_clock::time_point started_at = std::chrono::steady_clock::now();
+
+	ChunkReader first_reader, second_reader;
+	if (const std::error_code error = first_reader.open(first)) return error;
+	if (const std::error_code error = second_reader.open(second)) return error;
+
+	const std::span<std::byte> buffers = chunk_buffers();
+	const std::span<std::byte> first_chunk = buffers.first(CHUNK_SIZE);
+	const std::span<std::byte> second_chunk = buffers.last(CHUNK_SIZE);
+
+	ContentHasher first_hasher, second_hasher;
+	std::uintmax_t hashed_bytes = 0;
+	std::error_code error;
+	while (true) {
+		std::size_t first_size = 0, second_size = 0;
+		error = first_reader.read(first_chunk, first_size);
+		if (!error) error = second_reader.read(second_chunk, second_size);
+		if (error) break;
+
+		first_hasher.update(first_chunk.first(first_size));
+		second_hasher.update(second_chunk.first(second_size));
+		hashed_bytes += first_size + second_size;
+
+		// a file changed its size meanwhile
+		if (first_size != second_size) {
+			equal = false;
+			break;
+		}
+		if (first_size < CHUNK_SIZE) {
+			equal = first_hasher.digest() == second_hasher.digest();
+			break;
+		}
+		if (!first_hasher.has_equal_state(second_hasher)) {
+			equal = false;
+			break;
+		}
+	}
+
+	statistics.record_checksum(hashed_bytes, std::chrono::steady_clock::now() - started_at);
+	return error;
+}
@@ -0,0 +1,68 @@
+#ifndef DIRSYNC_CHECKSUM_HPP
+#define DIRSYNC_CHECKSUM_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <system_error>
+
+#include "statistics.hpp"
+
+namespace fs = std::filesystem;
+
+/** A 128-bit digest of file contents. */
+struct ContentDigest {
+	std::uint64_t low = 0;
+	std::uint64_t high = 0;
+
+	bool operator==(const ContentDigest &) const = default;
+};
+
+/** A streaming 128-bit hash of file contents for `--checksum`, built like the long-input loop of XXH3:
+ * eight 64-bit accumulators take 64-byte stripes, every lane adds a 32x32-bit product of the data mixed
+ * with a key, and the accumulators are scrambled after every block of 16 stripes. The lanes are independent,
+ * so the stripes are processed by AVX2 or SSE2 on x86-64 (chosen at run time) and by a scalar loop elsewhere,
+ * all with the same result. The keys differ from XXH3, the digests are only compared within a run.
+ * Not a cryptographic hash: it detects changes, not tampering. */
+class ContentHasher {
+	alignas(32) std::array<std::uint64_t, 8> accumulators;
+	/** The stripes of the current block already accumulated. */
+	std::size_t block_stripes = 0;
+	std::uint64_t length = 0;
+
+	/** The bytes of an incomplete stripe, accumulated when it is completed or finished. */
+	alignas(32) std::array<std::byte, 64> pending {};
+	std::size_t pending_size = 0;
+
+	void accumulate_stripes(const std::byte *data, std::size_t stripe_count);
+
+	public:
+	ContentHasher();
+
+	void update(std::span<const std::byte> data);
+
+	/** The digest of all data given so far; the hasher is left unchanged. */
+	ContentDigest digest() const;
+
+	/** Whether both hashers have consumed equal data, except for a hash collision. Cheaper than the digest,
+	 * it tells apart files of the same size by the first chunk after which their contents differ. */
+	bool has_equal_state(const ContentHasher &other) const;
+
+	/** The name of the vectorized implementation used, e.g. "avx2". */
+	static const char *implementation_name();
+};
+
+/** Compares the contents of two files of the same size (`--checksum`). Both files are read chunk by chunk
+ * in lockstep and hashed, the comparison stops at the first chunk after which the hash states differ.
+ * The hashed bytes and the time spent are added to the statistics.
+ * @param equal output parameter, whether the files have the same content */
+std::error_code compare_file_contents(
+	const fs::path &first,
+	const fs::path &second,
+	bool &equal,
+	RunStatistics &statistics
+);
+
+#endif //DIRSYNC_CHECKSUM_HPP
@@ -0,0 +1,223 @@
+#include "configuration-cache.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+	constexpr char CACHE_MAGIC[8] = {'D', 'I', 'R', 'S', 'Y', 'N', 'C', 'C'};
+	constexpr std::uint32_t CACHE_VERSION = 1;
+
+	struct CacheHeader {
+		char magic[8];
+		std::uint32_t version;
+		/** Guards against a different record layout (or byte order, together with the version). */
+		std::uint32_t record_size;
+		std::uint64_t record_count;
+		std::uint64_t data_size;
+	};
+
+	static_assert(std::is_trivially_copyable_v<CacheHeader>);
+	static_assert(std::is_trivially_copyable_v<ConfigurationCacheRecord>);
+	static_assert(sizeof(CacheHeader) % alignof(ConfigurationCacheRecord) == 0);
+
+	bool is_valid_cache(const std::byte *data, const std::size_t size, CacheHeader &header) {
+		if (size < sizeof(CacheHeader)) return false;
+		std::memcpy(&header, data, sizeof(CacheHeader));
+
+		if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) return false;
+		if (header.version != CACHE_VERSION || header.record_size != sizeof(ConfigurationCacheRecord)) return false;
+
+		const std::uint64_t available = size - sizeof(CacheHeader);
+		if (header.record_count > available / sizeof(ConfigurationCacheRecord)) return false;
+		return header.data_size == available - header.record_count * sizeof(ConfigurationCacheRecord);
+	}
+
+	/** The cache key, independent of the working directory. */
+	std::string cache_key(const fs::path &config_file) {
+		std::error_code error;
+		const fs::path absolute = fs::absolute(config_file, error);
+		if (error) return {};
+		return absolute.lexically_normal().generic_string();
+	}
+}
+
+ConfigurationCache::ConfigurationCache(fs::path file_path) : file_path(std::move(file_path)) {
+	const std::byte *content = nullptr;
+	std::size_t size = 0;
+
+#if defined(__unix__) || defined(__APPLE__)
+	const UniqueDescriptor fd(::open(this->file_path.c_str(), O_RDONLY | O_CLOEXEC));
+	struct stat status {};
+	if (!fd.valid() || ::fstat(fd.get(), &status) < 0 || !S_ISREG(status.st_mode)) return;
+	if (mapping.map(fd.get(), static_cast<std::size_t>(status.st_size))) return;
+	content = mapping.data();
+	size = mapping.size();
+#else
+	std::ifstream file(this->file_path, std::ios::binary);
+	if (!file) return;
+	std::vector<char> bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+	buffer.resize(bytes.size());
+	std::memcpy(buffer.data(), bytes.data(), bytes.size());
+	content = buffer.data();
+	size = buffer.size();
+#endif
+
+	CacheHeader header {};
+	if (!is_valid_cache(content, size, header)) return;
+
+	records = reinterpret_cast<const ConfigurationCacheRecord *>(content + sizeof(CacheHeader));
+	record_count = header.record_count;
+	data = std::string_view(reinterpret_cast<const char *>(records + record_count), header.data_size);
+}
+
+std::optional<fs::path> ConfigurationCache::default_path() {
+	if (const char *cache_home = std::getenv("XDG_CACHE_HOME"); cache_home != nullptr && *cache_home != '\0')
+		return fs::path(cache_home) / "dirsync" / "configurations";
+	if (const char *home = std::getenv("HOME"); home != nullptr && *home != '\0')
+		return fs::path(home) / ".cache" / "dirsync" / "configurations";
+	return std::nullopt;
+}
+
+std::string_view ConfigurationCache::string_at(const std::uint64_t offset, const std::uint64_t length) const {
+	// a damaged record cannot point outside of the data section
+	if (offset > data.size() || length > data.size() - offset) return {};
+	return data.substr(offset, length);
+}
+
+bool ConfigurationCache::find(
+	const fs::path &config_file,
+	const FileMetadata &metadata,
+	DirectoryConfiguration &configuration
+) const {
+	const std::string key = cache_key(config_file);
+	if (key.empty()) return false;
+
+	const ConfigurationCacheRecord *end = records + record_count;
+	const ConfigurationCacheRecord *found = std::lower_bound(
+		records,
+		end,
+		key,
+		[this](const ConfigurationCacheRecord &record, const std::string_view path) {
+			return string_at(record.path_offset, record.path_length) < path;
+		}
+	);
+
+	if (found == end || string_at(found->path_offset, found->path_length) != key) return false;
+	if (found->size != metadata.size || found->modified != to_nanoseconds(metadata.modified)
+		|| found->inode != metadata.inode)
+		return false;
+
+	return DirectoryConfiguration::decode(
+		string_at(found->configuration_offset, found->configuration_length),
+		configuration
+	);
+}
+
+void ConfigurationCache::store(
+	const fs::path &config_file,
+	const FileMetadata &metadata,
+	const DirectoryConfiguration &configuration
+) {
+	PendingEntry entry {cache_key(config_file), {}, {}};
+	if (entry.path.empty()) return;
+
+	entry.record.size = metadata.size;
+	entry.record.modified = to_nanoseconds(metadata.modified);
+	entry.record.inode = metadata.inode;
+	configuration.encode(entry.configuration);
+
+	std::lock_guard lock(pending_mutex);
+	pending.push_back(std::move(entry));
+}
+
+std::error_code ConfigurationCache::save() {
+	std::lock_guard lock(pending_mutex);
+	if (pending.empty()) return {};
+
+	// the new entries replace the previous ones of the same files, other entries are carried over
+	std::vector<PendingEntry> carried_over;
+	{
+		std::unordered_set<std::string_view> replaced;
+		for (const PendingEntry &entry : pending) replaced.insert(entry.path);
+		for (const ConfigurationCacheRecord &record : std::span(records, record_count)) {
+			const std::string_view path = string_at(record.path_offset, record.path_length);
+			if (path.empty() || replaced.contains(path)) continue;
+			carried_over.push_back({
+				std::string(path),
+				record,
+				std::string(string_at(record.configuration_offset, record.configuration_length))
+			});
+		}
+	}
+	pending.insert(pending.end(), std::make_move_iterator(carried_over.begin()), std::make_move_iterator(carried_over.end()));
+
+	std::ranges::sort(pending, {}, &PendingEntry::path);
+	const auto duplicates = std::ranges::unique(pending, {}, &PendingEntry::path);
+	pending.erase(duplicates.begin(), duplicates.end());
+
+	std::vector<ConfigurationCacheRecord> sorted_records;
+	sorted_records.reserve(pending.size());
+	std::string sorted_data;
+
+	for (PendingEntry &entry : pending) {
+		ConfigurationCacheRecord &record = entry.record;
+		record.path_offset = sorted_data.size();
+		record.path_length = static_cast<std::uint32_t>(entry.path.size());
+		sorted_data += entry.path;
+		record.configuration_offset = sorted_data.size();
+		record.configuration_length = static_cast<std::uint32_t>(entry.configuration.size());
+		sorted_data += entry.configuration;
+		sorted_records.push_back(record);
+	}
+	pending.clear();
+
+	CacheHeader header {};
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.record_size = sizeof(ConfigurationCacheRecord);
+	header.record_count = sorted_records.size();
+	header.data_size = sorted_data.size();
+
+	std::error_code error;
+	fs::create_directories(file_path.parent_path(), error);
+	if (error) return error;
+
+	// the previous cache may still be mapped, and other runs may read it, it is replaced by renaming
+	fs::path temporary_path = file_path;
+	temporary_path += ".tmp";
+#if defined(__unix__) || defined(__APPLE__)
+	temporary_path += std::to_string(::getpid());
+#endif
+	{
+		std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(
+			reinterpret_cast<const char *>(sorted_records.data()),
+			static_cast<std::streamsize>(sorted_records.size() * sizeof(ConfigurationCacheRecord))
+		);
+		file.write(sorted_data.data(), static_cast<std::streamsize>(sorted_data.size()));
+		file.close();
+		if (!file) {
+			fs::remove(temporary_path, error);
+			return std::make_error_code(std::errc::io_error);
+		}
+	}
+
+	fs::rename(temporary_path, file_path, error);
+	return error;
+}
@@ -0,0 +1,93 @@
+#ifndef DIRSYNC_CONFIGURATION_CACHE_HPP
+#define DIRSYNC_CONFIGURATION_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include "../file_descriptor.hpp"
+#endif
+
+#include "configuration.hpp"
+#include "../file_metadata.hpp"
+
+/** A fixed-size cache record, as stored in the file. Records are sorted by the absolute path
+ * of the configuration file, the paths and encoded configurations follow in a data section. */
+struct ConfigurationCacheRecord {
+	std::uint64_t path_offset;
+	std::uint32_t path_length;
+	std::uint32_t configuration_length;
+	std::uint64_t configuration_offset;
+	/** The identity of the configuration file version which was parsed. */
+	std::uint64_t size;
+	/** Nanoseconds since the file clock epoch, see `to_nanoseconds`. */
+	std::int64_t modified;
+	std::uint64_t inode;
+};
+
+/** A persistent cache of parsed directory configurations, shared by all runs of the user (`--config-cache`).
+ * A configuration is reused while its file keeps the same path, size, last write time and inode,
+ * so only new and changed configuration files are parsed. The cache of the previous runs is memory-mapped
+ * and searched by binary search, new entries are collected and written at the end of the run.
+ * Shared by parallel tasks, the methods are thread-safe.
+ *
+ * File layout (native byte order): header, sorted `ConfigurationCacheRecord`s, data section. */
+class ConfigurationCache {
+	const std::filesystem::path file_path;
+
+	// the cache of previous runs; an invalid or missing file is treated as empty
+#if defined(__unix__) || defined(__APPLE__)
+	MappedFile mapping;
+#else
+	std::vector<std::byte> buffer;
+#endif
+	const ConfigurationCacheRecord *records = nullptr;
+	std::size_t record_count = 0;
+	std::string_view data;
+
+	struct PendingEntry {
+		std::string path;
+		ConfigurationCacheRecord record;
+		std::string configuration;
+	};
+
+	std::mutex pending_mutex;
+	std::vector<PendingEntry> pending;
+
+	std::string_view string_at(std::uint64_t offset, std::uint64_t length) const;
+
+	public:
+	/** Loads the cache file, if any. */
+	explicit ConfigurationCache(std::filesystem::path file_path);
+
+	/** The per-user cache file, `$XDG_CACHE_HOME/dirsync/configurations` or `~/.cache/dirsync/configurations`. */
+	static std::optional<std::filesystem::path> default_path();
+
+	/** Finds the configuration parsed from the same version of the file.
+	 * @param configuration output parameter of the cached configuration, with the patterns compiled
+	 * @return true if found */
+	bool find(
+		const std::filesystem::path &config_file,
+		const FileMetadata &metadata,
+		DirectoryConfiguration &configuration
+	) const;
+
+	/** Adds a newly parsed configuration to the cache. */
+	void store(
+		const std::filesystem::path &config_file,
+		const FileMetadata &metadata,
+		const DirectoryConfiguration &configuration
+	);
+
+	/** Writes the cache file with the new entries, if there are any. */
+	std::error_code save();
+};
+
+#endif //DIRSYNC_CONFIGURATION_CACHE_HPP
@@ -0,0 +1,508 @@
+#include "configuration-json-stream.hpp"
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "configuration.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+	/** Malformed JSON, reported as a parse error of the configuration. */
+	struct JsonSyntaxError {};
+
+	/** A streaming JSON parser with the grammar of the JSON for Modern C++ defaults: RFC 8259 without comments,
+	 * strictly valid UTF-8, an optional byte order mark. Values are reported to the handler as they are read,
+	 * containers by their start and end; nesting is tracked by an explicit stack, not by recursion.
+	 * @throws JsonSyntaxError at the first syntax error */
+	template <typename Handler>
+	class JsonEventParser {
+		const std::string_view input;
+		std::size_t position = 0;
+		Handler &handler;
+		/** The last string or key, reused to avoid an allocation per string. */
+		std::string text;
+
+		char take() {
+			if (position >= input.size()) throw JsonSyntaxError{};
+			return input[position++];
+		}
+
+		void expect(const std::string_view literal) {
+			if (input.substr(position, literal.size()) != literal) throw JsonSyntaxError{};
+			position += literal.size();
+		}
+
+		void skip_whitespace() {
+			while (position < input.size()) {
+				const char c = input[position];
+				if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return;
+				position++;
+			}
+		}
+
+		bool is_digit_next() const {
+			return position < input.size() && input[position] >= '0' && input[position] <= '9';
+		}
+
+		unsigned read_hex_quad() {
+			unsigned value = 0;
+			for (int i = 0; i < 4; i++) {
+				const char c = take();
+				value <<= 4;
+				if (c >= '0' && c <= '9') value |= c - '0';
+				else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+				else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+				else throw JsonSyntaxError{};
+			}
+			return value;
+		}
+
+		void append_utf8(const std::uint32_t code_point) {
+			if (code_point < 0x80) {
+				text += static_cast<char>(code_point);
+			} else if (code_point < 0x800) {
+				text += static_cast<char>(0xC0 | (code_point >> 6));
+				text += static_cast<char>(0x80 | (code_point & 0x3F));
+			} else if (code_point < 0x10000) {
+				text += static_cast<char>(0xE0 | (code_point >> 12));
+				text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+				text += static_cast<char>(0x80 | (code_point & 0x3F));
+			} else {
+				text += static_cast<char>(0xF0 | (code_point >> 18));
+				text += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+				text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+				text += static_cast<char>(0x80 | (code_point & 0x3F));
+			}
+		}
+
+		void read_escape() {
+			switch (take()) {
+				case '"': text += '"'; return;
+				case '\\': text += '\\'; return;
+				case '/': text += '/'; return;
+				case 'b': text += '\b'; return;
+				case 'f': text += '\f'; return;
+				case 'n': text += '\n'; return;
+				case 'r': text += '\r'; return;
+				case 't': text += '\t'; return;
+				case 'u': break;
+				default: throw JsonSyntaxError{};
+			}
+
+			std::uint32_t code_point = read_hex_quad();
+			if (code_point >= 0xDC00 && code_point <= 0xDFFF) throw JsonSyntaxError{};
+			if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+				// a high surrogate must be followed by an escaped low one
+				expect("\\u");
+				const unsigned low = read_hex_quad();
+				if (low < 0xDC00 || low > 0xDFFF) throw JsonSyntaxError{};
+				code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+			}
+			append_utf8(code_point);
+		}
+
+		/** Copies a multi-byte UTF-8 sequence starting with the lead byte, rejecting overlong forms and surrogates. */
+		void read_utf8_sequence(const unsigned char lead) {
+			int continuation_count;
+			unsigned char low = 0x80, high = 0xBF; // the range of the first continuation byte
+			if (lead >= 0xC2 && lead <= 0xDF) continuation_count = 1;
+			else if (lead == 0xE0) { continuation_count = 2; low = 0xA0; }
+			else if (lead >= 0xE1 && lead <= 0xEC) continuation_count = 2;
+			else if (lead == 0xED) { continuation_count = 2; high = 0x9F; }
+			else if (lead >= 0xEE && lead <= 0xEF) continuation_count = 2;
+			else if (lead == 0xF0) { continuation_count = 3; low = 0x90; }
+			else if (lead >= 0xF1 && lead <= 0xF3) continuation_count = 3;
+			else if (lead == 0xF4) { continuation_count = 3; high = 0x8F; }
+			else throw JsonSyntaxError{};
+
+			text += static_cast<char>(lead);
+			for (int i = 0; i < continuation_count; i++) {
+				const auto byte = static_cast<unsigned char>(take());
+				if (byte < low || byte > high) throw JsonSyntaxError{};
+				text += static_cast<char>(byte);
+				low = 0x80;
+				high = 0xBF;
+			}
+		}
+
+		/** Reads a string after its opening quote into `text`. */
+		void read_string() {
+			text.clear();
+			while (true) {
+				// copy the plain run at once
+				const std::size_t start = position;
+				while (position < input.size()) {
+					const auto c = static_cast<unsigned char>(input[position]);
+					if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80) break;
+					position++;
+				}
+				text.append(input.substr(start, position - start));
+
+				const auto c = static_cast<unsigned char>(take());
+				if (c == '"') return;
+				if (c == '\\') read_escape();
+				else if (c < 0x20) throw JsonSyntaxError{};
+				else read_utf8_sequence(c);
+			}
+		}
+
+		/** Reads a number whose first character was taken already, classified like in the DOM parser:
+		 * an integer which fits 64 bits is unsigned or signed, anything else is a floating-point number. */
+		void read_number(const char first) {
+			const std::size_t start = position - 1;
+			const bool negative = first == '-';
+			const char leading_digit = negative ? take() : first;
+			if (leading_digit < '0' || leading_digit > '9') throw JsonSyntaxError{};
+			if (leading_digit != '0') {
+				while (is_digit_next()) position++;
+			}
+
+			bool is_integer = true;
+			if (position < input.size() && input[position] == '.') {
+				position++;
+				if (!is_digit_next()) throw JsonSyntaxError{};
+				while (is_digit_next()) position++;
+				is_integer = false;
+			}
+			if (position < input.size() && (input[position] == 'e' || input[position] == 'E')) {
+				position++;
+				if (position < input.size() && (input[position] == '+' || input[position] == '-')) position++;
+				if (!is_digit_next()) throw JsonSyntaxError{};
+				while (is_digit_next()) position++;
+				is_integer = false;
+			}
+
+			const std::string_view number = input.substr(start, position - start);
+			if (is_integer) {
+				const char *const end = number.data() + number.size();
+				if (negative) {
+					std::int64_t value;
+					if (std::from_chars(number.data(), end, value).ec == std::errc()) {
+						handler.number_integer(value);
+						return;
+					}
+				} else {
+					std::uint64_t value;
+					if (std::from_chars(number.data(), end, value).ec == std::errc()) {
+						handler.number_unsigned(value);
+						return;
+					}
+				}
+			}
+			const double value = std::strtod(std::string(number).c_str(), nullptr);
+			// the DOM parser rejects an overflow to infinity as well
+			if (!std::isfinite(value)) throw JsonSyntaxError{};
+			handler.number_float(value);
+		}
+
+		void read_scalar(const char first) {
+			switch (first) {
+				case '"':
+					read_string();
+					handler.string(text);
+					return;
+				case 't':
+					expect("rue");
+					handler.boolean(true);
+					return;
+				case 'f':
+					expect("alse");
+					handler.boolean(false);
+					return;
+				case 'n':
+					expect("ull");
+					handler.null();
+					return;
+				default:
+					if (first == '-' || (first >= '0' && first <= '9')) {
+						read_number(first);
+						return;
+					}
+					throw JsonSyntaxError{};
+			}
+		}
+
+		void read_key() {
+			skip_whitespace();
+			if (take() != '"') throw JsonSyntaxError{};
+			read_string();
+			handler.key(text);
+			skip_whitespace();
+			if (take() != ':') throw JsonSyntaxError{};
+		}
+
+		public:
+		JsonEventParser(const std::string_view input, Handler &handler) : input(input), handler(handler) {}
+
+		void parse() {
+			if (input.starts_with("\xEF\xBB\xBF")) position = 3;
+
+			// true for an object, false for an array
+			std::vector<bool> containers;
+			while (true) {
+				// a value is expected
+				skip_whitespace();
+				const char first = take();
+				if (first == '{' || first == '[') {
+					const bool is_object = first == '{';
+					if (is_object) handler.start_object();
+					else handler.start_array();
+
+					skip_whitespace();
+					if (position < input.size() && input[position] == (is_object ? '}' : ']')) {
+						position++;
+						if (is_object) handler.end_object();
+						else handler.end_array();
+					} else {
+						containers.push_back(is_object);
+						if (is_object) read_key();
+						continue;
+					}
+				} else {
+					read_scalar(first);
+				}
+
+				// the value is complete, continue with the next element or close the containers
+				while (true) {
+					skip_whitespace();
+					if (containers.empty()) {
+						if (position != input.size()) throw JsonSyntaxError{};
+						return;
+					}
+
+					const bool is_object = containers.back();
+					const char separator = take();
+					if (separator == ',') {
+						if (is_object) read_key();
+						break;
+					}
+					if (separator != (is_object ? '}' : ']')) throw JsonSyntaxError{};
+
+					if (is_object) handler.end_object();
+					else handler.end_array();
+					containers.pop_back();
+				}
+			}
+		}
+	};
+
+	/** The keys of the configuration object. */
+	enum class ConfigurationKey {
+		other,
+		config_version,
+		exclusion_patterns,
+		pattern_syntax,
+		max_file_size,
+	};
+}
+
+/** Receives the events of `JsonEventParser` and writes the values of the known keys into the configuration.
+ * Mirrors the conversions of the DOM reader: a repeated key replaces the previous value, unknown keys are ignored,
+ * a missing or mistyped required value is a parse error, but only reported after the version check. */
+class JsonConfigurationHandler {
+	DirectoryConfiguration &configuration;
+
+	/** The number of containers open around the next value: 0 for the document, 1 for the configuration object. */
+	int depth = 0;
+	bool is_object = false;
+	ConfigurationKey key_at_root = ConfigurationKey::other;
+
+	bool has_version = false;
+	bool version_is_object = false;
+	/** Major, minor and patch; none if missing or not a number. */
+	std::array<std::optional<std::size_t>, 3> version_parts;
+	/** The index of the version part whose value is next, -1 for other keys. */
+	int version_part = -1;
+
+	bool has_exclusion_patterns = false;
+	bool exclusion_patterns_valid = false;
+	bool pattern_syntax_valid = true;
+
+	enum class ValueKind { object, array, string, boolean, null, number };
+
+	/** Applies a value of the configuration object (depth 1) or of its version or pattern list (depth 2).
+	 * @param number the value of a number as a version part, if representable */
+	void value(const ValueKind kind, const std::string_view string = {}, const std::optional<std::size_t> number = {}) {
+		if (depth == 0) {
+			is_object = kind == ValueKind::object;
+			return;
+		}
+
+		if (depth == 1) {
+			switch (key_at_root) {
+				case ConfigurationKey::config_version:
+					version_is_object = kind == ValueKind::object;
+					break;
+				case ConfigurationKey::exclusion_patterns:
+					exclusion_patterns_valid = kind == ValueKind::array;
+					break;
+				case ConfigurationKey::pattern_syntax:
+					pattern_syntax_valid = kind == ValueKind::string && (string == "wildcard" || string == "gitignore");
+					if (pattern_syntax_valid && string == "gitignore")
+						configuration.pattern_syntax = PatternSyntax::gitignore;
+					break;
+				case ConfigurationKey::max_file_size:
+				case ConfigurationKey::other:
+					break;
+			}
+			return;
+		}
+
+		if (depth != 2) return;
+		if (key_at_root == ConfigurationKey::config_version && version_is_object && version_part >= 0) {
+			version_parts[version_part] = number;
+		} else if (key_at_root == ConfigurationKey::exclusion_patterns && exclusion_patterns_valid) {
+			if (kind == ValueKind::string) configuration.exclusion_patterns.emplace_back(string);
+			else exclusion_patterns_valid = false;
+		}
+	}
+
+	void open(const ValueKind kind) {
+		value(kind);
+		depth++;
+	}
+
+	public:
+	explicit JsonConfigurationHandler(DirectoryConfiguration &configuration) : configuration(configuration) {}
+
+	void start_object() { open(ValueKind::object); }
+	void start_array() { open(ValueKind::array); }
+	void end_object() { depth--; }
+	void end_array() { depth--; }
+
+	void key(const std::string_view name) {
+		if (depth == 2 && key_at_root == ConfigurationKey::config_version && version_is_object) {
+			if (name == "major") version_part = 0;
+			else if (name == "minor") version_part = 1;
+			else if (name == "patch") version_part = 2;
+			else version_part = -1;
+			if (version_part >= 0) version_parts[version_part].reset();
+			return;
+		}
+		if (depth != 1 || !is_object) return;
+
+		// a repeated key starts over
+		if (name == "configVersion") {
+			key_at_root = ConfigurationKey::config_version;
+			has_version = true;
+			version_is_object = false;
+			version_parts = {};
+			version_part = -1;
+		} else if (name == "exclusionPatterns") {
+			key_at_root = ConfigurationKey::exclusion_patterns;
+			has_exclusion_patterns = true;
+			exclusion_patterns_valid = false;
+			configuration.exclusion_patterns.clear();
+		} else if (name == "patternSyntax") {
+			key_at_root = ConfigurationKey::pattern_syntax;
+			pattern_syntax_valid = false;
+			configuration.pattern_syntax = PatternSyntax::wildcard;
+		} else if (name == "maxFileSize") {
+			key_at_root = ConfigurationKey::max_file_size;
+			configuration.max_file_size.reset();
+		} else {
+			key_at_root = ConfigurationKey::other;
+		}
+	}
+
+	void string(const std::string_view text) { value(ValueKind::string, text); }
+	void boolean(bool) { value(ValueKind::boolean); }
+	void null() { value(ValueKind::null); }
+
+	void number_unsigned(const std::uint64_t number) {
+		if (depth == 1 && key_at_root == ConfigurationKey::max_file_size) configuration.max_file_size = number;
+		value(ValueKind::number, {}, static_cast<std::size_t>(number));
+	}
+
+	void number_integer(const std::int64_t number) {
+		if (depth == 1 && key_at_root == ConfigurationKey::max_file_size)
+			configuration.max_file_size = static_cast<std::uintmax_t>(number);
+		value(ValueKind::number, {}, static_cast<std::size_t>(number));
+	}
+
+	/** Floating-point sizes are ignored, like in the DOM reader, version parts are truncated. */
+	void number_float(const double number) {
+		// 2^64, a version part out of the range of the conversion is not a number
+		constexpr double size_limit = 18446744073709551616.0;
+		const bool representable = number > -1.0 && number < size_limit;
+		value(ValueKind::number, {}, representable ? std::optional(static_cast<std::size_t>(number)) : std::nullopt);
+	}
+
+	std::optional<Version> get_version() const {
+		if (!has_version || !version_is_object) return std::nullopt;
+		for (const std::optional<std::size_t> &part : version_parts) {
+			if (!part.has_value()) return std::nullopt;
+		}
+		return Version(*version_parts[0], *version_parts[1], *version_parts[2]);
+	}
+
+	/** Finishes a compatible configuration.
+	 * @return false if a required value is missing or has a wrong type */
+	bool finish(const Version &version) {
+		if (!has_exclusion_patterns || !exclusion_patterns_valid || !pattern_syntax_valid) return false;
+		configuration.config_version = version;
+		configuration.compile_exclusion_patterns();
+		return true;
+	}
+};
+
+DirectoryConfigurationReadResult StreamingJsonDirConfigReader::read_from_directory(
+	const std::filesystem::path &directory,
+	const ProgramArguments &arguments
+) const {
+	const fs::path file_path = directory / config_file_name();
+	std::error_code error;
+	const fs::file_status file_status = fs::status(file_path, error);
+	if (!fs::exists(file_status))
+		return DirectoryConfigurationFileNonexistent{};
+
+	if (error) {
+		if (arguments.is_verbose())
+			std::cerr << "Error: Failed to check the directory configuration details in: "
+				<< file_path << ": " << error.message() << std::endl;
+		return fs::filesystem_error("Failed to check the directory configuration details", error);
+	}
+
+	return read_from_file(file_path, arguments);
+}
+
+DirectoryConfigurationReadResult StreamingJsonDirConfigReader::read_from_file(
+	const std::filesystem::path &file_path,
+	const ProgramArguments &
+) const {
+	std::ifstream file_stream(file_path, std::ios::binary);
+	if (!file_stream.good())
+		return DirectoryConfigurationFileNonexistent{};
+	const std::string content{std::istreambuf_iterator<char>(file_stream), std::istreambuf_iterator<char>()};
+
+	DirectoryConfiguration configuration;
+	JsonConfigurationHandler handler(configuration);
+	try {
+		JsonEventParser(content, handler).parse();
+	} catch (const JsonSyntaxError &) {
+		return DirectoryConfigurationParseError{};
+	}
+
+	const std::optional<Version> config_version = handler.get_version();
+	if (!config_version.has_value())
+		return DirectoryConfigurationParseError{};
+	if (!config_version->is_compatible_with(PROGRAM_VERSION))
+		return DirectoryConfigurationIncompatible{};
+
+	if (!handler.finish(*config_version))
+		return DirectoryConfigurationParseError{};
+	return configuration;
+}
@@ -0,0 +1,29 @@
+#ifndef DIRSYNC_CONFIGURATION_JSON_STREAM_HPP
+#define DIRSYNC_CONFIGURATION_JSON_STREAM_HPP
+
+#include <filesystem>
+
+#include "configuration.hpp"
+
+/** Reads the same `.dirsync.json` files as `JsonDirConfigReader`, but without building a JSON document:
+ * a streaming parser reports every value as it is read (SAX-style) and the known keys are written straight
+ * into the `DirectoryConfiguration`, other values are only validated. The accepted syntax, the parse errors
+ * and the version compatibility check are those of `JsonDirConfigReader`. */
+class StreamingJsonDirConfigReader final : public DirectoryConfigurationReader {
+	public:
+	DirectoryConfigurationReadResult read_from_directory(
+		const std::filesystem::path &directory,
+		const ProgramArguments &arguments
+	) const override;
+
+	DirectoryConfigurationReadResult read_from_file(
+		const std::filesystem::path &file_path,
+		const ProgramArguments &arguments
+	) const override;
+
+	const char *config_file_name() const override {
+		return ".dirsync.json";
+	}
+};
+
+#endif //DIRSYNC_CONFIGURATION_JSON_STREAM_HPP
@@ -12,9 +12,24 @@ AUTOGENERATE_JSON_CONVERSION(Version, major, minor, patch)
 
 const char *CONFIGURATION_VERSION_KEY = "configVersion";
 
+const char *PATTERN_SYNTAX_KEY = "patternSyntax";
+
+void from_json(const Json &j, PatternSyntax &syntax) {
+	const std::string &name = j.get_ref<const std::string &>();
+	if (name == "wildcard") syntax = PatternSyntax::wildcard;
+	else if (name == "gitignore") syntax = PatternSyntax::gitignore;
+	else throw Json::other_error::create(501, "unknown pattern syntax: " + name, &j);
+}
+void to_json(Json &j, const PatternSyntax &syntax) {
+	j = syntax == PatternSyntax::gitignore ? "gitignore" : "wildcard";
+}
+
 void from_json(const Json &j, DirectoryConfiguration &p) {
 	j.at(CONFIGURATION_VERSION_KEY).get_to(p.config_version);
 	j.at("exclusionPatterns").get_to(p.exclusion_patterns);
+	if (j.contains(PATTERN_SYNTAX_KEY))
+		j.at(PATTERN_SYNTAX_KEY).get_to(p.pattern_syntax);
+	p.compile_exclusion_patterns();
 	if (j.contains("maxFileSize")) {
 		const std::int64_t *max_file_size_ptr = j.at("maxFileSize").get_ptr<const std::int64_t *>();
 		if (max_file_size_ptr != nullptr)
@@ -25,6 +40,7 @@ void to_json(Json &j, const DirectoryConfiguration &p) {
 	j = Json{
 		{CONFIGURATION_VERSION_KEY, p.config_version},
 		{"exclusionPatterns", p.exclusion_patterns},
+		{PATTERN_SYNTAX_KEY, p.pattern_syntax},
 		{"maxFileSize", nullptr}
 	};
 
@@ -49,6 +65,13 @@ DirectoryConfigurationReadResult JsonDirConfigReader::read_from_directory(
 		return fs::filesystem_error("Failed to check the directory configuration details", error);
 	}
 
+	return read_from_file(file_path, arguments);
+}
+
+DirectoryConfigurationReadResult JsonDirConfigReader::read_from_file(
+	const std::filesystem::path &file_path,
+	const ProgramArguments &
+) const {
 	std::ifstream file_stream(file_path);
 	if (!file_stream.good())
 		return DirectoryConfigurationFileNonexistent{};
@@ -14,6 +14,11 @@ class JsonDirConfigReader final : public DirectoryConfigurationReader {
 		const ProgramArguments &arguments
 	) const override;
 
+	DirectoryConfigurationReadResult read_from_file(
+		const std::filesystem::path &file_path,
+		const ProgramArguments &arguments
+	) const override;
+
 	const char *config_file_name() const override {
 		return ".dirsync.json";
 	}
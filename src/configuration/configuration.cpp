@@ -1,14 +1,189 @@
 #include "configuration.hpp"
 
+#include <cstring>
 #include <fstream>
+#include <memory>
+#include <ranges>
+#include <string_view>
+#include <type_traits>
 
-#include "configuration-json.hpp"
+#include "configuration-cache.hpp"
+#include "configuration-json-stream.hpp"
 #include "../arguments.hpp"
 
 namespace fs = std::filesystem;
 using Reader = DirectoryConfigurationReader;
 using Result = DirectoryConfigurationReadResult;
 
+void DirectoryConfiguration::compile_exclusion_patterns() {
+	compiled_patterns.clear();
+	gitignore_patterns.reset();
+
+	if (pattern_syntax == PatternSyntax::gitignore) {
+		gitignore_patterns = std::make_shared<const GitignoreTrie>(exclusion_patterns);
+		return;
+	}
+
+	compiled_patterns.reserve(exclusion_patterns.size());
+	for (const std::string &pattern : exclusion_patterns)
+		compiled_patterns.emplace_back(pattern);
+}
+
+namespace {
+	/** The file name of the path, viewed in place without building a filename path where possible. */
+	std::string_view entry_name(const fs::path &path, std::string &buffer) {
+		if constexpr (std::is_same_v<fs::path::value_type, char>) {
+			const std::string_view native = path.native();
+			const std::size_t separator = native.rfind('/');
+			return separator == std::string_view::npos ? native : native.substr(separator + 1);
+		} else {
+			buffer = path.filename().string();
+			return buffer;
+		}
+	}
+}
+
+ConfigurationRules ConfigurationRules::extended_with(
+	const std::string_view directory_name,
+	const DirectoryConfiguration *configuration
+) const {
+	ConfigurationRules extended = *this;
+
+	// the subdirectory is entered by every gitignore trie of the parent directories
+	for (GitignoreCursor &cursor : extended.gitignore_cursors)
+		cursor.state = cursor.trie->step(cursor.state, directory_name);
+	std::erase_if(extended.gitignore_cursors, [](const GitignoreCursor &cursor) { return cursor.state.empty(); });
+
+	if (configuration == nullptr) return extended;
+	if (const std::shared_ptr<const GitignoreTrie> &trie = configuration->get_gitignore_patterns())
+		extended.gitignore_cursors.push_back({trie, trie->root_state()});
+
+	const std::optional<std::uintmax_t> &size = configuration->get_max_file_size();
+	if (size.has_value() && (!extended.max_file_size.has_value() || *size < *extended.max_file_size))
+		extended.max_file_size = size;
+
+	const std::vector<CompiledWildcard> &added = configuration->get_compiled_patterns();
+	if (!added.empty()) {
+		static const PatternSet empty_set;
+		extended.patterns = std::make_shared<const PatternSet>(patterns ? *patterns : empty_set, added);
+	}
+	return extended;
+}
+
+bool ConfigurationRules::accepts(const std::string_view name, const FileMetadata &metadata) const {
+	if (max_file_size.has_value() && metadata.is_regular_file()) {
+		if (metadata.size > *max_file_size) return false;
+	}
+
+	if (patterns != nullptr && patterns->matches_any(name)) return false;
+
+	for (const GitignoreCursor &cursor : std::ranges::reverse_view(gitignore_cursors)) {
+		const GitignoreVerdict verdict = cursor.trie->match(cursor.state, name, metadata.is_directory());
+		if (verdict != GitignoreVerdict::none) return verdict == GitignoreVerdict::included;
+	}
+	return true;
+}
+
+ConfigurationFilter ConfigurationFilter::extended_with(
+	const std::string_view directory_name,
+	const DirectoryConfiguration *first_configuration,
+	const DirectoryConfiguration *second_configuration
+) const {
+	ConfigurationFilter extended;
+	extended.first = first.extended_with(directory_name, first_configuration);
+	extended.second = second.extended_with(directory_name, second_configuration);
+	return extended;
+}
+
+bool ConfigurationFilter::accepts(const fs::path &path, const FileMetadata &metadata) const {
+	std::string name_buffer;
+	const std::string_view name = entry_name(path, name_buffer);
+	// a negation on one side does not override an exclusion on the other
+	return first.accepts(name, metadata) && second.accepts(name, metadata);
+}
+
+
+std::uint64_t DirectoryConfiguration::fingerprint() const {
+	// FNV-1a, unlike std::hash the value does not depend on the standard library implementation
+	std::uint64_t hash = 0xcbf29ce484222325;
+	const auto add_byte = [&hash](const unsigned char byte) {
+		hash ^= byte;
+		hash *= 0x100000001b3;
+	};
+	const auto add_number = [&add_byte](std::uint64_t number) {
+		for (int i = 0; i < 8; i++, number >>= 8) add_byte(static_cast<unsigned char>(number));
+	};
+
+	add_number(exclusion_patterns.size());
+	for (const std::string &pattern : exclusion_patterns) {
+		add_number(pattern.size());
+		for (const char c : pattern) add_byte(static_cast<unsigned char>(c));
+	}
+	add_number(static_cast<std::uint64_t>(pattern_syntax));
+	add_number(max_file_size.has_value());
+	add_number(max_file_size.value_or(0));
+	return hash;
+}
+
+namespace {
+	template<typename T>
+	void append_value(std::string &output, const T value) {
+		output.append(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+
+	template<typename T>
+	bool read_value(std::string_view &input, T &value) {
+		if (input.size() < sizeof(value)) return false;
+		std::memcpy(&value, input.data(), sizeof(value));
+		input.remove_prefix(sizeof(value));
+		return true;
+	}
+}
+
+void DirectoryConfiguration::encode(std::string &output) const {
+	append_value<std::uint64_t>(output, config_version.get_major());
+	append_value<std::uint64_t>(output, config_version.get_minor());
+	append_value<std::uint64_t>(output, config_version.get_patch());
+	append_value<std::uint8_t>(output, static_cast<std::uint8_t>(pattern_syntax));
+	append_value<std::uint8_t>(output, max_file_size.has_value());
+	append_value<std::uint64_t>(output, max_file_size.value_or(0));
+
+	append_value<std::uint32_t>(output, static_cast<std::uint32_t>(exclusion_patterns.size()));
+	for (const std::string &pattern : exclusion_patterns) {
+		append_value<std::uint32_t>(output, static_cast<std::uint32_t>(pattern.size()));
+		output += pattern;
+	}
+}
+
+bool DirectoryConfiguration::decode(std::string_view input, DirectoryConfiguration &configuration) {
+	std::uint64_t major, minor, patch, max_size;
+	std::uint8_t syntax, has_max_size;
+	std::uint32_t pattern_count;
+	if (!read_value(input, major) || !read_value(input, minor) || !read_value(input, patch)) return false;
+	if (!read_value(input, syntax) || !read_value(input, has_max_size) || !read_value(input, max_size)) return false;
+	if (!read_value(input, pattern_count)) return false;
+	if (syntax > static_cast<std::uint8_t>(PatternSyntax::gitignore)) return false;
+
+	configuration.config_version = Version(major, minor, patch);
+	configuration.pattern_syntax = static_cast<PatternSyntax>(syntax);
+	configuration.max_file_size.reset();
+	if (has_max_size) configuration.max_file_size = max_size;
+
+	configuration.exclusion_patterns.clear();
+	for (std::uint32_t i = 0; i < pattern_count; i++) {
+		std::uint32_t length;
+		if (!read_value(input, length) || input.size() < length) return false;
+		configuration.exclusion_patterns.emplace_back(input.substr(0, length));
+		input.remove_prefix(length);
+	}
+
+	// an incompatible configuration is parsed again, so the error is reported
+	if (!configuration.config_version.is_compatible_with(PROGRAM_VERSION)) return false;
+
+	configuration.compile_exclusion_patterns();
+	return input.empty();
+}
+
 bool is_config_file(const fs::path &path) {
 	return path.filename().string().starts_with(CONFIG_FILE_NAME_PREFIX);
 }
@@ -21,23 +196,55 @@ bool is_config_file(const fs::path &path) {
  * @param arguments the processed CLI program arguments
  * @param configuration Output parameter of the configuration. Has no value
  * if no supported configuration file was present or an error occurred.
+ * @param cache the cache of parsed configurations, if enabled
+ * @param listing the listing of the directory, if it was enumerated already. The configuration file
+ * is then looked up in it, instead of querying the file system.
  * @return A program-wide error code. If none occurs, defaults to zero. */
 int get_directory_configuration(
 	const fs::path &directory,
 	const ProgramArguments &arguments,
-	std::optional<DirectoryConfiguration> &configuration
+	std::optional<DirectoryConfiguration> &configuration,
+	ConfigurationCache *cache,
+	const DirectoryListing *listing
 ) {
-	const Reader &reader = JsonDirConfigReader();
+	const Reader &reader = StreamingJsonDirConfigReader();
 	// add other readers when the program is extended
 
-	const Result result = reader.read_from_directory(directory, arguments);
+	// the file is stamped before it is parsed, so a concurrent change is noticed by the next run
+	const fs::path config_file_path = directory / reader.config_file_name();
+	FileMetadata metadata;
+	bool stamped = false;
+	bool cacheable = false;
+	if (listing != nullptr) {
+		const ListedEntry *listed = listing->find(reader.config_file_name());
+		if (listed == nullptr) return 0;
+		stamped = listing->has_metadata && !listed->metadata_error;
+		if (stamped) metadata = listed->metadata;
+	}
+
+	if (cache != nullptr) {
+		if (!stamped) {
+			const std::error_code error = read_file_metadata(config_file_path, metadata);
+			if (error == std::errc::no_such_file_or_directory) return 0;
+			stamped = !error;
+		}
+		cacheable = stamped && metadata.is_regular_file();
+
+		DirectoryConfiguration cached;
+		if (cacheable && cache->find(config_file_path, metadata, cached)) {
+			configuration = std::move(cached);
+			return 0;
+		}
+	}
+
+	const Result result = listing != nullptr
+		? reader.read_from_file(config_file_path, arguments)
+		: reader.read_from_directory(directory, arguments);
 
 	if (std::holds_alternative<DirectoryConfigurationParseError>(result)) {
-		const fs::path config_file_path = directory / reader.config_file_name();
 		std::cerr << "Parse error in " << config_file_path << std::endl;
 		return EXIT_CODE_CONFIG_FILE_PARSE_ERROR;
 	} else if (std::holds_alternative<DirectoryConfigurationIncompatible>(result)) {
-		const fs::path config_file_path = directory / reader.config_file_name();
 		std::cerr << "Incompatible configuration in " << config_file_path << std::endl;
 		return EXIT_CODE_CONFIG_VERSION_INCOMPATIBLE;
 	}
@@ -45,5 +252,6 @@ int get_directory_configuration(
 	const DirectoryConfiguration *config = std::get_if<DirectoryConfiguration>(&result);
 	if (config == nullptr) return 0;
 	configuration = *config;
+	if (cacheable) cache->store(config_file_path, metadata, *config);
 	return 0;
 }
@@ -1,13 +1,22 @@
 #ifndef DIRSYNC_DIRECTORY_CONFIG_HPP
 #define DIRSYNC_DIRECTORY_CONFIG_HPP
 
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 
 #include "../arguments.hpp"
 #include "../constants.hpp"
+#include "../directory_listing.hpp"
+#include "../file_metadata.hpp"
+#include "../gitignore.hpp"
+#include "../pattern_set.hpp"
 #include "../wildcards.hpp"
 
 //enum class DirectoryRole {
@@ -21,14 +30,28 @@
 //	//	bool
 //};
 
+/** The syntax of the exclusion patterns of a configuration. */
+enum class PatternSyntax {
+	/** `*` wildcards matched against the file name, the default */
+	wildcard,
+	/** gitignore patterns matched against the path relative to the configured directory, see `GitignoreTrie` */
+	gitignore,
+};
+
 /** A local directory configuration, saved as a file inside the directory it configures.
  * Contains information about the wildcard-supported excluded patterns and other
  * filtering information. */
 class DirectoryConfiguration {
 	Version config_version;
 	std::vector<std::string> exclusion_patterns;
+	PatternSyntax pattern_syntax = PatternSyntax::wildcard;
 	std::optional<std::uintmax_t> max_file_size;
 
+	/** The exclusion patterns compiled when the configuration is loaded, according to the syntax. */
+	std::vector<CompiledWildcard> compiled_patterns;
+	std::shared_ptr<const GitignoreTrie> gitignore_patterns;
+	void compile_exclusion_patterns();
+
 	//	DirectoryRole role = DirectoryRole::unspecified;
 	//	DateTime last_synchronized_date;
 	//	ExclusionFlags exclusionFlags;
@@ -40,6 +63,8 @@ class DirectoryConfiguration {
 	using Json = nlohmann::json;
 	friend void from_json(const Json &j, DirectoryConfiguration &p);
 	friend void to_json(Json &j, const DirectoryConfiguration &p);
+	// the streaming reader writes the parsed values directly, see `StreamingJsonDirConfigReader`
+	friend class JsonConfigurationHandler;
 
 	public:
 	// /** Getter for the semver (sematic versioning) configuration version
@@ -68,20 +93,115 @@ class DirectoryConfiguration {
 	/** Returns true if the filesystem entry is accepted
 	 * in the directory configured by this instance. */
 	bool accepts(const std::filesystem::directory_entry &entry) const {
-		const std::string filename = entry.path().filename().string();
-
 		if (max_file_size.has_value() && entry.is_regular_file()) {
 			const std::uintmax_t size = entry.file_size();
 			if (size > *max_file_size) return false;
 		}
 
-		for (const auto &pattern : exclusion_patterns) {
-			if (wildcard_matches(pattern, filename))
-				return false;
+		return !is_excluded(entry.path().filename().string(), entry.is_directory());
+	}
+
+	/** Returns true if the filesystem entry with already known metadata (e.g. from a directory listing)
+	 * is allowed to be copied from the directory configured by this instance. */
+	bool allows(const std::filesystem::path &path, const FileMetadata &metadata) const {
+		return accepts(path, metadata);
+	}
+
+	/** Returns true if the filesystem entry with already known metadata
+	 * is accepted in the directory configured by this instance. */
+	bool accepts(const std::filesystem::path &path, const FileMetadata &metadata) const {
+		if (max_file_size.has_value() && metadata.is_regular_file()) {
+			if (metadata.size > *max_file_size) return false;
 		}
 
-		return true;
+		return !is_excluded(path.filename().string(), metadata.is_directory());
 	}
+
+	/** Returns true if the filename (of an entry directly in the configured directory)
+	 * matches any of the exclusion patterns. */
+	bool is_excluded(const std::string_view filename, const bool is_directory) const {
+		for (const CompiledWildcard &pattern : compiled_patterns) {
+			if (pattern.matches(filename))
+				return true;
+		}
+		if (gitignore_patterns != nullptr) {
+			const GitignoreTrie &trie = *gitignore_patterns;
+			return trie.match(trie.root_state(), filename, is_directory) == GitignoreVerdict::excluded;
+		}
+		return false;
+	}
+
+	/** A stable hash of the filtering rules, identifying the configuration across program runs. */
+	std::uint64_t fingerprint() const;
+
+	/** Appends a compact binary form of the configuration, see `ConfigurationCache`. */
+	void encode(std::string &output) const;
+	/** Restores a configuration from its binary form and compiles its patterns.
+	 * @return false if the input is damaged */
+	static bool decode(std::string_view input, DirectoryConfiguration &configuration);
+
+	const std::vector<CompiledWildcard> &get_compiled_patterns() const { return compiled_patterns; }
+	const std::shared_ptr<const GitignoreTrie> &get_gitignore_patterns() const { return gitignore_patterns; }
+	const std::optional<std::uintmax_t> &get_max_file_size() const { return max_file_size; }
+};
+
+/** The combined filtering rules of the configurations of one side of a stack, equivalent to asking each of them:
+ * all wildcard exclusion patterns in a single `PatternSet` and the smallest maximum file size.
+ * Deeper levels share the pattern set of their parent unless they add patterns, copies are cheap.
+ * Gitignore patterns are matched by the relative path, so the rules keep the state of every gitignore trie
+ * of the side for the current directory. The deepest configuration with a matching gitignore pattern decides,
+ * a wildcard pattern excludes regardless. */
+class ConfigurationRules {
+	struct GitignoreCursor {
+		std::shared_ptr<const GitignoreTrie> trie;
+		GitignoreTrie::State state;
+	};
+
+	std::shared_ptr<const PatternSet> patterns;
+	std::optional<std::uintmax_t> max_file_size;
+	/** From the shallowest to the deepest configuration, without tries which cannot match anymore. */
+	std::vector<GitignoreCursor> gitignore_cursors;
+
+	public:
+	/** The rules of a subdirectory, with the rules of its configuration added, unless it is null.
+	 * @param directory_name the name of the subdirectory, ignored for the root of the stack */
+	ConfigurationRules extended_with(
+		std::string_view directory_name,
+		const DirectoryConfiguration *configuration
+	) const;
+
+	/** Returns true if the entry with the given name and already known metadata passes every configuration. */
+	bool accepts(std::string_view name, const FileMetadata &metadata) const;
+};
+
+/** The filtering rules of a whole stack of configuration pairs. The rules of both sides are kept apart,
+ * a configuration only speaks for its own directory tree: an entry is synchronized if the configurations
+ * of the first (source) side allow it and the configurations of the second (target) side accept it.
+ * Two-way synchronization filters the listing of each side by the rules of that side. */
+class ConfigurationFilter {
+	ConfigurationRules first;
+	ConfigurationRules second;
+
+	public:
+	/** The filter of a subdirectory, with the rules of its configurations added.
+	 * Null configurations are skipped.
+	 * @param directory_name the name of the subdirectory, ignored for the root of the stack */
+	ConfigurationFilter extended_with(
+		std::string_view directory_name,
+		const DirectoryConfiguration *first_configuration,
+		const DirectoryConfiguration *second_configuration
+	) const;
+
+	/** Returns true if the filesystem entry with already known metadata passes the configurations of both sides. */
+	bool accepts(const std::filesystem::path &path, const FileMetadata &metadata) const;
+
+	/** The rules of the first (source, or left) side. */
+	const ConfigurationRules &get_first_rules() const { return first; }
+	/** The rules of the second (target, or right) side. */
+	const ConfigurationRules &get_second_rules() const { return second; }
+
+	/** Exchanges the rules of the sides, for a context whose directories are in the opposite order. */
+	void swap_sides() { std::swap(first, second); }
 };
 
 struct DirectoryConfigurationFileNonexistent {};
@@ -112,6 +232,12 @@ class DirectoryConfigurationReader {
 		const ProgramArguments &arguments
 	) const = 0;
 
+	/** Reads the configuration file whose existence is already known, e.g. from a directory listing. */
+	virtual DirectoryConfigurationReadResult read_from_file(
+		const std::filesystem::path &file_path,
+		const ProgramArguments &arguments
+	) const = 0;
+
 	/** Gets the config filename specific to this format.
 	 * Example: .dirsync.json for JSON format. */
 	virtual const char *config_file_name() const = 0;
@@ -119,10 +245,14 @@ class DirectoryConfigurationReader {
 	virtual ~DirectoryConfigurationReader() = default;
 };
 
+class ConfigurationCache;
+
 int get_directory_configuration(
 	const std::filesystem::path &directory,
 	const ProgramArguments &arguments,
-	std::optional<DirectoryConfiguration> &configuration
+	std::optional<DirectoryConfiguration> &configuration,
+	ConfigurationCache *cache = nullptr,
+	const DirectoryListing *listing = nullptr
 );
 
 #endif //DIRSYNC_DIRECTORY_CONFIG_HPP
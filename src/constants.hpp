@@ -26,6 +26,10 @@ class Version {
 	constexpr Version(const size_t major, const size_t minor, const size_t patch)
 		: major(major), minor(minor), patch(patch) {}
 
+	constexpr size_t get_major() const { return major; }
+	constexpr size_t get_minor() const { return minor; }
+	constexpr size_t get_patch() const { return patch; }
+
 	std::strong_ordering operator<=>(const Version &) const = default;
 	// default comparisons: https://en.cppreference.com/w/cpp/language/default_comparisons
 
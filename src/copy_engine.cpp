@@ -0,0 +1,381 @@
+#include "copy_engine.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <syncstream>
+#include <system_error>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+
+#include "delta.hpp"
+#include "file_descriptor.hpp"
+#include "file_metadata.hpp"
+#include "statistics.hpp"
+
+const char *copy_method_name(const CopyMethod method) {
+	switch (method) {
+		case CopyMethod::none: return "none";
+		case CopyMethod::reflink: return "reflink";
+		case CopyMethod::delta: return "delta";
+		case CopyMethod::sparse: return "sparse";
+		case CopyMethod::copy_file_range: return "copy_file_range";
+		case CopyMethod::sendfile: return "sendfile";
+		case CopyMethod::read_write: return "read/write";
+		case CopyMethod::filesystem: return "std::filesystem";
+	}
+	return "unknown";
+}
+
+std::error_code CopyEngine::copy(const fs::path &source, const fs::path &target, const fs::copy_options options) {
+	CopyResult result;
+	const std::error_code error = copy_contents(source, target, options, result);
+	if (error) return error;
+	if (result.method == CopyMethod::none) return error;
+
+	statistics.record_copy(result);
+	if (verbose)
+		std::osyncstream(std::cout) << "Copied " << target << " using " << copy_method_name(result.method) << "\n";
+	return error;
+}
+
+std::unique_ptr<char[]> KernelCopyEngine::acquire_buffer() {
+	{
+		std::lock_guard lock(buffer_mutex);
+		if (!free_buffers.empty()) {
+			std::unique_ptr<char[]> buffer = std::move(free_buffers.back());
+			free_buffers.pop_back();
+			return buffer;
+		}
+	}
+	return std::make_unique_for_overwrite<char[]>(BUFFER_SIZE);
+}
+
+void KernelCopyEngine::release_buffer(std::unique_ptr<char[]> buffer) {
+	std::lock_guard lock(buffer_mutex);
+	free_buffers.push_back(std::move(buffer));
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+namespace {
+	// the largest amount handed to the kernel in a single call
+	constexpr std::size_t KERNEL_COPY_CHUNK = 1 << 30;
+
+#if defined(__linux__)
+	/** True if the in-kernel copy is not supported for these files, so the next method should be tried. */
+	bool is_unsupported_kernel_copy(const int error) {
+		return error == EXDEV || error == ENOSYS || error == EOPNOTSUPP || error == EINVAL || error == EBADF;
+	}
+
+	/** True if the filesystem (pair) cannot share extents between these files. */
+	bool is_unsupported_clone(const int error) {
+		return error == EXDEV || error == EOPNOTSUPP || error == ENOTTY || error == EINVAL || error == ENOSYS;
+	}
+#endif
+}
+
+bool KernelCopyEngine::try_clone(
+	const int source_fd,
+	const int target_fd,
+	const std::uintmax_t size,
+	CopyResult &result,
+	std::error_code &error
+) const {
+	if (reflink_mode == ReflinkMode::never) return false;
+
+#if defined(__linux__)
+	if (::ioctl(target_fd, FICLONE, source_fd) == 0) {
+		result.method = CopyMethod::reflink;
+		result.bytes = size;
+		return true;
+	}
+	if (!is_unsupported_clone(errno) || reflink_mode == ReflinkMode::always)
+		error = last_error();
+	return false;
+#else
+	if (reflink_mode == ReflinkMode::always)
+		error = std::make_error_code(std::errc::not_supported);
+	return false;
+#endif
+}
+
+std::error_code KernelCopyEngine::copy_descriptors(
+	const int source_fd,
+	const int target_fd,
+	const std::uintmax_t size,
+	CopyResult &result
+) {
+	// the methods continue from the current file offsets, so a fallback may happen mid-file
+#if defined(__linux__)
+	while (true) {
+		const ssize_t copied = ::copy_file_range(source_fd, nullptr, target_fd, nullptr, KERNEL_COPY_CHUNK, 0);
+		if (copied > 0) {
+			result.bytes += copied;
+			continue;
+		}
+		if (copied == 0 && result.bytes >= size) {
+			result.method = CopyMethod::copy_file_range;
+			return {};
+		}
+		if (copied < 0 && errno == EINTR) continue;
+		if (copied < 0 && !is_unsupported_kernel_copy(errno)) return last_error();
+		break; // unsupported, or a file reporting a wrong size (e.g. in procfs)
+	}
+
+	while (true) {
+		const ssize_t copied = ::sendfile(target_fd, source_fd, nullptr, KERNEL_COPY_CHUNK);
+		if (copied > 0) {
+			result.bytes += copied;
+			continue;
+		}
+		if (copied == 0 && result.bytes >= size) {
+			result.method = CopyMethod::sendfile;
+			return {};
+		}
+		if (copied < 0 && errno == EINTR) continue;
+		if (copied < 0 && !is_unsupported_kernel_copy(errno)) return last_error();
+		break;
+	}
+#endif
+
+	std::unique_ptr<char[]> buffer = acquire_buffer();
+	std::error_code error;
+	while (!error) {
+		const ssize_t read_count = ::read(source_fd, buffer.get(), BUFFER_SIZE);
+		if (read_count == 0) break;
+		if (read_count < 0) {
+			if (errno != EINTR) error = last_error();
+			continue;
+		}
+
+		for (ssize_t written = 0; written < read_count && !error;) {
+			const ssize_t write_count = ::write(target_fd, buffer.get() + written, read_count - written);
+			if (write_count < 0) {
+				if (errno != EINTR) error = last_error();
+				continue;
+			}
+			written += write_count;
+		}
+		result.bytes += read_count;
+	}
+	release_buffer(std::move(buffer));
+
+	result.method = CopyMethod::read_write;
+	return error;
+}
+
+std::error_code KernelCopyEngine::copy_range(
+	const int source_fd,
+	const int target_fd,
+	std::uintmax_t offset,
+	std::uintmax_t length
+) {
+#if defined(__linux__)
+	auto source_offset = static_cast<off_t>(offset);
+	auto target_offset = static_cast<off_t>(offset);
+	while (length > 0) {
+		const ssize_t copied = ::copy_file_range(
+			source_fd, &source_offset, target_fd, &target_offset, std::min<std::uintmax_t>(length, KERNEL_COPY_CHUNK), 0
+		);
+		if (copied > 0) {
+			length -= copied;
+			continue;
+		}
+		if (copied == 0) return {}; // the source has been truncated meanwhile
+		if (errno == EINTR) continue;
+		if (!is_unsupported_kernel_copy(errno)) return last_error();
+		break;
+	}
+	offset = static_cast<std::uintmax_t>(source_offset);
+#endif
+
+	std::unique_ptr<char[]> buffer = acquire_buffer();
+	std::error_code error;
+	while (length > 0 && !error) {
+		const ssize_t read_count = ::pread(
+			source_fd, buffer.get(), std::min<std::uintmax_t>(length, BUFFER_SIZE), static_cast<off_t>(offset)
+		);
+		if (read_count == 0) break;
+		if (read_count < 0) {
+			if (errno != EINTR) error = last_error();
+			continue;
+		}
+
+		for (ssize_t written = 0; written < read_count && !error;) {
+			const ssize_t write_count = ::pwrite(
+				target_fd, buffer.get() + written, read_count - written, static_cast<off_t>(offset + written)
+			);
+			if (write_count < 0) {
+				if (errno != EINTR) error = last_error();
+				continue;
+			}
+			written += write_count;
+		}
+		offset += read_count;
+		length -= read_count;
+	}
+	release_buffer(std::move(buffer));
+	return error;
+}
+
+std::error_code KernelCopyEngine::copy_sparse(
+	const int source_fd,
+	const int target_fd,
+	const std::uintmax_t size,
+	CopyResult &result
+) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	off_t data = 0;
+	while (true) {
+		data = ::lseek(source_fd, data, SEEK_DATA);
+		if (data < 0) {
+			if (errno == ENXIO) break; // no more data, the rest of the file is a hole
+			if (result.bytes == 0 && (errno == EINVAL || errno == EOPNOTSUPP))
+				return std::make_error_code(std::errc::not_supported);
+			return last_error();
+		}
+		const off_t hole = ::lseek(source_fd, data, SEEK_HOLE);
+		if (hole < 0) return last_error();
+
+		const auto length = static_cast<std::uintmax_t>(hole - data);
+		if (const std::error_code error = copy_range(source_fd, target_fd, data, length)) return error;
+		result.bytes += length;
+		data = hole;
+	}
+
+	// the target is empty, extending it creates the holes in between and at the end of the copied extents
+	if (::ftruncate(target_fd, static_cast<off_t>(size)) < 0) return last_error();
+
+	result.method = CopyMethod::sparse;
+	result.hole_bytes = size > result.bytes ? size - result.bytes : 0;
+	return {};
+#else
+	return std::make_error_code(std::errc::not_supported);
+#endif
+}
+
+std::error_code KernelCopyEngine::copy_contents(
+	const fs::path &source,
+	const fs::path &target,
+	const fs::copy_options options,
+	CopyResult &result
+) {
+	const UniqueDescriptor source_fd(::open(source.c_str(), O_RDONLY | O_CLOEXEC));
+	if (!source_fd.valid()) return last_error();
+
+	struct stat source_stat {};
+	if (::fstat(source_fd.get(), &source_stat) < 0) return last_error();
+	if (!S_ISREG(source_stat.st_mode)) return std::make_error_code(std::errc::not_supported);
+
+	const auto size = static_cast<std::uintmax_t>(source_stat.st_size);
+	// fewer allocated blocks than the size implies holes (or compression, for which the copy is dense anyway)
+	const bool sparse = static_cast<std::uintmax_t>(source_stat.st_blocks) * 512 < size;
+	const bool overwrite = (options & fs::copy_options::overwrite_existing) != fs::copy_options::none;
+	// the delta transfer rebuilds the file densely, the holes of a sparse source are kept by copying its extents instead
+	const bool try_delta = delta && overwrite && !sparse;
+
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+	if (!overwrite)
+		flags |= O_EXCL;
+	else if (!try_delta)
+		flags |= O_TRUNC;
+	// otherwise the old target is kept as the basis of the delta transfer until a clone or a full copy replaces it
+
+	const mode_t permissions = source_stat.st_mode & 07777;
+	UniqueDescriptor target_fd(::open(target.c_str(), flags, permissions));
+	if (!target_fd.valid()) {
+		if (errno == EEXIST && (options & fs::copy_options::skip_existing) != fs::copy_options::none)
+			return {};
+		return last_error();
+	}
+
+	// an overwritten file keeps its permissions otherwise
+	if (::fchmod(target_fd.get(), permissions) < 0) return last_error();
+
+	std::error_code error;
+	if (try_clone(source_fd.get(), target_fd.get(), size, result, error)) {
+		// a clone sharing all extents is cheaper than any delta, it only has to drop the rest of a longer old target
+		if (try_delta && ::ftruncate(target_fd.get(), static_cast<off_t>(size)) < 0) return last_error();
+	} else {
+		if (error) return error;
+
+		if (try_delta) {
+			DeltaResult delta_result;
+			error = delta_transfer(source, target, delta_result);
+			if (!error) {
+				statistics.record_delta(delta_result);
+				result.method = CopyMethod::delta;
+				result.bytes = delta_result.literal_bytes;
+				return error;
+			}
+			if (error != std::errc::not_supported) return error;
+			if (::ftruncate(target_fd.get(), 0) < 0) return last_error();
+		}
+
+		if (sparse) error = copy_sparse(source_fd.get(), target_fd.get(), size, result);
+		if (!sparse || error == std::errc::not_supported)
+			error = copy_descriptors(source_fd.get(), target_fd.get(), size, result);
+		if (error) return error;
+	}
+
+	// after the last write, which would update the modification time again
+	if (const std::error_code times_error = copy_file_times(target_fd.get(), source_stat)) return times_error;
+	return target_fd.close();
+}
+
+#else
+
+std::error_code KernelCopyEngine::copy_descriptors(const int, const int, const std::uintmax_t, CopyResult &) {
+	return std::make_error_code(std::errc::not_supported);
+}
+
+std::error_code KernelCopyEngine::copy_range(const int, const int, const std::uintmax_t, const std::uintmax_t) {
+	return std::make_error_code(std::errc::not_supported);
+}
+
+std::error_code KernelCopyEngine::copy_sparse(const int, const int, const std::uintmax_t, CopyResult &) {
+	return std::make_error_code(std::errc::not_supported);
+}
+
+std::error_code KernelCopyEngine::copy_contents(
+	const fs::path &source,
+	const fs::path &target,
+	const fs::copy_options options,
+	CopyResult &result
+) {
+	std::error_code error;
+	if (!fs::copy_file(source, target, options, error)) return error;
+
+	const fs::file_time_type modified = fs::last_write_time(source, error);
+	if (error) return error;
+	fs::last_write_time(target, modified, error);
+	if (error) return error;
+
+	result.method = CopyMethod::filesystem;
+	result.bytes = fs::file_size(target, error);
+	return error;
+}
+
+#endif
+
+std::unique_ptr<CopyEngine> create_copy_engine(const ProgramArguments &arguments, RunStatistics &statistics) {
+	return std::make_unique<KernelCopyEngine>(
+		statistics,
+		arguments.is_verbose(),
+		arguments.get_reflink_mode(),
+		arguments.uses_delta_transfer()
+	);
+}
@@ -0,0 +1,127 @@
+#ifndef DIRSYNC_COPY_ENGINE_HPP
+#define DIRSYNC_COPY_ENGINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+#include "arguments.hpp"
+
+namespace fs = std::filesystem;
+
+struct RunStatistics;
+
+/** The mechanism which transferred the file content. */
+enum class CopyMethod {
+	/** Nothing was copied, e.g. the target existed and was to be skipped. */
+	none,
+	/** The target shares the data extents of the source (copy-on-write clone, Linux `FICLONE`). */
+	reflink,
+	/** The existing target was updated by a delta transfer, see `delta_transfer`. */
+	delta,
+	/** Only the data extents of a sparse source were copied, the holes were recreated. */
+	sparse,
+	/** In-kernel copy, may be offloaded to the filesystem or storage (Linux). */
+	copy_file_range,
+	/** In-kernel copy through the page cache (Linux). */
+	sendfile,
+	/** User-space loop of reads and writes with large pooled buffers. */
+	read_write,
+	/** `std::filesystem::copy_file`, used on platforms without POSIX descriptors. */
+	filesystem,
+};
+
+constexpr std::size_t COPY_METHOD_COUNT = static_cast<std::size_t>(CopyMethod::filesystem) + 1;
+
+const char *copy_method_name(CopyMethod method);
+
+/** The outcome of a single successful file copy. */
+struct CopyResult {
+	CopyMethod method = CopyMethod::none;
+	std::uintmax_t bytes = 0;
+	/** The size of holes in a sparse source, which were not read nor written. */
+	std::uintmax_t hole_bytes = 0;
+};
+
+/** An abstract, pluggable engine copying regular file contents.
+ * Descendants implement `copy_contents`, the base class records run statistics
+ * and reports the used method for each file in verbose mode. */
+class CopyEngine {
+	const bool verbose;
+
+	protected:
+	RunStatistics &statistics;
+
+	CopyEngine(RunStatistics &statistics, const bool verbose) : verbose(verbose), statistics(statistics) {}
+
+	/** Copies the content and permissions of the source file to the target one.
+	 * Supports `overwrite_existing` and `skip_existing` copy options,
+	 * otherwise an existing target is an error - just like `std::filesystem::copy_file`. */
+	virtual std::error_code copy_contents(
+		const fs::path &source,
+		const fs::path &target,
+		fs::copy_options options,
+		CopyResult &result
+	) = 0;
+
+	public:
+	/** Copies the file, see `copy_contents`. */
+	std::error_code copy(const fs::path &source, const fs::path &target, fs::copy_options options);
+
+	virtual ~CopyEngine() = default;
+};
+
+/** The default engine. Overwritten large files may be updated by a delta transfer.
+ * Otherwise, on Linux, it clones the file first (depending on the reflink mode).
+ * Sparse files are copied extent by extent (`SEEK_DATA`/`SEEK_HOLE`), keeping their holes.
+ * Other files are copied by `copy_file_range`, `sendfile`, and finally a read/write loop.
+ * Other POSIX systems use the read/write loop only,
+ * remaining platforms use `std::filesystem::copy_file`. */
+class KernelCopyEngine final : public CopyEngine {
+	const ReflinkMode reflink_mode;
+	const bool delta;
+
+	// buffers for the read/write loop, reused across files and threads
+	std::mutex buffer_mutex;
+	std::vector<std::unique_ptr<char[]>> free_buffers;
+
+	public:
+	static constexpr std::size_t BUFFER_SIZE = 1 << 20;
+
+	KernelCopyEngine(
+		RunStatistics &statistics,
+		const bool verbose,
+		const ReflinkMode reflink_mode,
+		const bool delta
+	) : CopyEngine(statistics, verbose), reflink_mode(reflink_mode), delta(delta) {}
+
+	protected:
+	std::error_code copy_contents(
+		const fs::path &source,
+		const fs::path &target,
+		fs::copy_options options,
+		CopyResult &result
+	) override;
+
+	private:
+	std::unique_ptr<char[]> acquire_buffer();
+	void release_buffer(std::unique_ptr<char[]> buffer);
+	std::error_code copy_descriptors(int source_fd, int target_fd, std::uintmax_t size, CopyResult &result);
+	/** Copies `length` bytes at `offset` of the source to the same offset of the target. */
+	std::error_code copy_range(int source_fd, int target_fd, std::uintmax_t offset, std::uintmax_t length);
+	/** Copies the data extents of a sparse source file, skipping its holes.
+	 * @return `std::errc::not_supported` if holes cannot be located, before anything was written */
+	std::error_code copy_sparse(int source_fd, int target_fd, std::uintmax_t size, CopyResult &result);
+	/** Clones the whole source file into the (empty) target file.
+	 * @return true if cloned, false if the fallback copy should be used */
+	bool try_clone(int source_fd, int target_fd, std::uintmax_t size, CopyResult &result, std::error_code &error) const;
+};
+
+/** Creates the copy engine configured by the program arguments. */
+std::unique_ptr<CopyEngine> create_copy_engine(const ProgramArguments &arguments, RunStatistics &statistics);
+
+#endif //DIRSYNC_COPY_ENGINE_HPP
@@ -0,0 +1,236 @@
+#include "delta.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_descriptor.hpp"
+#include "file_metadata.hpp"
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+
+namespace {
+	constexpr std::size_t MINIMUM_BLOCK_SIZE = 2 * 1024;
+	constexpr std::size_t MAXIMUM_BLOCK_SIZE = 1024 * 1024;
+
+	/** The block size grows with the square root of the file size (as in rsync),
+	 * balancing the number of signatures against the granularity of matches. */
+	std::size_t choose_block_size(const std::uintmax_t file_size) {
+		const auto root = static_cast<std::size_t>(std::sqrt(static_cast<double>(file_size)));
+		const std::size_t rounded = (root + 1023) / 1024 * 1024;
+		return std::clamp(rounded, MINIMUM_BLOCK_SIZE, MAXIMUM_BLOCK_SIZE);
+	}
+
+	/** The rsync weak checksum of a window: two 16-bit sums, updated in O(1) when the window slides. */
+	class RollingChecksum {
+		std::uint32_t a = 0;
+		std::uint32_t b = 0;
+		std::uint32_t length = 0;
+
+		public:
+		void reset(const std::byte *data, const std::size_t size) {
+			a = b = 0;
+			length = static_cast<std::uint32_t>(size);
+			for (std::size_t i = 0; i < size; i++) {
+				const auto value = static_cast<std::uint32_t>(data[i]);
+				a += value;
+				b += (length - static_cast<std::uint32_t>(i)) * value;
+			}
+		}
+
+		/** Slides the window by one byte, removing `out` and appending `in`. */
+		void roll(const std::byte out, const std::byte in) {
+			a += static_cast<std::uint32_t>(in) - static_cast<std::uint32_t>(out);
+			b += a - length * static_cast<std::uint32_t>(out);
+		}
+
+		std::uint32_t value() const { return (a & 0xffff) | (b << 16); }
+	};
+
+	std::error_code write_all(const int fd, const std::byte *data, std::size_t size) {
+		while (size > 0) {
+			const ssize_t written = ::write(fd, data, size);
+			if (written < 0) {
+				if (errno == EINTR) continue;
+				return last_error();
+			}
+			data += written;
+			size -= written;
+		}
+		return {};
+	}
+
+	/** Writes the reconstructed file: literal bytes from the source,
+	 * and consecutive matched blocks coalesced into single copies from the old target. */
+	class DeltaWriter {
+		const int output_fd;
+		const int basis_fd;
+		const MappedFile &basis;
+
+		std::uintmax_t match_offset = 0;
+		std::uintmax_t match_length = 0;
+
+		public:
+		DeltaResult result;
+
+		DeltaWriter(const int output_fd, const int basis_fd, const MappedFile &basis) :
+			output_fd(output_fd), basis_fd(basis_fd), basis(basis) {}
+
+		std::error_code add_literal(const std::byte *data, const std::size_t size) {
+			if (size == 0) return {};
+			if (const std::error_code error = flush_match()) return error;
+
+			result.literal_bytes += size;
+			return write_all(output_fd, data, size);
+		}
+
+		std::error_code add_match(const std::uintmax_t offset, const std::size_t size) {
+			if (match_length > 0 && match_offset + match_length == offset) {
+				match_length += size;
+				return {};
+			}
+			if (const std::error_code error = flush_match()) return error;
+
+			match_offset = offset;
+			match_length = size;
+			return {};
+		}
+
+		std::error_code flush_match() {
+			if (match_length == 0) return {};
+			result.matched_bytes += match_length;
+
+#if defined(__linux__)
+			// in-kernel copy, which also shares the extents on copy-on-write filesystems
+			auto offset = static_cast<off_t>(match_offset);
+			while (match_length > 0) {
+				const ssize_t copied = ::copy_file_range(basis_fd, &offset, output_fd, nullptr, match_length, 0);
+				if (copied <= 0) break;
+				match_length -= copied;
+			}
+			match_offset = static_cast<std::uintmax_t>(offset);
+#endif
+			const std::error_code error = write_all(output_fd, basis.data() + match_offset, match_length);
+			match_length = 0;
+			return error;
+		}
+	};
+
+	std::error_code reconstruct(
+		const MappedFile &source,
+		const MappedFile &basis,
+		const int basis_fd,
+		const int output_fd,
+		DeltaResult &result
+	) {
+		const std::size_t block_size = choose_block_size(basis.size());
+
+		// signatures of all full blocks of the old target
+		std::unordered_multimap<std::uint32_t, std::size_t> signatures;
+		signatures.reserve(basis.size() / block_size);
+		RollingChecksum checksum;
+		for (std::size_t offset = 0; offset + block_size <= basis.size(); offset += block_size) {
+			checksum.reset(basis.data() + offset, block_size);
+			signatures.emplace(checksum.value(), offset);
+		}
+
+		DeltaWriter writer(output_fd, basis_fd, basis);
+		const std::byte *data = source.data();
+		const std::size_t size = source.size();
+
+		std::size_t position = 0;
+		std::size_t literal_start = 0;
+		if (size >= block_size) checksum.reset(data, block_size);
+
+		while (position + block_size <= size) {
+			const auto [first, last] = signatures.equal_range(checksum.value());
+			const auto match = std::find_if(first, last, [&](const auto &signature) {
+				return std::memcmp(data + position, basis.data() + signature.second, block_size) == 0;
+			});
+
+			if (match != last) {
+				if (auto error = writer.add_literal(data + literal_start, position - literal_start)) return error;
+				if (auto error = writer.add_match(match->second, block_size)) return error;
+
+				position += block_size;
+				literal_start = position;
+				if (position + block_size <= size) checksum.reset(data + position, block_size);
+				continue;
+			}
+
+			if (position + block_size < size) checksum.roll(data[position], data[position + block_size]);
+			position++;
+		}
+
+		if (auto error = writer.add_literal(data + literal_start, size - literal_start)) return error;
+		if (auto error = writer.flush_match()) return error;
+
+		result = writer.result;
+		return {};
+	}
+
+	std::error_code open_regular_file(const fs::path &path, UniqueDescriptor &fd, struct stat &status) {
+		fd = UniqueDescriptor(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+		if (!fd.valid()) return last_error();
+		if (::fstat(fd.get(), &status) < 0) return last_error();
+		if (!S_ISREG(status.st_mode)) return std::make_error_code(std::errc::not_supported);
+		return {};
+	}
+}
+
+std::error_code delta_transfer(const fs::path &source, const fs::path &target, DeltaResult &result) {
+	UniqueDescriptor source_fd, basis_fd;
+	struct stat source_status {}, basis_status {};
+
+	if (auto error = open_regular_file(source, source_fd, source_status)) return error;
+	if (auto error = open_regular_file(target, basis_fd, basis_status)) {
+		if (error == std::errc::no_such_file_or_directory) return std::make_error_code(std::errc::not_supported);
+		return error;
+	}
+
+	const auto source_size = static_cast<std::uintmax_t>(source_status.st_size);
+	const auto basis_size = static_cast<std::uintmax_t>(basis_status.st_size);
+	if (source_size < DELTA_MINIMUM_FILE_SIZE || basis_size < DELTA_MINIMUM_FILE_SIZE)
+		return std::make_error_code(std::errc::not_supported);
+
+	MappedFile source_map, basis_map;
+	if (auto error = source_map.map(source_fd.get(), source_size)) return error;
+	if (auto error = basis_map.map(basis_fd.get(), basis_size)) return error;
+
+	// the temporary file lives next to the target, so the final rename stays on one filesystem
+	const fs::path temporary = target.parent_path()
+		/ ("." + target.filename().string() + ".dirsync-delta-" + std::to_string(::getpid()));
+	::unlink(temporary.c_str()); // a leftover of an interrupted run
+
+	UniqueDescriptor output_fd(::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600));
+	if (!output_fd.valid()) return last_error();
+
+	std::error_code error = reconstruct(source_map, basis_map, basis_fd.get(), output_fd.get(), result);
+	if (!error && ::fchmod(output_fd.get(), source_status.st_mode & 07777) < 0) error = last_error();
+	if (!error) error = copy_file_times(output_fd.get(), source_status);
+	if (const std::error_code close_error = output_fd.close(); !error) error = close_error;
+	if (!error && ::rename(temporary.c_str(), target.c_str()) < 0) error = last_error();
+
+	if (error) ::unlink(temporary.c_str());
+	return error;
+}
+
+#else
+
+std::error_code delta_transfer(const fs::path &, const fs::path &, DeltaResult &) {
+	return std::make_error_code(std::errc::not_supported);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef DIRSYNC_DELTA_HPP
+#define DIRSYNC_DELTA_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+/** Files smaller than this are always copied whole, the signatures would not pay off. */
+constexpr std::uintmax_t DELTA_MINIMUM_FILE_SIZE = 64 * 1024;
+
+/** The amount of data reused from the old target file and written from the source. */
+struct DeltaResult {
+	std::uintmax_t matched_bytes = 0;
+	std::uintmax_t literal_bytes = 0;
+};
+
+/** Updates an existing target file to the content of the source file, rsync-style.
+ * Block signatures (a rolling weak checksum) of the target are computed and searched for
+ * in the source at every byte offset. Matching blocks are verified byte by byte and copied
+ * from the old target, only the remaining literal bytes are read from the source.
+ * The result is reconstructed in a temporary file in the target directory,
+ * which then atomically replaces the target.
+ * @return an error; `std::errc::not_supported` if the delta transfer is not applicable
+ * (e.g. a small file or platform without memory mapping) and a full copy should be used instead */
+std::error_code delta_transfer(const fs::path &source, const fs::path &target, DeltaResult &result);
+
+#endif //DIRSYNC_DELTA_HPP
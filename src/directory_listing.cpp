@@ -0,0 +1,164 @@
+#include "directory_listing.hpp"
+
+#include <bit>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+#if defined(__linux__)
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "file_descriptor.hpp"
+#endif
+
+#include "file_metadata.hpp"
+
+#if defined(__linux__)
+
+namespace {
+	/** The record layout returned by the `getdents64` system call. */
+	struct LinuxDirent64 {
+		std::uint64_t d_ino;
+		std::int64_t d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char d_name[1];
+	};
+
+	// large batches amortize the system call over hundreds of entries
+	constexpr std::size_t GETDENTS_BUFFER_SIZE = 256 * 1024;
+
+	fs::file_type file_type_of_dirent(const unsigned char type) {
+		switch (type) {
+			case DT_REG: return fs::file_type::regular;
+			case DT_DIR: return fs::file_type::directory;
+			case DT_LNK: return fs::file_type::symlink;
+			case DT_FIFO: return fs::file_type::fifo;
+			case DT_SOCK: return fs::file_type::socket;
+			case DT_CHR: return fs::file_type::character;
+			case DT_BLK: return fs::file_type::block;
+			default: return fs::file_type::unknown;
+		}
+	}
+}
+
+DirectoryListing list_directory(const fs::path &directory, const bool query_metadata) {
+	const UniqueDescriptor fd(::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+	if (!fd.valid()) throw fs::filesystem_error("cannot open directory", directory, last_error());
+
+	// reused by every listing on this thread
+	thread_local const std::unique_ptr<char[]> buffer = std::make_unique_for_overwrite<char[]>(GETDENTS_BUFFER_SIZE);
+
+	DirectoryListing listing;
+	listing.has_metadata = query_metadata;
+	while (true) {
+		const long count = ::syscall(SYS_getdents64, fd.get(), buffer.get(), GETDENTS_BUFFER_SIZE);
+		if (count < 0) {
+			if (errno == EINTR) continue;
+			throw fs::filesystem_error("cannot read directory", directory, last_error());
+		}
+		if (count == 0) break;
+
+		for (long offset = 0; offset < count;) {
+			const auto *record = reinterpret_cast<const LinuxDirent64 *>(buffer.get() + offset);
+			offset += record->d_reclen;
+
+			const char *name = record->d_name;
+			if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) continue;
+
+			ListedEntry &listed = listing.entries.emplace_back();
+			listed.path = directory / name;
+
+			// the directory type is final, symbolic links are followed by the metadata query
+			listed.metadata.type = file_type_of_dirent(record->d_type);
+			if (query_metadata && listed.metadata.type != fs::file_type::directory)
+				listed.metadata_error = read_file_metadata_at(fd.get(), name, listed.metadata);
+		}
+	}
+	return listing;
+}
+
+#else
+
+DirectoryListing list_directory(const fs::path &directory, const bool query_metadata) {
+	DirectoryListing listing;
+	listing.has_metadata = query_metadata;
+	for (const fs::directory_entry &entry : fs::directory_iterator(directory)) {
+		ListedEntry &listed = listing.entries.emplace_back();
+		listed.path = entry.path();
+		if (query_metadata)
+			listed.metadata_error = read_file_metadata(listed.path, listed.metadata);
+		else
+			listed.metadata.type = entry.status(listed.metadata_error).type();
+	}
+	return listing;
+}
+
+#endif
+
+const ListedEntry *DirectoryListing::find(const std::string_view name) const {
+	for (const ListedEntry &entry : entries) {
+		if constexpr (std::is_same_v<fs::path::value_type, char>) {
+			// compares the end of the path in place, without building a filename path
+			const std::string_view path = entry.path.native();
+			if (path.size() > name.size() && path.ends_with(name) && path[path.size() - name.size() - 1] == '/')
+				return &entry;
+		} else {
+			if (entry.path.filename() == name) return &entry;
+		}
+	}
+	return nullptr;
+}
+
+DirectoryIndex::DirectoryIndex(const DirectoryListing &listing) : listing(&listing) {
+	const std::size_t count = listing.entries.size();
+	if (count == 0) return;
+
+	// at most half of the slots are occupied, which keeps the probe sequences short
+	slots.assign(std::bit_ceil(count * 2), 0);
+	names.reserve(count);
+	const std::size_t mask = slots.size() - 1;
+
+	for (std::size_t i = 0; i < count; i++) {
+		const std::string &name = names.emplace_back(listing.entries[i].path.filename().string());
+		std::size_t slot = std::hash<std::string_view>{}(name) & mask;
+		while (slots[slot] != 0) slot = (slot + 1) & mask;
+		slots[slot] = static_cast<std::uint32_t>(i + 1);
+	}
+}
+
+const ListedEntry *DirectoryIndex::find(const std::string_view name) const {
+	if (slots.empty()) return nullptr;
+	const std::size_t mask = slots.size() - 1;
+
+	for (std::size_t slot = std::hash<std::string_view>{}(name) & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+		const std::size_t index = slots[slot] - 1;
+		if (names[index] == name) return &listing->entries[index];
+	}
+	return nullptr;
+}
+
+DirectoryPairListing list_directory_pair(
+	const fs::path &source_directory,
+	const fs::path &target_directory,
+	const bool query_target_metadata
+) {
+	DirectoryPairListing listing;
+	listing.source = list_directory(source_directory, true);
+
+	std::error_code error;
+	if (fs::is_directory(target_directory, error))
+		listing.target = list_directory(target_directory, query_target_metadata);
+
+	return listing;
+}
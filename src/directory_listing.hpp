@@ -0,0 +1,76 @@
+#ifndef DIRSYNC_DIRECTORY_LISTING_HPP
+#define DIRSYNC_DIRECTORY_LISTING_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "file_metadata.hpp"
+
+namespace fs = std::filesystem;
+
+/** A directory entry enumerated by `list_directory`, together with its metadata (if requested,
+ * otherwise only the type). A failed metadata query is kept in `metadata_error` and reported by the consumer. */
+struct ListedEntry {
+	fs::path path;
+	FileMetadata metadata;
+	std::error_code metadata_error;
+};
+
+/** All entries of a single directory, in the order of enumeration. */
+struct DirectoryListing {
+	std::vector<ListedEntry> entries;
+	/** Whether the metadata of the entries was queried, otherwise only their types are known. */
+	bool has_metadata = false;
+
+	/** Finds a single entry by its file name, by a linear scan. See `DirectoryIndex` for repeated lookups.
+	 * @return the entry or null */
+	const ListedEntry *find(std::string_view name) const;
+};
+
+/** A flat hash table of the entry names of a listing, so the existence (and metadata) of an entry
+ * is answered without a path-resolving system call. Open addressing with linear probing
+ * over a contiguous slot array. The listing must outlive the index. */
+class DirectoryIndex {
+	const DirectoryListing *listing = nullptr;
+	std::vector<std::string> names;
+	/** The entry index plus one of every occupied slot, zero for an empty one. The size is a power of two. */
+	std::vector<std::uint32_t> slots;
+
+	public:
+	DirectoryIndex() = default;
+	explicit DirectoryIndex(const DirectoryListing &listing);
+
+	/** @return the listed entry with the file name, or null */
+	const ListedEntry *find(std::string_view name) const;
+
+	bool has_metadata() const { return listing != nullptr && listing->has_metadata; }
+};
+
+/** Listings of a corresponding source and target directory.
+ * The target listing is empty if the target directory does not exist (yet). */
+struct DirectoryPairListing {
+	DirectoryListing source;
+	DirectoryListing target;
+};
+
+/** Enumerates the directory. On Linux, entries are read in large `getdents64` batches and classified
+ * by their `d_type`. If `query_metadata` is set, the metadata of every entry except directories is read
+ * by a single `statx` relative to the open directory (directories need their type only).
+ * Without `query_metadata`, the type may be unknown or a symbolic link.
+ * Other platforms use `fs::directory_iterator`.
+ * @throws fs::filesystem_error if the directory cannot be iterated */
+DirectoryListing list_directory(const fs::path &directory, bool query_metadata);
+
+/** Lists the source directory with metadata and the target directory, with metadata if requested.
+ * @throws fs::filesystem_error if the source directory cannot be iterated */
+DirectoryPairListing list_directory_pair(
+	const fs::path &source_directory,
+	const fs::path &target_directory,
+	bool query_target_metadata
+);
+
+#endif //DIRSYNC_DIRECTORY_LISTING_HPP
@@ -0,0 +1,80 @@
+#ifndef DIRSYNC_FILE_DESCRIPTOR_HPP
+#define DIRSYNC_FILE_DESCRIPTOR_HPP
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <cerrno>
+#include <cstddef>
+#include <system_error>
+#include <utility>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/** Converts the current `errno` to an error code. */
+inline std::error_code last_error() {
+	return {errno, std::generic_category()};
+}
+
+/** Owns a POSIX file descriptor and closes it upon destruction. */
+class UniqueDescriptor {
+	int fd;
+
+	public:
+	explicit UniqueDescriptor(const int fd = -1) : fd(fd) {}
+	~UniqueDescriptor() { if (fd >= 0) ::close(fd); }
+
+	UniqueDescriptor(UniqueDescriptor &&other) noexcept : fd(std::exchange(other.fd, -1)) {}
+	UniqueDescriptor &operator=(UniqueDescriptor &&other) noexcept {
+		std::swap(fd, other.fd);
+		return *this;
+	}
+
+	int get() const { return fd; }
+	bool valid() const { return fd >= 0; }
+
+	/** Closes the descriptor, reporting the error of delayed writes. */
+	std::error_code close() {
+		const int result = ::close(fd);
+		fd = -1;
+		if (result < 0) return last_error();
+		return {};
+	}
+};
+
+/** A read-only memory mapping of a whole file, unmapped upon destruction.
+ * Empty files are represented by a null mapping of zero size. */
+class MappedFile {
+	const std::byte *address = nullptr;
+	std::size_t length = 0;
+
+	public:
+	MappedFile() = default;
+	~MappedFile() { if (address != nullptr) ::munmap(const_cast<std::byte *>(address), length); }
+
+	MappedFile(MappedFile &&other) noexcept :
+		address(std::exchange(other.address, nullptr)), length(std::exchange(other.length, 0)) {}
+	MappedFile &operator=(MappedFile &&other) noexcept {
+		std::swap(address, other.address);
+		std::swap(length, other.length);
+		return *this;
+	}
+
+	/** Maps the first `size` bytes of the open file. */
+	std::error_code map(const int fd, const std::size_t size) {
+		if (size == 0) return {};
+		void *mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (mapped == MAP_FAILED) return last_error();
+
+		address = static_cast<const std::byte *>(mapped);
+		length = size;
+		return {};
+	}
+
+	const std::byte *data() const { return address; }
+	std::size_t size() const { return length; }
+};
+
+#endif
+
+#endif //DIRSYNC_FILE_DESCRIPTOR_HPP
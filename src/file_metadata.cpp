@@ -0,0 +1,196 @@
+#include "file_metadata.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_descriptor.hpp"
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+
+namespace {
+	fs::file_time_type to_file_time(const std::int64_t seconds, const std::int64_t nanoseconds) {
+		const std::chrono::sys_time<std::chrono::nanoseconds> system_time{
+			std::chrono::seconds(seconds) + std::chrono::nanoseconds(nanoseconds)
+		};
+		return std::chrono::file_clock::from_sys(
+			std::chrono::time_point_cast<std::chrono::file_clock::duration>(system_time)
+		);
+	}
+
+	fs::file_type file_type_of_mode(const mode_t mode) {
+		if (S_ISREG(mode)) return fs::file_type::regular;
+		if (S_ISDIR(mode)) return fs::file_type::directory;
+		if (S_ISLNK(mode)) return fs::file_type::symlink;
+		if (S_ISFIFO(mode)) return fs::file_type::fifo;
+		if (S_ISSOCK(mode)) return fs::file_type::socket;
+		if (S_ISCHR(mode)) return fs::file_type::character;
+		if (S_ISBLK(mode)) return fs::file_type::block;
+		return fs::file_type::unknown;
+	}
+
+	void fill_from_stat(const struct stat &status, FileMetadata &metadata) {
+#if defined(__APPLE__)
+		const timespec &modified = status.st_mtimespec;
+		const timespec &changed = status.st_ctimespec;
+#else
+		const timespec &modified = status.st_mtim;
+		const timespec &changed = status.st_ctim;
+#endif
+		metadata.type = file_type_of_mode(status.st_mode);
+		metadata.size = static_cast<std::uintmax_t>(status.st_size);
+		metadata.modified = to_file_time(modified.tv_sec, modified.tv_nsec);
+		metadata.changed = to_file_time(changed.tv_sec, changed.tv_nsec);
+		metadata.inode = static_cast<std::uint64_t>(status.st_ino);
+		metadata.device = static_cast<std::uint64_t>(status.st_dev);
+	}
+
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+	// only the fields used by dirsync, filesystems may skip gathering the others
+	constexpr unsigned int STATX_FIELDS = STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_CTIME | STATX_INO;
+
+	std::atomic<bool> statx_unsupported = false;
+#endif
+}
+
+std::error_code copy_file_times(const int target_fd, const struct stat &source) {
+#if defined(__APPLE__)
+	const timespec times[2] = {source.st_atimespec, source.st_mtimespec};
+#else
+	const timespec times[2] = {source.st_atim, source.st_mtim};
+#endif
+	if (::futimens(target_fd, times) < 0) return last_error();
+	return {};
+}
+
+std::error_code read_file_metadata_at(const int directory_fd, const char *name, FileMetadata &metadata) {
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+	if (!statx_unsupported.load(std::memory_order_relaxed)) {
+		struct statx status {};
+		if (::statx(directory_fd, name, AT_NO_AUTOMOUNT, STATX_FIELDS, &status) == 0) {
+			metadata.type = file_type_of_mode(status.stx_mode);
+			metadata.size = status.stx_size;
+			metadata.modified = to_file_time(status.stx_mtime.tv_sec, status.stx_mtime.tv_nsec);
+			metadata.changed = to_file_time(status.stx_ctime.tv_sec, status.stx_ctime.tv_nsec);
+			metadata.inode = status.stx_ino;
+			metadata.device = (static_cast<std::uint64_t>(status.stx_dev_major) << 32) | status.stx_dev_minor;
+			return {};
+		}
+		if (errno != ENOSYS) return last_error();
+		statx_unsupported.store(true, std::memory_order_relaxed); // an old kernel, not worth retrying
+	}
+#endif
+
+	struct stat status {};
+	if (::fstatat(directory_fd, name, &status, 0) < 0) return last_error();
+	fill_from_stat(status, metadata);
+	return {};
+}
+
+std::error_code read_file_metadata(const fs::path &path, FileMetadata &metadata) {
+	return read_file_metadata_at(AT_FDCWD, path.c_str(), metadata);
+}
+
+#else
+
+std::error_code read_file_metadata(const fs::path &path, FileMetadata &metadata) {
+	std::error_code error;
+	const fs::file_status status = fs::status(path, error);
+	if (error) return error;
+
+	metadata.type = status.type();
+	metadata.size = fs::is_regular_file(status) ? fs::file_size(path, error) : 0;
+	if (error) return error;
+	metadata.modified = fs::last_write_time(path, error);
+	metadata.changed = metadata.modified;
+	metadata.inode = 0;
+	metadata.device = 0;
+	return error;
+}
+
+#endif
+
+namespace {
+	using namespace std::chrono_literals;
+
+	/** From the coarsest, see `timestamp_granularity_of`. */
+	constexpr std::array<std::chrono::nanoseconds, 11> TIMESTAMP_GRANULARITIES = {
+		2s, 1s, 100ms, 10ms, 1ms, 100us, 10us, 1us, 100ns, 10ns, 1ns
+	};
+
+	/** The number of directory entries whose times are sampled when the granularity is inferred.
+	 * With fewer entries, nothing is inferred. */
+	constexpr int INFERENCE_SAMPLES = 16;
+}
+
+fs::file_time_type::duration timestamp_granularity_of(const fs::file_time_type time) {
+	using namespace std::chrono;
+	const std::int64_t since_epoch = duration_cast<nanoseconds>(file_clock::to_sys(time).time_since_epoch()).count();
+	nanoseconds granularity = 1ns;
+	for (const nanoseconds candidate : TIMESTAMP_GRANULARITIES) {
+		if (since_epoch % candidate.count() == 0) {
+			granularity = candidate;
+			break;
+		}
+	}
+	// a clock coarser than nanoseconds cannot represent finer differences anyway
+	return std::max(duration_cast<fs::file_time_type::duration>(granularity), fs::file_time_type::duration(1));
+}
+
+fs::file_time_type::duration probe_timestamp_granularity(const fs::path &directory, const bool may_write) {
+	using namespace std::chrono;
+	using Duration = fs::file_time_type::duration;
+	std::error_code error;
+
+	if (may_write) {
+		const fs::path probe = directory / (".dirsync-probe-" + std::to_string(
+			system_clock::now().time_since_epoch().count()
+		));
+		const sys_time<nanoseconds> probe_time{1700000001s + 999999999ns};
+		const fs::file_time_type written = file_clock::from_sys(time_point_cast<Duration>(probe_time));
+
+		bool created;
+		{
+			std::ofstream file(probe);
+			created = file.good();
+		}
+		if (created) {
+			fs::last_write_time(probe, written, error);
+			const fs::file_time_type stored = error ? fs::file_time_type() : fs::last_write_time(probe, error);
+			std::error_code remove_error;
+			fs::remove(probe, remove_error);
+			if (!error) return timestamp_granularity_of(stored);
+		}
+	}
+
+	// the finest observed granularity bounds the one of the filesystem from above; the times may be coarser
+	// than the filesystem (e.g. restored from an archive), so a single finer time proves a finer granularity
+	Duration granularity = Duration::max();
+	const fs::file_time_type directory_modified = fs::last_write_time(directory, error);
+	if (!error) granularity = timestamp_granularity_of(directory_modified);
+
+	int samples = 0;
+	for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+		std::error_code entry_error;
+		const fs::file_time_type modified = it->last_write_time(entry_error);
+		if (entry_error) continue;
+		granularity = std::min(granularity, timestamp_granularity_of(modified));
+		if (++samples == INFERENCE_SAMPLES || granularity == Duration(1)) break;
+	}
+
+	// too few times to tell a coarse filesystem from coarse times, they are compared exactly
+	if (granularity != Duration(1) && samples < INFERENCE_SAMPLES) return Duration(1);
+	return granularity;
+}
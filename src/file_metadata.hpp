@@ -0,0 +1,71 @@
+#ifndef DIRSYNC_FILE_METADATA_HPP
+#define DIRSYNC_FILE_METADATA_HPP
+
+#include <chrono>
+#include <compare>
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+/** The metadata of a filesystem entry, read by a single status query (`statx` on Linux)
+ * and shared by filters, comparisons and the manifest, so every file is queried at most once per side.
+ * Symbolic links are followed. */
+struct FileMetadata {
+	fs::file_type type = fs::file_type::none;
+	std::uintmax_t size = 0;
+	fs::file_time_type modified;
+	/** Last status change time; equals `modified` on platforms without it. */
+	fs::file_time_type changed;
+	/** Zero on platforms without inode numbers. */
+	std::uint64_t inode = 0;
+	std::uint64_t device = 0;
+
+	bool is_regular_file() const { return type == fs::file_type::regular; }
+	bool is_directory() const { return type == fs::file_type::directory; }
+};
+
+/** Reads the metadata of the file, following symbolic links.
+ * @return an error; `std::errc::no_such_file_or_directory` if the file does not exist */
+std::error_code read_file_metadata(const fs::path &path, FileMetadata &metadata);
+
+#if defined(__unix__) || defined(__APPLE__)
+/** Reads the metadata of a file relative to an open directory, following symbolic links. */
+std::error_code read_file_metadata_at(int directory_fd, const char *name, FileMetadata &metadata);
+
+/** Sets the access and modification times of the open file to those of the source status, with full precision.
+ * Called after the content was written, so a copy compares equal to its source in later runs. */
+std::error_code copy_file_times(int target_fd, const struct stat &source);
+#endif
+
+/** The coarsest of the usual timestamp granularities (1 ns, the powers of ten up to 1 s, and 2 s of FAT)
+ * which divides the time, i.e. an upper bound of the granularity of the filesystem which stored it. */
+fs::file_time_type::duration timestamp_granularity_of(fs::file_time_type time);
+
+/** Determines the granularity of the modification times stored by the filesystem of the directory.
+ * With `may_write`, a temporary file is given a modification time with an odd second and 999999999 nanoseconds,
+ * the granularity is that of the time read back. Otherwise, or if the file cannot be written, it is inferred
+ * from the existing times of the directory and a sample of its entries, the finest one seen, which may
+ * overestimate it; with fewer entries than the sample size, the times are compared exactly (1 ns). */
+fs::file_time_type::duration probe_timestamp_granularity(const fs::path &directory, bool may_write);
+
+/** Compares the modification times of two files, which are equivalent if closer than the tolerance,
+ * the coarser granularity of their filesystems. */
+inline std::weak_ordering compare_modification_times(
+	const fs::file_time_type first,
+	const fs::file_time_type second,
+	const fs::file_time_type::duration tolerance
+) {
+	const fs::file_time_type::duration difference = first - second;
+	if (difference >= tolerance) return std::weak_ordering::greater;
+	if (-difference >= tolerance) return std::weak_ordering::less;
+	return std::weak_ordering::equivalent;
+}
+
+/** The time in nanoseconds since the file clock epoch, as stored in binary files. */
+inline std::int64_t to_nanoseconds(const fs::file_time_type time) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+#endif //DIRSYNC_FILE_METADATA_HPP
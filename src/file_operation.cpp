@@ -0,0 +1,24 @@
+#include "file_operation.hpp"
+
+#include <filesystem>
+#include <system_error>
+
+#include "constants.hpp"
+#include "copy_engine.hpp"
+
+int perform_file_operation(const FileOperation &operation, CopyEngine &copy_engine) {
+	std::error_code err;
+
+	switch (operation.kind) {
+		case FileOperation::Kind::copy:
+			fs::create_directories(operation.target.parent_path(), err);
+			err = copy_engine.copy(operation.source, operation.target, operation.options);
+			break;
+		case FileOperation::Kind::remove:
+			fs::remove_all(operation.target, err);
+			break;
+	}
+
+	if (err) return EXIT_CODE_FILESYSTEM_ERROR;
+	return 0;
+}
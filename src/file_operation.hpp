@@ -0,0 +1,30 @@
+#ifndef DIRSYNC_FILE_OPERATION_HPP
+#define DIRSYNC_FILE_OPERATION_HPP
+
+#include <filesystem>
+
+#include "copy_engine.hpp"
+
+namespace fs = std::filesystem;
+
+/** A single modifying filesystem action decided by a synchronizer.
+ * Separating the decision from the action allows executing it inline or on another thread. */
+struct FileOperation {
+	enum class Kind {
+		/** Copies `source` to `target`, creating the parent directories of the target. */
+		copy,
+		/** Removes `target`, including the contents of a directory. */
+		remove,
+	};
+
+	Kind kind = Kind::copy;
+	fs::path source;
+	fs::path target;
+	fs::copy_options options = fs::copy_options::none;
+};
+
+/** Performs the operation on the calling thread, copying file contents by the given engine.
+ * @return A program-wide error code. If none occurs, defaults to zero. */
+int perform_file_operation(const FileOperation &operation, CopyEngine &copy_engine);
+
+#endif //DIRSYNC_FILE_OPERATION_HPP
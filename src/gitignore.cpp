@@ -0,0 +1,225 @@
+#include "gitignore.hpp"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+	constexpr std::string_view DOUBLE_STAR = "**";
+
+	bool has_wildcards(const std::string_view segment) {
+		for (std::size_t i = 0; i < segment.size(); i++) {
+			if (segment[i] == '\\') i++;
+			else if (segment[i] == '*' || segment[i] == '?' || segment[i] == '[') return true;
+		}
+		return false;
+	}
+
+	std::string unescape(const std::string_view segment) {
+		std::string result;
+		for (std::size_t i = 0; i < segment.size(); i++) {
+			if (segment[i] == '\\' && i + 1 < segment.size()) i++;
+			result += segment[i];
+		}
+		return result;
+	}
+
+	/** Matches a single character at the pattern position.
+	 * @param next output parameter of the position after the matched pattern element
+	 * @return true if the character matches */
+	bool character_matches(const std::string_view pattern, const std::size_t position, const char c, std::size_t &next) {
+		const char element = pattern[position];
+		if (element == '?') {
+			next = position + 1;
+			return true;
+		}
+		if (element == '\\' && position + 1 < pattern.size()) {
+			next = position + 2;
+			return pattern[position + 1] == c;
+		}
+		if (element != '[') {
+			next = position + 1;
+			return element == c;
+		}
+
+		std::size_t i = position + 1;
+		const bool negated = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+		if (negated) i++;
+
+		bool matched = false;
+		// a closing bracket right after the opening one is a member of the class
+		for (bool first = true; i < pattern.size() && (first || pattern[i] != ']'); first = false) {
+			char low = pattern[i];
+			if (low == '\\' && i + 1 < pattern.size()) low = pattern[++i];
+			i++;
+
+			char high = low;
+			if (i + 1 < pattern.size() && pattern[i] == '-' && pattern[i + 1] != ']') {
+				high = pattern[++i];
+				if (high == '\\' && i + 1 < pattern.size()) high = pattern[++i];
+				i++;
+			}
+			const auto value = static_cast<unsigned char>(c);
+			if (static_cast<unsigned char>(low) <= value && value <= static_cast<unsigned char>(high)) matched = true;
+		}
+
+		// an unterminated class is a literal bracket
+		if (i >= pattern.size()) {
+			next = position + 1;
+			return c == '[';
+		}
+		next = i + 1;
+		return matched != negated;
+	}
+}
+
+bool glob_segment_matches(const std::string_view pattern, const std::string_view name) {
+	// iterative matching, backtracking only to the last asterisk
+	std::size_t p = 0, n = 0;
+	std::size_t star_pattern = std::string_view::npos, star_name = 0;
+
+	while (n < name.size()) {
+		if (p < pattern.size() && pattern[p] == '*') {
+			star_pattern = ++p;
+			star_name = n;
+			continue;
+		}
+		std::size_t next;
+		if (p < pattern.size() && character_matches(pattern, p, name[n], next)) {
+			p = next;
+			n++;
+			continue;
+		}
+		if (star_pattern == std::string_view::npos) return false;
+		p = star_pattern;
+		n = ++star_name;
+	}
+
+	while (p < pattern.size() && pattern[p] == '*') p++;
+	return p == pattern.size();
+}
+
+GitignoreTrie::GitignoreTrie(const std::vector<std::string> &patterns) {
+	for (std::uint32_t rule = 0; rule < patterns.size(); rule++) {
+		std::string_view line = patterns[rule];
+
+		// trailing spaces are ignored unless escaped
+		while (!line.empty() && line.back() == ' ' && !(line.size() >= 2 && line[line.size() - 2] == '\\'))
+			line.remove_suffix(1);
+		if (line.empty() || line.front() == '#') continue;
+
+		Terminal terminal {rule, false, false};
+		if (line.front() == '!') {
+			terminal.negated = true;
+			line.remove_prefix(1);
+		}
+		if (!line.empty() && line.back() == '/') {
+			terminal.directory_only = true;
+			line.remove_suffix(1);
+		}
+
+		// a slash at the beginning or in the middle anchors the pattern to the configured directory
+		const bool anchored = line.find('/') != std::string_view::npos;
+		if (!line.empty() && line.front() == '/') line.remove_prefix(1);
+		if (line.empty()) continue;
+
+		std::vector<std::string_view> segments;
+		if (!anchored) segments.push_back(DOUBLE_STAR);
+		while (!line.empty()) {
+			const std::size_t slash = line.find('/');
+			const std::string_view segment = line.substr(0, slash);
+			if (!segment.empty()) segments.push_back(segment);
+			line.remove_prefix(slash == std::string_view::npos ? line.size() : slash + 1);
+		}
+
+		// a trailing `**` matches everything inside, but not the directory itself
+		if (segments.back() == DOUBLE_STAR) {
+			segments.back() = "*";
+			segments.push_back(DOUBLE_STAR);
+		}
+		insert(segments, terminal);
+	}
+
+	add_node(root, 0);
+}
+
+void GitignoreTrie::insert(const std::vector<std::string_view> &segments, const Terminal terminal) {
+	std::uint32_t node = 0;
+	for (const std::string_view segment : segments) {
+		std::uint32_t next = 0;
+
+		if (segment == DOUBLE_STAR) {
+			next = nodes[node].double_star_child;
+			if (next == 0) {
+				next = static_cast<std::uint32_t>(nodes.size());
+				nodes[node].double_star_child = next;
+				nodes.emplace_back().is_double_star = true;
+			}
+		} else if (has_wildcards(segment)) {
+			auto &children = nodes[node].glob_children;
+			const auto found = std::ranges::find(children, segment, &std::pair<std::string, std::uint32_t>::first);
+			if (found != children.end()) next = found->second;
+			else {
+				next = static_cast<std::uint32_t>(nodes.size());
+				children.emplace_back(segment, next);
+				nodes.emplace_back();
+			}
+		} else {
+			const std::string literal = unescape(segment);
+			const auto found = nodes[node].literal_children.find(literal);
+			if (found != nodes[node].literal_children.end()) next = found->second;
+			else {
+				next = static_cast<std::uint32_t>(nodes.size());
+				nodes[node].literal_children.emplace(literal, next);
+				nodes.emplace_back();
+			}
+		}
+		node = next;
+	}
+	nodes[node].terminals.push_back(terminal);
+}
+
+void GitignoreTrie::add_node(State &state, const std::uint32_t node) const {
+	if (std::ranges::find(state, node) != state.end()) return;
+	state.push_back(node);
+	// `**` may match zero segments
+	if (nodes[node].double_star_child != 0) add_node(state, nodes[node].double_star_child);
+}
+
+void GitignoreTrie::step_into(const State &state, const std::string_view name, State &next) const {
+	next.clear();
+	for (const std::uint32_t index : state) {
+		const Node &node = nodes[index];
+		if (node.is_double_star) add_node(next, index);
+
+		if (const auto found = node.literal_children.find(name); found != node.literal_children.end())
+			add_node(next, found->second);
+		for (const auto &[pattern, child] : node.glob_children) {
+			if (glob_segment_matches(pattern, name)) add_node(next, child);
+		}
+	}
+}
+
+GitignoreTrie::State GitignoreTrie::step(const State &state, const std::string_view name) const {
+	State next;
+	step_into(state, name, next);
+	return next;
+}
+
+GitignoreVerdict GitignoreTrie::match(const State &state, const std::string_view name, const bool is_directory) const {
+	// the scratch state is reused, matching an entry does not allocate in the steady state
+	thread_local State next;
+	step_into(state, name, next);
+
+	const Terminal *decisive = nullptr;
+	for (const std::uint32_t index : next) {
+		for (const Terminal &terminal : nodes[index].terminals) {
+			if (terminal.directory_only && !is_directory) continue;
+			if (decisive == nullptr || terminal.rule > decisive->rule) decisive = &terminal;
+		}
+	}
+
+	if (decisive == nullptr) return GitignoreVerdict::none;
+	return decisive->negated ? GitignoreVerdict::included : GitignoreVerdict::excluded;
+}
@@ -0,0 +1,83 @@
+#ifndef DIRSYNC_GITIGNORE_HPP
+#define DIRSYNC_GITIGNORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** The decision of the gitignore patterns about a path. */
+enum class GitignoreVerdict {
+	/** no pattern matches */
+	none,
+	excluded,
+	/** re-included by a negated pattern `!...` */
+	included,
+};
+
+/** Exclusion patterns in the gitignore syntax, relative to the configured directory:
+ * `*`, `?` and `[a-z]`/`[!a-z]` classes within a path segment, `**` across segments,
+ * a leading or middle slash anchoring the pattern to the configured directory, a trailing slash
+ * matching directories only, `!` negation re-including a path, `#` comments and backslash escapes.
+ * As in git, the last matching pattern decides.
+ *
+ * The patterns are compiled into a trie of path segments, literal segments are shared between patterns.
+ * Matching walks the trie as a non-deterministic automaton, one segment at a time: the `State` of a directory
+ * is computed once when it is entered, and its entries are matched by a single step from it. */
+class GitignoreTrie {
+	struct Terminal {
+		/** The pattern position, the last matching pattern wins. */
+		std::uint32_t rule;
+		bool negated;
+		bool directory_only;
+	};
+
+	struct StringHash {
+		using is_transparent = void;
+		std::size_t operator()(const std::string_view text) const { return std::hash<std::string_view>{}(text); }
+	};
+
+	struct Node {
+		std::unordered_map<std::string, std::uint32_t, StringHash, std::equal_to<>> literal_children;
+		/** Segments with wildcards or classes, in the pattern syntax. */
+		std::vector<std::pair<std::string, std::uint32_t>> glob_children;
+		/** The `**` child, matching zero or more segments, zero if none. */
+		std::uint32_t double_star_child = 0;
+		bool is_double_star = false;
+		std::vector<Terminal> terminals;
+	};
+
+	public:
+	/** The trie nodes reached by the path of a directory. */
+	using State = std::vector<std::uint32_t>;
+
+	private:
+	std::vector<Node> nodes{1};
+	State root;
+
+	void insert(const std::vector<std::string_view> &segments, Terminal terminal);
+	void add_node(State &state, std::uint32_t node) const;
+	void step_into(const State &state, std::string_view name, State &next) const;
+
+	public:
+	explicit GitignoreTrie(const std::vector<std::string> &patterns);
+
+	/** The state of the configured directory itself. */
+	const State &root_state() const { return root; }
+
+	/** The state of a subdirectory of the directory with the given state.
+	 * Empty if no pattern can match anything below it. */
+	State step(const State &state, std::string_view name) const;
+
+	/** Decides about an entry of the directory with the given state. */
+	GitignoreVerdict match(const State &state, std::string_view name, bool is_directory) const;
+};
+
+/** Matches a single path segment against a gitignore segment pattern with `*`, `?`, classes and escapes. */
+bool glob_segment_matches(std::string_view pattern, std::string_view name);
+
+#endif //DIRSYNC_GITIGNORE_HPP
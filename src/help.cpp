@@ -16,6 +16,17 @@ const char *HELP =
 	"-s, --skip-existing, --safe:	Skip copying files that are already in their respective destination.\n"
 	"-r, --rename:	Use renaming conflict strategy: copy the source content to a new file with appended \"last write\" timestamp in the filename, using -YYYY-MM-DD-hh-mm-ss suffix format. File extension is kept.\n"
 	"--copy-configs, --copy-configurations:	Copy directory configuration files themselves, if encountered.\n"
+	"--reflink[=auto|always|never]:	Clone file contents on copy-on-write filesystems (btrfs, XFS) instead of copying the data. 'auto' (default) falls back to copying, 'always' fails when cloning is unsupported, a bare --reflink means 'always'.\n"
+	"--delta:	When overwriting an existing large file, transfer only the changed blocks (rsync-style rolling checksum) instead of the whole file.\n"
+	"--checksum:	Compare existing files by their sizes and a hash of their contents instead of their last write times alone. Identical files are not copied even if their times differ, files with equal times but different contents are (in two-way mode, they are reported and left alone). The last write time still decides which version is newer. Files recorded unchanged by --manifest or --state are not read.\n"
+	"--pipeline:	One-way only. Overlap directory enumeration, planning and copying in separate threads connected by bounded queues. Uses the --jobs count for scanner and copying threads.\n"
+	"--manifest:	One-way only. Keep a manifest of the written files (.dirsync-manifest) in the target root. Files unchanged since they were written are skipped without examining the target.\n"
+	"--prune:	One-way only, implies --manifest. Skip source directories whose modification and status change times and configurations did not change since the last run; their files are not examined. Subdirectories are still checked one by one.\n"
+	"--full-scan:	With --prune, examine every directory in this run and refresh the records. Use periodically to pick up files modified in place.\n"
+	"--config-cache[=FILE]:	Keep the parsed directory configurations in a binary cache file (by default ~/.cache/dirsync/configurations), so only new and changed configuration files are parsed.\n"
+	"--state[=FILE]:	Two-way only. Record the synchronized entries in a state file (by default in ~/.cache/dirsync/state/, one per directory pair), so the next run can tell which side changed: deletions are propagated, entries modified on both sides are reported as conflicts and resolved by the conflict strategy, unchanged files are skipped.\n"
+	"--watch[=MS]:	After the synchronization, keep watching the source directory (and the target one in two-way mode) by inotify and synchronize the changed entries. Changes are collected until none arrives for MS milliseconds (default 500). Stopped by SIGINT or SIGTERM. Linux only.\n"
+	"-j N, --jobs N, --jobs=N:	Synchronize subdirectories in parallel using N threads, in both one-way and two-way mode. Defaults to 1 (serial synchronization).\n"
 	"--test:	Runs implementation tests. Used by developers and testers.\n";
 
 void print_help() {
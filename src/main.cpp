@@ -6,6 +6,7 @@
 #include "help.hpp"
 #include "synchronize.hpp"
 #include "tests.hpp"
+#include "watch.hpp"
 
 int main(const int argc, char **argv) {
 	const std::vector<std::string> args(argv, argv + argc);
@@ -19,6 +20,7 @@ int main(const int argc, char **argv) {
 	} else if (mode == ProgramMode::test) {
 		return run_tests();
 	} else if (mode == ProgramMode::synchronize) {
+		if (arguments->watches()) return watch_directories(*arguments);
 		return synchronize_directories(*arguments);
 	}
 
@@ -0,0 +1,305 @@
+#include "manifest.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file_descriptor.hpp"
+#endif
+
+#include "file_metadata.hpp"
+
+namespace {
+	constexpr char MANIFEST_MAGIC[8] = {'D', 'I', 'R', 'S', 'Y', 'N', 'C', 'M'};
+	constexpr std::uint32_t MANIFEST_VERSION = 4;
+
+	struct ManifestHeader {
+		char magic[8];
+		std::uint32_t version;
+		/** Guards against a different record layout (or byte order, together with the version). */
+		std::uint32_t record_size;
+		std::uint64_t record_count;
+		std::uint32_t directory_record_size;
+		std::uint32_t reserved;
+		std::uint64_t directory_record_count;
+		std::uint64_t paths_size;
+	};
+
+	static_assert(std::is_trivially_copyable_v<ManifestHeader>);
+	static_assert(std::is_trivially_copyable_v<ManifestRecord>);
+	static_assert(std::is_trivially_copyable_v<DirectoryRecord>);
+	static_assert(sizeof(ManifestHeader) % alignof(ManifestRecord) == 0);
+	static_assert(sizeof(ManifestRecord) % alignof(DirectoryRecord) == 0);
+
+	/** The parent directory of a relative path in the generic format, empty for the root. */
+	std::string_view parent_of(const std::string_view path) {
+		const std::size_t slash = path.rfind('/');
+		if (slash == std::string_view::npos) return {};
+		return path.substr(0, slash);
+	}
+
+	bool is_within_scope(const std::string_view path, const std::string_view scope) {
+		if (scope.empty() || path == scope) return true;
+		if (!path.starts_with(scope)) return false;
+		return scope.ends_with('/') || path[scope.size()] == '/';
+	}
+
+	bool is_within_scopes(const std::string_view path, const std::vector<std::string> &scopes) {
+		return std::ranges::any_of(scopes, [path](const std::string &scope) { return is_within_scope(path, scope); });
+	}
+
+	/** Validates the header and the overall size of the file content. */
+	bool is_valid_manifest(const std::byte *data, const std::size_t size, ManifestHeader &header) {
+		if (size < sizeof(ManifestHeader)) return false;
+		std::memcpy(&header, data, sizeof(ManifestHeader));
+
+		if (std::memcmp(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0) return false;
+		if (header.version != MANIFEST_VERSION || header.record_size != sizeof(ManifestRecord)) return false;
+		if (header.directory_record_size != sizeof(DirectoryRecord)) return false;
+
+		std::uint64_t available = size - sizeof(ManifestHeader);
+		if (header.record_count > available / sizeof(ManifestRecord)) return false;
+		available -= header.record_count * sizeof(ManifestRecord);
+		if (header.directory_record_count > available / sizeof(DirectoryRecord)) return false;
+		available -= header.directory_record_count * sizeof(DirectoryRecord);
+		return header.paths_size == available;
+	}
+}
+
+bool is_manifest_file(const fs::path &target_path, const fs::path &target_root) {
+	return target_path.lexically_relative(target_root) == MANIFEST_FILE_NAME;
+}
+
+TargetManifest::TargetManifest(fs::path target_root) : target_root(std::move(target_root)) {
+	const fs::path file_path = this->target_root / MANIFEST_FILE_NAME;
+	const std::byte *data = nullptr;
+	std::size_t size = 0;
+
+#if defined(__unix__) || defined(__APPLE__)
+	const UniqueDescriptor fd(::open(file_path.c_str(), O_RDONLY | O_CLOEXEC));
+	struct stat status {};
+	if (!fd.valid() || ::fstat(fd.get(), &status) < 0 || !S_ISREG(status.st_mode)) return;
+	if (mapping.map(fd.get(), static_cast<std::size_t>(status.st_size))) return;
+	data = mapping.data();
+	size = mapping.size();
+#else
+	std::ifstream file(file_path, std::ios::binary);
+	if (!file) return;
+	std::vector<char> content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+	buffer.resize(content.size());
+	std::memcpy(buffer.data(), content.data(), content.size());
+	data = buffer.data();
+	size = buffer.size();
+#endif
+
+	ManifestHeader header {};
+	if (!is_valid_manifest(data, size, header)) return;
+
+	records = reinterpret_cast<const ManifestRecord *>(data + sizeof(ManifestHeader));
+	record_count = header.record_count;
+	directory_records = reinterpret_cast<const DirectoryRecord *>(records + record_count);
+	directory_record_count = header.directory_record_count;
+	paths = std::string_view(
+		reinterpret_cast<const char *>(directory_records + directory_record_count),
+		header.paths_size
+	);
+}
+
+std::string_view TargetManifest::string_at(const std::uint64_t offset, const std::uint64_t length) const {
+	// a damaged record cannot point outside of the string table
+	if (offset > paths.size() || length > paths.size() - offset) return {};
+	return paths.substr(offset, length);
+}
+
+std::string_view TargetManifest::path_of(const ManifestRecord &record) const {
+	return string_at(record.path_offset, record.path_length);
+}
+
+const ManifestRecord *TargetManifest::find(const std::string_view relative_path) const {
+	const ManifestRecord *end = records + record_count;
+	const ManifestRecord *found = std::lower_bound(
+		records,
+		end,
+		relative_path,
+		[this](const ManifestRecord &record, const std::string_view path) { return path_of(record) < path; }
+	);
+
+	if (found == end || path_of(*found) != relative_path) return nullptr;
+	return found;
+}
+
+const DirectoryRecord *TargetManifest::find_directory(const std::string_view relative_path) const {
+	const DirectoryRecord *end = directory_records + directory_record_count;
+	const DirectoryRecord *found = std::lower_bound(
+		directory_records,
+		end,
+		relative_path,
+		[this](const DirectoryRecord &record, const std::string_view path) {
+			return string_at(record.path_offset, record.path_length) < path;
+		}
+	);
+
+	if (found == end || string_at(found->path_offset, found->path_length) != relative_path) return nullptr;
+	return found;
+}
+
+std::vector<std::string_view> TargetManifest::children_of(const DirectoryRecord &record) const {
+	std::vector<std::string_view> children;
+	std::string_view remaining = string_at(record.children_offset, record.children_length);
+	while (!remaining.empty()) {
+		const std::size_t slash = remaining.find('/');
+		children.push_back(remaining.substr(0, slash));
+		if (slash == std::string_view::npos) break;
+		remaining.remove_prefix(slash + 1);
+	}
+	return children;
+}
+
+void TargetManifest::keep_directory(std::string relative_path, const DirectoryRecord &record) {
+	std::string children(string_at(record.children_offset, record.children_length));
+
+	std::lock_guard lock(pending_mutex);
+	kept_directories.insert(relative_path);
+	pending_directories.push_back({std::move(relative_path), std::move(children), record});
+}
+
+void TargetManifest::record_directory(
+	std::string relative_path,
+	const FileMetadata &metadata,
+	const std::uint64_t configuration_fingerprint,
+	const std::vector<std::string> &children
+) {
+	DirectoryRecord record {};
+	record.modified = to_nanoseconds(metadata.modified);
+	record.changed = to_nanoseconds(metadata.changed);
+	record.configuration_fingerprint = configuration_fingerprint;
+
+	std::string joined_children;
+	for (const std::string &child : children) {
+		if (!joined_children.empty()) joined_children += '/';
+		joined_children += child;
+	}
+
+	std::lock_guard lock(pending_mutex);
+	pending_directories.push_back({std::move(relative_path), std::move(joined_children), record});
+}
+
+void TargetManifest::keep(std::string relative_path, const ManifestRecord &record) {
+	std::lock_guard lock(pending_mutex);
+	pending.push_back({std::move(relative_path), record});
+}
+
+void TargetManifest::record(std::string relative_path, const FileMetadata &source) {
+	ManifestRecord record {};
+	record.size = source.size;
+	record.source_modified = to_nanoseconds(source.modified);
+
+	std::lock_guard lock(pending_mutex);
+	pending.push_back({std::move(relative_path), record});
+}
+
+std::error_code TargetManifest::save_partial(const std::vector<std::string> &scopes) {
+	{
+		std::lock_guard lock(pending_mutex);
+		for (const ManifestRecord &record : std::span(records, record_count)) {
+			const std::string_view path = path_of(record);
+			if (!is_within_scopes(path, scopes)) pending.push_back({std::string(path), record});
+		}
+		for (const DirectoryRecord &record : std::span(directory_records, directory_record_count)) {
+			const std::string_view path = string_at(record.path_offset, record.path_length);
+			if (is_within_scopes(path, scopes)) continue;
+			pending_directories.push_back({
+				std::string(path),
+				std::string(string_at(record.children_offset, record.children_length)),
+				record
+			});
+		}
+	}
+	return save();
+}
+
+std::error_code TargetManifest::save() {
+	std::lock_guard lock(pending_mutex);
+
+	// files in kept directories were not visited, their previous records remain valid
+	if (!kept_directories.empty()) {
+		for (const ManifestRecord &record : std::span(records, record_count)) {
+			const std::string_view path = path_of(record);
+			if (kept_directories.contains(std::string(parent_of(path))))
+				pending.push_back({std::string(path), record});
+		}
+	}
+
+	std::ranges::sort(pending, {}, &PendingRecord::path);
+	const auto duplicates = std::ranges::unique(pending, {}, &PendingRecord::path);
+	pending.erase(duplicates.begin(), duplicates.end());
+
+	std::vector<ManifestRecord> sorted_records;
+	sorted_records.reserve(pending.size());
+	std::string sorted_paths;
+
+	for (PendingRecord &pending_record : pending) {
+		ManifestRecord &record = pending_record.record;
+		record.path_offset = sorted_paths.size();
+		record.path_length = static_cast<std::uint32_t>(pending_record.path.size());
+		sorted_paths += pending_record.path;
+		sorted_records.push_back(record);
+	}
+
+	std::ranges::sort(pending_directories, {}, &PendingDirectoryRecord::path);
+	std::vector<DirectoryRecord> sorted_directory_records;
+	sorted_directory_records.reserve(pending_directories.size());
+
+	for (PendingDirectoryRecord &pending_directory : pending_directories) {
+		DirectoryRecord &record = pending_directory.record;
+		record.path_offset = sorted_paths.size();
+		record.path_length = static_cast<std::uint32_t>(pending_directory.path.size());
+		sorted_paths += pending_directory.path;
+		record.children_offset = sorted_paths.size();
+		record.children_length = static_cast<std::uint32_t>(pending_directory.children.size());
+		sorted_paths += pending_directory.children;
+		sorted_directory_records.push_back(record);
+	}
+
+	ManifestHeader header {};
+	std::memcpy(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+	header.version = MANIFEST_VERSION;
+	header.record_size = sizeof(ManifestRecord);
+	header.record_count = sorted_records.size();
+	header.directory_record_size = sizeof(DirectoryRecord);
+	header.directory_record_count = sorted_directory_records.size();
+	header.paths_size = sorted_paths.size();
+
+	// the previous manifest may still be mapped, it is replaced by renaming a complete new file
+	const fs::path file_path = target_root / MANIFEST_FILE_NAME;
+	fs::path temporary_path = file_path;
+	temporary_path += ".tmp";
+	{
+		std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(
+			reinterpret_cast<const char *>(sorted_records.data()),
+			static_cast<std::streamsize>(sorted_records.size() * sizeof(ManifestRecord))
+		);
+		file.write(
+			reinterpret_cast<const char *>(sorted_directory_records.data()),
+			static_cast<std::streamsize>(sorted_directory_records.size() * sizeof(DirectoryRecord))
+		);
+		file.write(sorted_paths.data(), static_cast<std::streamsize>(sorted_paths.size()));
+		file.close();
+		if (!file) return std::make_error_code(std::errc::io_error);
+	}
+
+	std::error_code error;
+	fs::rename(temporary_path, file_path, error);
+	return error;
+}
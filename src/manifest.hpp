@@ -0,0 +1,143 @@
+#ifndef DIRSYNC_MANIFEST_HPP
+#define DIRSYNC_MANIFEST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include "file_descriptor.hpp"
+#endif
+
+#include "file_metadata.hpp"
+
+namespace fs = std::filesystem;
+
+/** The manifest file name, in the target root directory. */
+constexpr char MANIFEST_FILE_NAME[] = ".dirsync-manifest";
+
+/** Whether the target path is the manifest file itself, i.e. directly in the target root. */
+bool is_manifest_file(const fs::path &target_path, const fs::path &target_root);
+
+/** A fixed-size manifest record, as stored in the file. Records are sorted by their paths,
+ * which are stored in a string table following the records. */
+struct ManifestRecord {
+	std::uint64_t path_offset;
+	std::uint32_t path_length;
+	std::uint32_t reserved;
+	/** The size and last write time of the source file version which was written. */
+	std::uint64_t size;
+	/** Nanoseconds since the file clock epoch, see `to_nanoseconds`. */
+	std::int64_t source_modified;
+};
+
+/** A fixed-size record of a source directory, used to prune unchanged directories.
+ * The names of its synchronized subdirectories are stored in the string table, separated by slashes. */
+struct DirectoryRecord {
+	std::uint64_t path_offset;
+	std::uint32_t path_length;
+	std::uint32_t children_length;
+	std::uint64_t children_offset;
+	/** The times of the source directory, read before it was enumerated. */
+	std::int64_t modified;
+	std::int64_t changed;
+	/** Identifies the configuration stack (and relevant arguments) the directory was synchronized with. */
+	std::uint64_t configuration_fingerprint;
+};
+
+/** The manifest of the target directory tree, recording every file dirsync wrote (or found up to date)
+ * by its path relative to the target root, and the source directories which were synchronized.
+ * The manifest of the previous run is memory-mapped and searched by binary search, the records
+ * of the current run are collected and written at its end. Shared by parallel tasks, the methods are thread-safe.
+ *
+ * File layout (native byte order): header, sorted `ManifestRecord`s, sorted `DirectoryRecord`s,
+ * string table of paths. */
+class TargetManifest {
+	const fs::path target_root;
+
+	// the previous manifest; an invalid or missing file is treated as empty
+#if defined(__unix__) || defined(__APPLE__)
+	MappedFile mapping;
+#else
+	std::vector<std::byte> buffer;
+#endif
+	const ManifestRecord *records = nullptr;
+	std::size_t record_count = 0;
+	const DirectoryRecord *directory_records = nullptr;
+	std::size_t directory_record_count = 0;
+	std::string_view paths;
+
+	struct PendingRecord {
+		std::string path;
+		ManifestRecord record;
+	};
+
+	struct PendingDirectoryRecord {
+		std::string path;
+		std::string children;
+		DirectoryRecord record;
+	};
+
+	std::mutex pending_mutex;
+	std::vector<PendingRecord> pending;
+	std::vector<PendingDirectoryRecord> pending_directories;
+	/** Directories kept from the previous run, whose file records are carried over as well. */
+	std::unordered_set<std::string> kept_directories;
+
+	std::string_view string_at(std::uint64_t offset, std::uint64_t length) const;
+	std::string_view path_of(const ManifestRecord &record) const;
+
+	public:
+	/** Loads the manifest of the previous run from the target root, if any. */
+	explicit TargetManifest(fs::path target_root);
+
+	/** Finds the record of the previous run.
+	 * @param relative_path the path relative to the target root, in the generic format
+	 * @return the record or null */
+	const ManifestRecord *find(std::string_view relative_path) const;
+
+	/** Carries the record of an unchanged file over to the manifest of this run. */
+	void keep(std::string relative_path, const ManifestRecord &record);
+
+	/** Records the source version of a file which is (being) written to the target, or is up to date. */
+	void record(std::string relative_path, const FileMetadata &source);
+
+	/** Finds the directory record of the previous run.
+	 * @param relative_path the path relative to the source root, in the generic format (empty for the root)
+	 * @return the record or null */
+	const DirectoryRecord *find_directory(std::string_view relative_path) const;
+
+	/** The names of the subdirectories of the directory record. */
+	std::vector<std::string_view> children_of(const DirectoryRecord &record) const;
+
+	/** Carries the directory record over to the manifest of this run, together with the records
+	 * of the files directly in it, since the directory was not examined. */
+	void keep_directory(std::string relative_path, const DirectoryRecord &record);
+
+	/** Records a source directory which was synchronized successfully.
+	 * @param metadata the metadata of the directory, read before enumerating it
+	 * @param children the names of the synchronized subdirectories */
+	void record_directory(
+		std::string relative_path,
+		const FileMetadata &metadata,
+		std::uint64_t configuration_fingerprint,
+		const std::vector<std::string> &children
+	);
+
+	/** Writes the manifest of this run, replacing the previous one. */
+	std::error_code save();
+
+	/** Writes the manifest of a run which synchronized only some entries (`--watch`): the previous file
+	 * and directory records outside of the synchronized scopes are carried over.
+	 * @param scopes relative paths of the synchronized entries, including their subtrees.
+	 * A scope ending with a slash covers the contents of the directory, an empty one everything. */
+	std::error_code save_partial(const std::vector<std::string> &scopes);
+};
+
+#endif //DIRSYNC_MANIFEST_HPP
@@ -0,0 +1,125 @@
+#include "pattern_set.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "wildcards.hpp"
+
+void PatternSet::AffixTable::insert(const std::string_view literal) {
+	literals.emplace(literal);
+	const auto position = std::ranges::lower_bound(lengths, literal.size());
+	if (position == lengths.end() || *position != literal.size()) lengths.insert(position, literal.size());
+}
+
+bool PatternSet::AffixTable::contains_prefix_of(const std::string_view name) const {
+	for (const std::size_t length : lengths) {
+		if (length > name.size()) break;
+		if (literals.contains(name.substr(0, length))) return true;
+	}
+	return false;
+}
+
+bool PatternSet::AffixTable::contains_suffix_of(const std::string_view name) const {
+	for (const std::size_t length : lengths) {
+		if (length > name.size()) break;
+		if (literals.contains(name.substr(name.size() - length))) return true;
+	}
+	return false;
+}
+
+std::uint32_t PatternSet::Node::child(const unsigned char byte) const {
+	for (const auto &[label, node] : children) {
+		if (label == byte) return node;
+	}
+	return 0;
+}
+
+PatternSet::PatternSet(const PatternSet &base, const std::span<const CompiledWildcard> added) {
+	patterns.reserve(base.patterns.size() + added.size());
+	patterns.insert(patterns.end(), base.patterns.begin(), base.patterns.end());
+	patterns.insert(patterns.end(), added.begin(), added.end());
+
+	// the failure links depend on the whole trie, so the automaton is built anew
+	for (std::uint32_t i = 0; i < patterns.size(); i++) insert(i);
+	link_failures();
+}
+
+void PatternSet::insert(const std::uint32_t pattern_index) {
+	const CompiledWildcard &pattern = patterns[pattern_index];
+	const std::string_view literal = pattern.longest_literal();
+
+	switch (pattern.shape()) {
+		case WildcardShape::exact: exact_names.emplace(literal); break;
+		case WildcardShape::prefix: prefixes.insert(literal); break;
+		case WildcardShape::suffix: suffixes.insert(literal); break;
+		case WildcardShape::contains: contained_literals.emplace_back(literal); break;
+		case WildcardShape::anything: matches_anything = true; break;
+		case WildcardShape::general: insert_general(pattern_index); break;
+	}
+}
+
+void PatternSet::insert_general(const std::uint32_t pattern_index) {
+	std::uint32_t node = 0;
+	for (const char c : patterns[pattern_index].longest_literal()) {
+		const auto byte = static_cast<unsigned char>(c);
+		std::uint32_t next = nodes[node].child(byte);
+		if (next == 0) {
+			next = static_cast<std::uint32_t>(nodes.size());
+			nodes[node].children.emplace_back(byte, next);
+			nodes.emplace_back();
+		}
+		node = next;
+	}
+	nodes[node].outputs.push_back(pattern_index);
+}
+
+void PatternSet::link_failures() {
+	// breadth-first, so the failure node of every node is final before its children are linked
+	std::vector<std::uint32_t> queue;
+	for (const auto &[_, child] : nodes[0].children) queue.push_back(child);
+
+	for (std::size_t i = 0; i < queue.size(); i++) {
+		const std::uint32_t node = queue[i];
+		for (const auto &[byte, child] : nodes[node].children) {
+			std::uint32_t failure = nodes[node].failure;
+			while (failure != 0 && nodes[failure].child(byte) == 0) failure = nodes[failure].failure;
+			nodes[child].failure = nodes[failure].child(byte);
+
+			const Node &failure_node = nodes[nodes[child].failure];
+			nodes[child].output_link = failure_node.outputs.empty() ? failure_node.output_link : nodes[child].failure;
+			queue.push_back(child);
+		}
+	}
+}
+
+bool PatternSet::matches_general(const std::string_view name) const {
+	std::uint32_t state = 0;
+	for (const char c : name) {
+		const auto byte = static_cast<unsigned char>(c);
+		while (state != 0 && nodes[state].child(byte) == 0) state = nodes[state].failure;
+		state = nodes[state].child(byte);
+
+		// every literal ending here is a candidate
+		for (std::uint32_t node = nodes[state].outputs.empty() ? nodes[state].output_link : state;
+			node != 0;
+			node = nodes[node].output_link) {
+			for (const std::uint32_t index : nodes[node].outputs) {
+				if (patterns[index].matches(name)) return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool PatternSet::matches_any(const std::string_view name) const {
+	if (matches_anything) return true;
+	if (!exact_names.empty() && exact_names.contains(name)) return true;
+	if (prefixes.contains_prefix_of(name) || suffixes.contains_suffix_of(name)) return true;
+	for (const std::string &literal : contained_literals) {
+		if (name.find(literal) != std::string_view::npos) return true;
+	}
+	return nodes.size() > 1 && matches_general(name);
+}
@@ -0,0 +1,82 @@
+#ifndef DIRSYNC_PATTERN_SET_HPP
+#define DIRSYNC_PATTERN_SET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "wildcards.hpp"
+
+/** An immutable set of wildcard patterns, matched against a name together.
+ * The patterns are classified by their `WildcardShape`: exact names are looked up in a hash set,
+ * prefixes and suffixes in hash sets bucketed by their lengths, and "contains" patterns
+ * are searched for with `std::string_view::find` (which uses `memchr`/`memcmp`).
+ * Only general patterns go through the Aho-Corasick automaton: the longest literal of every such
+ * pattern is put into the automaton, scanning the name yields the patterns whose literal occurs in it,
+ * and only these candidates are verified by their `CompiledWildcard`.
+ * The matching cost depends on the name and the candidates, not on the number of patterns. */
+class PatternSet {
+	struct StringHash {
+		using is_transparent = void;
+		std::size_t operator()(const std::string_view text) const { return std::hash<std::string_view>{}(text); }
+	};
+	using StringSet = std::unordered_set<std::string, StringHash, std::equal_to<>>;
+
+	/** Literals of a single length class (prefixes or suffixes) with the distinct lengths, ascending. */
+	struct AffixTable {
+		StringSet literals;
+		std::vector<std::size_t> lengths;
+
+		void insert(std::string_view literal);
+		bool contains_prefix_of(std::string_view name) const;
+		bool contains_suffix_of(std::string_view name) const;
+	};
+
+	struct Node {
+		/** Transitions of the trie, usually only a few per node. */
+		std::vector<std::pair<unsigned char, std::uint32_t>> children;
+		/** The node of the longest proper suffix of this node's string which is in the trie. */
+		std::uint32_t failure = 0;
+		/** The nearest node on the failure chain with outputs, zero if there is none. */
+		std::uint32_t output_link = 0;
+		/** Patterns whose literal ends at this node. */
+		std::vector<std::uint32_t> outputs;
+
+		std::uint32_t child(unsigned char byte) const;
+	};
+
+	std::vector<CompiledWildcard> patterns;
+
+	bool matches_anything = false;
+	StringSet exact_names;
+	AffixTable prefixes;
+	AffixTable suffixes;
+	std::vector<std::string> contained_literals;
+
+	/** The trie of the general patterns with the root at index zero. */
+	std::vector<Node> nodes{1};
+
+	void insert(std::uint32_t pattern_index);
+	void insert_general(std::uint32_t pattern_index);
+	void link_failures();
+	bool matches_general(std::string_view name) const;
+
+	public:
+	PatternSet() = default;
+
+	/** A set with the patterns of the base set and the added ones. */
+	PatternSet(const PatternSet &base, std::span<const CompiledWildcard> added);
+
+	bool empty() const { return patterns.empty(); }
+
+	/** Returns true if the name matches any of the patterns. */
+	bool matches_any(std::string_view name) const;
+};
+
+#endif //DIRSYNC_PATTERN_SET_HPP
@@ -0,0 +1,106 @@
+#include "pipeline.hpp"
+
+#include <exception>
+#include <utility>
+
+#include "directory_listing.hpp"
+#include "file_operation.hpp"
+
+// number of queued items per thread of the consuming stage
+constexpr std::size_t SCAN_QUEUE_CAPACITY_PER_THREAD = 4;
+constexpr std::size_t OPERATION_QUEUE_CAPACITY_PER_THREAD = 256;
+
+SynchronizationPipeline::SynchronizationPipeline(
+	const std::size_t scanner_count,
+	const std::size_t executor_count,
+	const bool query_target_metadata,
+	CopyEngine &copy_engine
+) :
+	query_target_metadata(query_target_metadata),
+	copy_engine(copy_engine),
+	scan_requests(scanner_count * SCAN_QUEUE_CAPACITY_PER_THREAD),
+	operations(executor_count * OPERATION_QUEUE_CAPACITY_PER_THREAD),
+	prefetch_limit(scanner_count * SCAN_QUEUE_CAPACITY_PER_THREAD * 2) {
+	for (std::size_t i = 0; i < scanner_count; i++)
+		scanners.emplace_back(&SynchronizationPipeline::scanner_loop, this);
+	for (std::size_t i = 0; i < executor_count; i++)
+		executors.emplace_back(&SynchronizationPipeline::executor_loop, this);
+}
+
+void SynchronizationPipeline::prefetch(const fs::path &source_directory, const fs::path &target_directory) {
+	if (prefetched.size() >= prefetch_limit || prefetched.contains(source_directory)) return;
+
+	ScanRequest request{source_directory, target_directory, {}};
+	std::future<DirectoryPairListing> listing = request.listing.get_future();
+	if (!scan_requests.try_push(std::move(request))) return;
+
+	prefetched.emplace(source_directory, std::move(listing));
+}
+
+DirectoryPairListing SynchronizationPipeline::take_listing(
+	const fs::path &source_directory,
+	const fs::path &target_directory
+) {
+	const auto iterator = prefetched.find(source_directory);
+	if (iterator == prefetched.end())
+		return list_directory_pair(source_directory, target_directory, query_target_metadata);
+
+	std::future<DirectoryPairListing> listing = std::move(iterator->second);
+	prefetched.erase(iterator);
+	return listing.get(); // rethrows a scanner exception
+}
+
+void SynchronizationPipeline::discard_listing(const fs::path &source_directory) {
+	prefetched.erase(source_directory);
+}
+
+int SynchronizationPipeline::execute(FileOperation operation) {
+	operations.push({next_sequence++, std::move(operation)});
+	return get_first_error();
+}
+
+int SynchronizationPipeline::finish() {
+	if (finished) return get_first_error();
+	finished = true;
+
+	scan_requests.close();
+	operations.close();
+	for (std::thread &scanner : scanners) scanner.join();
+	for (std::thread &executor : executors) executor.join();
+	prefetched.clear();
+
+	return get_first_error();
+}
+
+int SynchronizationPipeline::get_first_error() {
+	std::lock_guard lock(error_mutex);
+	return first_error;
+}
+
+void SynchronizationPipeline::report_error(const std::uint64_t sequence, const int error) {
+	std::lock_guard lock(error_mutex);
+	if (first_error != 0 && first_error_sequence < sequence) return;
+	first_error = error;
+	first_error_sequence = sequence;
+}
+
+void SynchronizationPipeline::scanner_loop() {
+	while (std::optional<ScanRequest> request = scan_requests.pop()) {
+		try {
+			request->listing.set_value(list_directory_pair(
+				request->source_directory,
+				request->target_directory,
+				query_target_metadata
+			));
+		} catch (...) {
+			request->listing.set_exception(std::current_exception());
+		}
+	}
+}
+
+void SynchronizationPipeline::executor_loop() {
+	while (const std::optional<PlannedOperation> planned = operations.pop()) {
+		const int error = perform_file_operation(planned->operation, copy_engine);
+		if (error) report_error(planned->sequence, error);
+	}
+}
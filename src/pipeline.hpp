@@ -0,0 +1,102 @@
+#ifndef DIRSYNC_PIPELINE_HPP
+#define DIRSYNC_PIPELINE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "copy_engine.hpp"
+#include "directory_listing.hpp"
+#include "file_operation.hpp"
+
+namespace fs = std::filesystem;
+
+/** A three-stage scan / plan / execute pipeline for one-way synchronization.
+ * Scanner threads enumerate source and target directories ahead of the planner,
+ * the planner (the thread driving `MonodirectionalSynchronizer`) applies configurations
+ * and conflict rules, and executor threads perform the resulting copies and deletions.
+ * Both hand-overs are bounded queues, so memory usage does not grow with the tree size:
+ * when the scan queue is full, the planner enumerates the directory itself,
+ * when the operation queue is full, the planner waits for the executors. */
+class SynchronizationPipeline {
+	struct ScanRequest {
+		fs::path source_directory;
+		fs::path target_directory;
+		std::promise<DirectoryPairListing> listing;
+	};
+
+	/** An operation with its position in the plan, so errors are reported in the order of the serial run. */
+	struct PlannedOperation {
+		std::uint64_t sequence;
+		FileOperation operation;
+	};
+
+	const bool query_target_metadata;
+	CopyEngine &copy_engine;
+
+	BoundedQueue<ScanRequest> scan_requests;
+	BoundedQueue<PlannedOperation> operations;
+	// owned by the planner thread
+	std::uint64_t next_sequence = 0;
+
+	// owned by the planner thread: listings requested ahead, keyed by the source directory
+	std::map<fs::path, std::future<DirectoryPairListing>> prefetched;
+	const std::size_t prefetch_limit;
+
+	std::vector<std::thread> scanners;
+	std::vector<std::thread> executors;
+	/** The error of the earliest planned operation which failed, whichever executor finished first. */
+	std::mutex error_mutex;
+	int first_error = 0;
+	std::uint64_t first_error_sequence = 0;
+	bool finished = false;
+
+	public:
+	/** Starts the scanner and executor threads.
+	 * @param query_target_metadata whether the metadata of target entries is read as well
+	 * @param copy_engine the engine used by the executors */
+	SynchronizationPipeline(
+		std::size_t scanner_count,
+		std::size_t executor_count,
+		bool query_target_metadata,
+		CopyEngine &copy_engine
+	);
+	~SynchronizationPipeline() { finish(); }
+
+	SynchronizationPipeline(const SynchronizationPipeline &) = delete;
+	SynchronizationPipeline &operator=(const SynchronizationPipeline &) = delete;
+
+	/** Asks the scanners to enumerate the directory pair in advance.
+	 * The request is dropped silently when the scan queue or prefetch limit is full. */
+	void prefetch(const fs::path &source_directory, const fs::path &target_directory);
+
+	/** Returns the prefetched listing, waiting for the scanner if needed.
+	 * Directories not prefetched are enumerated on the calling thread.
+	 * @throws fs::filesystem_error if the source directory cannot be iterated */
+	DirectoryPairListing take_listing(const fs::path &source_directory, const fs::path &target_directory);
+
+	/** Drops the listing prefetched for a directory which does not need to be enumerated after all. */
+	void discard_listing(const fs::path &source_directory);
+
+	/** Hands the operation over to the executors, blocking while the queue is full.
+	 * @return the error of the earliest planned operation which failed so far, otherwise zero */
+	int execute(FileOperation operation);
+
+	/** Waits for all enqueued operations to finish and stops the threads.
+	 * @return the error of the earliest planned operation which failed, otherwise zero */
+	int finish();
+
+	private:
+	int get_first_error();
+	void report_error(std::uint64_t sequence, int error);
+
+	void scanner_loop();
+	void executor_loop();
+};
+
+#endif //DIRSYNC_PIPELINE_HPP
@@ -0,0 +1,56 @@
+#include "statistics.hpp"
+
+#include <algorithm>
+#include <ostream>
+
+#include "checksum.hpp"
+#include "copy_engine.hpp"
+
+void RunStatistics::print(std::ostream &stream) const {
+	std::uintmax_t files_copied = 0;
+	for (const auto &count : files_by_copy_method) files_copied += count.load();
+
+	stream << "Copied " << files_copied << " files (" << bytes_copied.load() << " bytes)";
+	const char *separator = ": ";
+	for (std::size_t i = 0; i < COPY_METHOD_COUNT; i++) {
+		const std::uintmax_t count = files_by_copy_method[i].load();
+		if (count == 0) continue;
+
+		stream << separator << copy_method_name(static_cast<CopyMethod>(i)) << " " << count;
+		separator = ", ";
+	}
+	stream << std::endl;
+
+	if (const std::uintmax_t unchanged = manifest_unchanged_files.load(); unchanged > 0)
+		stream << "Manifest: " << unchanged << " unchanged files skipped" << std::endl;
+	if (const std::uintmax_t pruned = pruned_directories.load(); pruned > 0)
+		stream << "Pruning: " << pruned << " unchanged directories skipped" << std::endl;
+
+	const std::uintmax_t state_unchanged = state_unchanged_entries.load();
+	const std::uintmax_t deletions = state_deletions.load();
+	const std::uintmax_t conflicts = state_conflicts.load();
+	if (state_unchanged > 0 || deletions > 0 || conflicts > 0) {
+		stream << "State: " << state_unchanged << " unchanged files skipped, " << deletions << " deletions propagated, "
+			<< conflicts << " conflicts" << std::endl;
+	}
+
+	if (const std::uintmax_t comparisons = checksum_comparisons.load(); comparisons > 0) {
+		// per thread with parallel jobs, the times are summed
+		const std::uintmax_t bytes = checksum_bytes.load();
+		const std::uintmax_t nanoseconds = std::max<std::uintmax_t>(checksum_nanoseconds.load(), 1);
+		const auto tenths_of_mebibytes_per_second = static_cast<std::uintmax_t>(
+			static_cast<double>(bytes) / static_cast<double>(1 << 20) * 1e10 / static_cast<double>(nanoseconds)
+		);
+		stream << "Checksums: " << comparisons << " file pairs compared, " << bytes << " bytes hashed at "
+			<< tenths_of_mebibytes_per_second / 10 << "." << tenths_of_mebibytes_per_second % 10 << " MiB/s ("
+			<< ContentHasher::implementation_name() << ")" << std::endl;
+	}
+
+	if (const std::uintmax_t holes = hole_bytes.load(); holes > 0)
+		stream << "Sparse files: " << holes << " bytes of holes skipped" << std::endl;
+
+	if (files_by_copy_method[static_cast<std::size_t>(CopyMethod::delta)].load() > 0) {
+		stream << "Delta transfer: " << delta_matched_bytes.load() << " bytes reused, "
+			<< delta_literal_bytes.load() << " literal bytes written" << std::endl;
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef DIRSYNC_STATISTICS_HPP
+#define DIRSYNC_STATISTICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#include "copy_engine.hpp"
+#include "delta.hpp"
+
+/** Counters describing the work done by one dirsync invocation.
+ * All members are atomic, the instance is shared by parallel tasks and pipeline threads. */
+struct RunStatistics {
+	std::array<std::atomic<std::uintmax_t>, COPY_METHOD_COUNT> files_by_copy_method{};
+	std::atomic<std::uintmax_t> bytes_copied = 0;
+	std::atomic<std::uintmax_t> hole_bytes = 0;
+	std::atomic<std::uintmax_t> manifest_unchanged_files = 0;
+	std::atomic<std::uintmax_t> pruned_directories = 0;
+	std::atomic<std::uintmax_t> delta_matched_bytes = 0;
+	std::atomic<std::uintmax_t> delta_literal_bytes = 0;
+	std::atomic<std::uintmax_t> state_unchanged_entries = 0;
+	std::atomic<std::uintmax_t> state_deletions = 0;
+	std::atomic<std::uintmax_t> state_conflicts = 0;
+	std::atomic<std::uintmax_t> checksum_comparisons = 0;
+	std::atomic<std::uintmax_t> checksum_bytes = 0;
+	/** The time spent reading and hashing, summed over all threads. */
+	std::atomic<std::uintmax_t> checksum_nanoseconds = 0;
+
+	void record_copy(const CopyResult &result) {
+		files_by_copy_method[static_cast<std::size_t>(result.method)].fetch_add(1, std::memory_order_relaxed);
+		bytes_copied.fetch_add(result.bytes, std::memory_order_relaxed);
+		hole_bytes.fetch_add(result.hole_bytes, std::memory_order_relaxed);
+	}
+
+	void record_delta(const DeltaResult &result) {
+		delta_matched_bytes.fetch_add(result.matched_bytes, std::memory_order_relaxed);
+		delta_literal_bytes.fetch_add(result.literal_bytes, std::memory_order_relaxed);
+	}
+
+	void record_checksum(const std::uintmax_t bytes, const std::chrono::steady_clock::duration duration) {
+		checksum_comparisons.fetch_add(1, std::memory_order_relaxed);
+		checksum_bytes.fetch_add(bytes, std::memory_order_relaxed);
+		checksum_nanoseconds.fetch_add(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), std::memory_order_relaxed
+		);
+	}
+
+	/** Writes a human-readable summary, used at the end of a verbose run. */
+	void print(std::ostream &stream) const;
+};
+
+#endif //DIRSYNC_STATISTICS_HPP
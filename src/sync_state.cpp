@@ -0,0 +1,293 @@
+#include "sync_state.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <compare>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	constexpr char STATE_MAGIC[8] = {'D', 'I', 'R', 'S', 'Y', 'N', 'C', 'S'};
+	constexpr std::uint32_t STATE_VERSION = 1;
+
+	struct StateHeader {
+		char magic[8];
+		std::uint32_t version;
+		/** Guards against a different record layout (or byte order, together with the version). */
+		std::uint32_t record_size;
+		std::uint64_t record_count;
+		std::uint64_t paths_size;
+	};
+
+	static_assert(std::is_trivially_copyable_v<StateHeader>);
+	static_assert(std::is_trivially_copyable_v<StateRecord>);
+	static_assert(sizeof(StateHeader) % alignof(StateRecord) == 0);
+
+	bool is_valid_state(const std::byte *data, const std::size_t size, StateHeader &header) {
+		if (size < sizeof(StateHeader)) return false;
+		std::memcpy(&header, data, sizeof(StateHeader));
+
+		if (std::memcmp(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC)) != 0) return false;
+		if (header.version != STATE_VERSION || header.record_size != sizeof(StateRecord)) return false;
+
+		const std::uint64_t available = size - sizeof(StateHeader);
+		if (header.record_count > available / sizeof(StateRecord)) return false;
+		return header.paths_size == available - header.record_count * sizeof(StateRecord);
+	}
+
+	/** The root path independent of the working directory, as a part of the state file name. */
+	std::string absolute_root(const fs::path &root) {
+		std::error_code error;
+		const fs::path absolute = fs::absolute(root, error);
+		if (error) return root.generic_string();
+		std::string normal = absolute.lexically_normal().generic_string();
+		if (normal.size() > 1 && normal.ends_with('/')) normal.pop_back();
+		return normal;
+	}
+
+	/** 64-bit FNV-1a. */
+	std::uint64_t hash_of(const std::string_view bytes, std::uint64_t hash = 0xcbf29ce484222325) {
+		for (const char c : bytes) {
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 0x100000001b3;
+		}
+		return hash;
+	}
+
+	bool is_within_scope(const std::string_view path, const std::string_view scope) {
+		if (scope.empty() || path == scope) return true;
+		if (!path.starts_with(scope)) return false;
+		return scope.ends_with('/') || path[scope.size()] == '/';
+	}
+
+	fs::file_time_type from_nanoseconds(const std::int64_t nanoseconds) {
+		using namespace std::chrono;
+		return fs::file_time_type(duration_cast<fs::file_time_type::duration>(std::chrono::nanoseconds(nanoseconds)));
+	}
+}
+
+SynchronizationState::SynchronizationState(fs::path file_path, fs::path left_root, fs::path right_root)
+	: file_path(std::move(file_path)), left_root(std::move(left_root)), right_root(std::move(right_root)) {
+	const std::byte *data = nullptr;
+	std::size_t size = 0;
+
+#if defined(__unix__) || defined(__APPLE__)
+	const UniqueDescriptor fd(::open(this->file_path.c_str(), O_RDONLY | O_CLOEXEC));
+	struct stat status {};
+	if (!fd.valid() || ::fstat(fd.get(), &status) < 0 || !S_ISREG(status.st_mode)) return;
+	if (mapping.map(fd.get(), static_cast<std::size_t>(status.st_size))) return;
+	data = mapping.data();
+	size = mapping.size();
+#else
+	std::ifstream file(this->file_path, std::ios::binary);
+	if (!file) return;
+	std::vector<char> content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+	buffer.resize(content.size());
+	std::memcpy(buffer.data(), content.data(), content.size());
+	data = buffer.data();
+	size = buffer.size();
+#endif
+
+	StateHeader header {};
+	if (!is_valid_state(data, size, header)) return;
+
+	records = reinterpret_cast<const StateRecord *>(data + sizeof(StateHeader));
+	record_count = header.record_count;
+	paths = std::string_view(reinterpret_cast<const char *>(records + record_count), header.paths_size);
+}
+
+std::optional<fs::path> SynchronizationState::default_path(const fs::path &left_root, const fs::path &right_root) {
+	fs::path directory;
+	if (const char *cache_home = std::getenv("XDG_CACHE_HOME"); cache_home != nullptr && *cache_home != '\0')
+		directory = fs::path(cache_home) / "dirsync" / "state";
+	else if (const char *home = std::getenv("HOME"); home != nullptr && *home != '\0')
+		directory = fs::path(home) / ".cache" / "dirsync" / "state";
+	else
+		return std::nullopt;
+
+	// the terminating zero separates the roots, so no other pair of paths joins into the same bytes
+	std::uint64_t hash = hash_of(absolute_root(left_root));
+	hash = hash_of(std::string_view("", 1), hash);
+	hash = hash_of(absolute_root(right_root), hash);
+
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+	return directory / name;
+}
+
+std::string_view SynchronizationState::path_of(const StateRecord &record) const {
+	// a damaged record cannot point outside of the string table
+	if (record.path_offset > paths.size() || record.path_length > paths.size() - record.path_offset) return {};
+	return paths.substr(record.path_offset, record.path_length);
+}
+
+const StateRecord *SynchronizationState::find(const std::string_view relative_path) const {
+	const StateRecord *end = records + record_count;
+	const StateRecord *found = std::lower_bound(
+		records,
+		end,
+		relative_path,
+		[this](const StateRecord &record, const std::string_view path) { return path_of(record) < path; }
+	);
+
+	if (found == end || path_of(*found) != relative_path) return nullptr;
+	return found;
+}
+
+bool SynchronizationState::is_unchanged(
+	const StateRecord &record,
+	const FileMetadata &metadata,
+	const bool left,
+	const fs::file_time_type::duration tolerance
+) {
+	if (metadata.is_directory()) return record.type == StateEntryType::directory;
+	if (!metadata.is_regular_file() || record.type != StateEntryType::file) return false;
+	if (metadata.size != record.size) return false;
+
+	const std::int64_t recorded = left ? record.left_modified : record.right_modified;
+	return compare_modification_times(metadata.modified, from_nanoseconds(recorded), tolerance)
+		== std::weak_ordering::equivalent;
+}
+
+void SynchronizationState::keep(std::string relative_path, const StateRecord &record) {
+	std::lock_guard lock(pending_mutex);
+	pending.push_back({std::move(relative_path), record, false});
+}
+
+void SynchronizationState::keep_subtree(const std::string &relative_path) {
+	const std::string prefix = relative_path + '/';
+	const StateRecord *end = records + record_count;
+	// the records of the subtree follow each other, sorted after the prefix
+	const StateRecord *child = std::lower_bound(
+		records,
+		end,
+		std::string_view(prefix),
+		[this](const StateRecord &record, const std::string_view path) { return path_of(record) < path; }
+	);
+
+	std::lock_guard lock(pending_mutex);
+	if (const StateRecord *record = find(relative_path)) pending.push_back({relative_path, *record, false});
+	for (; child != end && path_of(*child).starts_with(prefix); ++child)
+		pending.push_back({std::string(path_of(*child)), *child, false});
+}
+
+void SynchronizationState::record(std::string relative_path, const FileMetadata &left, const FileMetadata &right) {
+	StateRecord record {};
+	record.type = left.is_directory() ? StateEntryType::directory : StateEntryType::file;
+	if (!left.is_directory()) {
+		record.size = left.size;
+		record.left_modified = to_nanoseconds(left.modified);
+		record.right_modified = to_nanoseconds(right.modified);
+	}
+
+	std::lock_guard lock(pending_mutex);
+	pending.push_back({std::move(relative_path), record, false});
+}
+
+void SynchronizationState::record_written(std::string relative_path) {
+	std::lock_guard lock(pending_mutex);
+	pending.push_back({std::move(relative_path), StateRecord {}, true});
+}
+
+std::error_code SynchronizationState::save_partial(const std::vector<std::string> &scopes) {
+	{
+		std::lock_guard lock(pending_mutex);
+		for (const StateRecord &record : std::span(records, record_count)) {
+			const std::string_view path = path_of(record);
+			const bool synchronized = std::ranges::any_of(
+				scopes,
+				[path](const std::string &scope) { return is_within_scope(path, scope); }
+			);
+			if (!path.empty() && !synchronized) pending.push_back({std::string(path), record, false});
+		}
+	}
+	return save();
+}
+
+std::error_code SynchronizationState::save() {
+	std::lock_guard lock(pending_mutex);
+
+	std::ranges::sort(pending, {}, &PendingRecord::path);
+	const auto duplicates = std::ranges::unique(pending, {}, &PendingRecord::path);
+	pending.erase(duplicates.begin(), duplicates.end());
+
+	std::vector<StateRecord> sorted_records;
+	sorted_records.reserve(pending.size());
+	std::string sorted_paths;
+
+	for (PendingRecord &pending_record : pending) {
+		StateRecord &record = pending_record.record;
+		if (pending_record.read_metadata) {
+			FileMetadata left, right;
+			if (read_file_metadata(left_root / pending_record.path, left)) continue;
+			if (read_file_metadata(right_root / pending_record.path, right)) continue;
+
+			if (left.is_directory() && right.is_directory()) {
+				record.type = StateEntryType::directory;
+			} else if (left.is_regular_file() && right.is_regular_file() && left.size == right.size) {
+				record.type = StateEntryType::file;
+				record.size = left.size;
+				record.left_modified = to_nanoseconds(left.modified);
+				record.right_modified = to_nanoseconds(right.modified);
+			} else {
+				continue;
+			}
+		}
+
+		record.path_offset = sorted_paths.size();
+		record.path_length = static_cast<std::uint32_t>(pending_record.path.size());
+		sorted_paths += pending_record.path;
+		sorted_records.push_back(record);
+	}
+	pending.clear();
+
+	StateHeader header {};
+	std::memcpy(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+	header.version = STATE_VERSION;
+	header.record_size = sizeof(StateRecord);
+	header.record_count = sorted_records.size();
+	header.paths_size = sorted_paths.size();
+
+	std::error_code error;
+	if (file_path.has_parent_path()) {
+		fs::create_directories(file_path.parent_path(), error);
+		if (error) return error;
+	}
+
+	// the previous state may still be mapped, it is replaced by renaming a complete new file
+	fs::path temporary_path = file_path;
+	temporary_path += ".tmp";
+#if defined(__unix__) || defined(__APPLE__)
+	temporary_path += std::to_string(::getpid());
+#endif
+	{
+		std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(
+			reinterpret_cast<const char *>(sorted_records.data()),
+			static_cast<std::streamsize>(sorted_records.size() * sizeof(StateRecord))
+		);
+		file.write(sorted_paths.data(), static_cast<std::streamsize>(sorted_paths.size()));
+		file.close();
+		if (!file) {
+			fs::remove(temporary_path, error);
+			return std::make_error_code(std::errc::io_error);
+		}
+	}
+
+	fs::rename(temporary_path, file_path, error);
+	return error;
+}
@@ -0,0 +1,122 @@
+#ifndef DIRSYNC_SYNC_STATE_HPP
+#define DIRSYNC_SYNC_STATE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include "file_descriptor.hpp"
+#endif
+
+#include "file_metadata.hpp"
+
+namespace fs = std::filesystem;
+
+/** The type of a synchronized entry, as stored in a `StateRecord`. */
+enum class StateEntryType : std::uint32_t {
+	file = 0,
+	directory = 1,
+};
+
+/** A fixed-size state record, as stored in the file. Records are sorted by their paths,
+ * which are stored in a string table following the records. */
+struct StateRecord {
+	std::uint64_t path_offset;
+	std::uint32_t path_length;
+	StateEntryType type;
+	/** The size both copies of a file had after the last synchronization. */
+	std::uint64_t size;
+	/** The last write times of the left and the right copy after the last synchronization,
+	 * nanoseconds since the file clock epoch, see `to_nanoseconds`. Unused for directories. */
+	std::int64_t left_modified;
+	std::int64_t right_modified;
+};
+
+/** The state of a two-way synchronized directory pair (`--state`): every entry which existed on both sides
+ * after the last run, by its path relative to the left root. Comparing each side with the record tells
+ * which side changed since, so deletions are told apart from creations and concurrent edits from one-sided ones.
+ * The state of the previous run is memory-mapped and searched by binary search, the records of the current
+ * run are collected and written at its end. Shared by parallel tasks, the methods are thread-safe.
+ *
+ * File layout (native byte order): header, sorted `StateRecord`s, string table of paths. */
+class SynchronizationState {
+	const fs::path file_path;
+	const fs::path left_root;
+	const fs::path right_root;
+
+	// the state of the previous run; an invalid or missing file is treated as empty
+#if defined(__unix__) || defined(__APPLE__)
+	MappedFile mapping;
+#else
+	std::vector<std::byte> buffer;
+#endif
+	const StateRecord *records = nullptr;
+	std::size_t record_count = 0;
+	std::string_view paths;
+
+	struct PendingRecord {
+		std::string path;
+		StateRecord record;
+		/** Whether an entry was written in this run, so the metadata of both copies is read upon saving. */
+		bool read_metadata;
+	};
+
+	std::mutex pending_mutex;
+	std::vector<PendingRecord> pending;
+
+	std::string_view path_of(const StateRecord &record) const;
+
+	public:
+	/** Loads the state of the previous run of the directory pair, if any. */
+	SynchronizationState(fs::path file_path, fs::path left_root, fs::path right_root);
+
+	/** The per-user state file of the directory pair, named by a hash of both absolute roots,
+	 * in `$XDG_CACHE_HOME/dirsync/state` or `~/.cache/dirsync/state`. */
+	static std::optional<fs::path> default_path(const fs::path &left_root, const fs::path &right_root);
+
+	/** Finds the record of the previous run.
+	 * @param relative_path the path relative to the left root, in the generic format
+	 * @return the record or null */
+	const StateRecord *find(std::string_view relative_path) const;
+
+	/** Whether the copy of an entry on one side is the one recorded, i.e. it did not change since the last run.
+	 * @param tolerance the timestamp granularity, see `compare_modification_times` */
+	static bool is_unchanged(
+		const StateRecord &record,
+		const FileMetadata &metadata,
+		bool left,
+		fs::file_time_type::duration tolerance
+	);
+
+	/** Carries the record of an entry unchanged on both sides over to the state of this run. */
+	void keep(std::string relative_path, const StateRecord &record);
+
+	/** Carries the records of an entry which was not synchronized in this run (e.g. excluded on one side)
+	 * and of its whole subtree over to the state of this run. */
+	void keep_subtree(const std::string &relative_path);
+
+	/** Records an entry which is equal on both sides, with the already known metadata of both copies. */
+	void record(std::string relative_path, const FileMetadata &left, const FileMetadata &right);
+
+	/** Records an entry which is (being) written to one side. Both copies are queried upon saving,
+	 * the entry is left out unless they have the same type (and size). */
+	void record_written(std::string relative_path);
+
+	/** Writes the state of this run, replacing the previous one. */
+	std::error_code save();
+
+	/** Writes the state of a run which synchronized only some entries (`--watch`): the previous records
+	 * outside of the synchronized scopes are carried over.
+	 * @param scopes relative paths of the synchronized entries, including their subtrees.
+	 * A scope ending with a slash covers the contents of the directory, an empty one everything. */
+	std::error_code save_partial(const std::vector<std::string> &scopes);
+};
+
+#endif //DIRSYNC_SYNC_STATE_HPP
@@ -1,14 +1,21 @@
 #include "synchronize.hpp"
 #include "constants.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <format>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <utility>
 
+#include "file_metadata.hpp"
 #include "synchronize_one_way.hpp"
 #include "synchronize_two_way.hpp"
+#include "pipeline.hpp"
+#include "task_pool.hpp"
 #include "configuration/configuration.hpp"
 
 namespace fs = std::filesystem;
@@ -75,10 +82,56 @@ int ensure_target_directory(const fs::path &path, fs::directory_entry &directory
 /** Creates a new string by appending a dash and a formatted last write time, keeping the file extension (if any).
  * @param entry file or directory whose name and last write time is used to compose the new filename */
 std::string insert_timestamp_to_filename(const fs::directory_entry &entry) {
-	return entry.path().stem().string()
+	return insert_timestamp_to_filename(entry.path(), entry.last_write_time());
+}
+
+/** Creates a new string by appending a dash and the formatted last write time, keeping the file extension (if any).
+ * @param path file or directory whose name is used to compose the new filename
+ * @param last_write_time the already known last write time of the file */
+std::string insert_timestamp_to_filename(const fs::path &path, const fs::file_time_type &last_write_time) {
+	return path.stem().string()
 		+ "-"
-		+ get_formatted_time(entry.last_write_time())
-		+ entry.path().extension().string();
+		+ get_formatted_time(last_write_time)
+		+ path.extension().string();
+}
+
+/** Formats a timestamp granularity in the largest unit which keeps it whole, e.g. `100 ns` or `2 s`. */
+std::string format_granularity(const fs::file_time_type::duration granularity) {
+	using namespace std::chrono;
+	const auto nanoseconds_count = duration_cast<nanoseconds>(granularity).count();
+	constexpr std::pair<std::int64_t, const char *> units[] = {
+		{1'000'000'000, "s"}, {1'000'000, "ms"}, {1'000, "us"}, {1, "ns"}
+	};
+	for (const auto &[size, name] : units) {
+		if (nanoseconds_count % size == 0) return std::to_string(nanoseconds_count / size) + " " + name;
+	}
+	return std::to_string(nanoseconds_count) + " ns";
+}
+
+/** Probes the timestamp granularity of the roots, the coarser one becomes the tolerance of time comparisons.
+ * The roots are probed by writing a file, except in a dry run. In one-way mode, only the target is probed:
+ * the copies keep the source times as precisely as the target stores them, and the source times may be
+ * coarser than its filesystem (e.g. extracted from an archive), which would widen the tolerance for nothing. */
+void probe_timestamp_tolerance(const ProgramArguments &arguments, SynchronizationSession &session) {
+	const bool may_write = !arguments.is_dry_run();
+	const fs::file_time_type::duration target_granularity =
+		probe_timestamp_granularity(arguments.get_target_path(), may_write);
+	session.timestamp_tolerance = target_granularity;
+
+	if (arguments.is_one_way()) {
+		if (arguments.is_verbose())
+			std::cout << "Timestamp granularity: target " << format_granularity(target_granularity) << std::endl;
+		return;
+	}
+
+	const fs::file_time_type::duration source_granularity =
+		probe_timestamp_granularity(arguments.get_source_path(), may_write);
+	session.timestamp_tolerance = std::max(source_granularity, target_granularity);
+
+	if (arguments.is_verbose()) {
+		std::cout << "Timestamp granularity: source " << format_granularity(source_granularity)
+			<< ", target " << format_granularity(target_granularity) << std::endl;
+	}
 }
 
 /** Given the program CLI arguments, delegates the work to one-way-specific or two-way-specific
@@ -87,22 +140,67 @@ std::string insert_timestamp_to_filename(const fs::directory_entry &entry) {
  * @param arguments the processed CLI arguments, dictating synchronization details
  * @return An error code. If none occurs, defaults to zero. */
 int synchronize_directories(const ProgramArguments &arguments) {
+	SynchronizationSession session(arguments);
+	return synchronize_directories(arguments, session);
+}
+
+/** Writes the run-wide caches of the session and prints the statistics of a verbose run. */
+void finish_session(const ProgramArguments &arguments, SynchronizationSession &session) {
+	// the cache does not describe the synchronized directories, a failure only costs the next run a parse
+	if (session.configuration_cache != nullptr) {
+		if (const std::error_code cache_error = session.configuration_cache->save())
+			std::cerr << "Warning: Failed to write the configuration cache. " << cache_error.message() << std::endl;
+	}
+
+	if (arguments.is_verbose())
+		session.statistics.print(std::cout);
+}
+
+int synchronize_directories(const ProgramArguments &arguments, SynchronizationSession &session) {
 	const fs::path source_path = arguments.get_source_path();
 	const fs::path target_path = arguments.get_target_path();
 
 	fs::directory_entry source_directory, target_directory;
 	fs::file_status source_status, target_status;
 
+	// the calling thread also executes tasks while waiting for them
+	std::optional<TaskPool> pool;
+	if (arguments.is_parallel() && !arguments.is_pipelined()) pool.emplace(arguments.get_job_count() - 1);
+	TaskPool *task_pool = pool.has_value() ? &*pool : nullptr;
+
 	int error = 0;
 	if (arguments.is_one_way()) {
 		error = verify_source_directory(source_path, source_directory, source_status);
 		if (error) return error;
 		error = ensure_target_directory(target_path, target_directory, target_status);
 		if (error) return error;
+		probe_timestamp_tolerance(arguments, session);
 
-		MonodirectionalContext context(arguments);
-		MonodirectionalSynchronizer synchronizer(context);
-		error = synchronizer.synchronize();
+		MonodirectionalContext context(arguments, session);
+		if (arguments.is_pipelined()) {
+			// the calling thread is the planning stage
+			SynchronizationPipeline pipeline(
+				arguments.get_job_count(),
+				arguments.get_job_count(),
+				session.manifest == nullptr,
+				*session.copy_engine
+			);
+			MonodirectionalSynchronizer synchronizer(context, nullptr, &pipeline);
+			error = synchronizer.synchronize();
+			const int pipeline_error = pipeline.finish();
+			if (!error) error = pipeline_error;
+		} else {
+			MonodirectionalSynchronizer synchronizer(context, task_pool);
+			error = synchronizer.synchronize();
+		}
+
+		// after a failure, the previous manifest is kept, it only describes files which were not touched since
+		if (!error && session.manifest != nullptr && !arguments.is_dry_run()) {
+			if (const std::error_code manifest_error = session.manifest->save()) {
+				std::cerr << "Error: Failed to write the target manifest. " << manifest_error.message() << std::endl;
+				error = EXIT_CODE_FILESYSTEM_ERROR;
+			}
+		}
 	} else {
 		// we do not have the source and target directories, we have two source ones
 
@@ -110,12 +208,81 @@ int synchronize_directories(const ProgramArguments &arguments) {
 		if (error) return error;
 		error = verify_source_directory(target_path, target_directory, target_status);
 		if (error) return error;
+		probe_timestamp_tolerance(arguments, session);
 
-		BidirectionalContext context(arguments);
-		BidirectionalSynchronizer synchronizer(context);
+		BidirectionalContext context(arguments, session);
+		BidirectionalSynchronizer synchronizer(context, task_pool);
 		error = synchronizer.synchronize();
+
+		// after a failure, the previous state is kept; entries synchronized since only look changed on both sides
+		if (!error && session.state != nullptr && !arguments.is_dry_run()) {
+			if (const std::error_code state_error = session.state->save()) {
+				std::cerr << "Error: Failed to write the synchronization state. " << state_error.message() << std::endl;
+				error = EXIT_CODE_FILESYSTEM_ERROR;
+			}
+		}
+	}
+
+	finish_session(arguments, session);
+	return error;
+}
+
+int synchronize_changes(
+	const ProgramArguments &arguments,
+	SynchronizationSession &session,
+	const std::vector<ChangedDirectory> &directories
+) {
+	std::optional<TaskPool> pool;
+	if (arguments.is_parallel()) pool.emplace(arguments.get_job_count() - 1);
+	TaskPool *task_pool = pool.has_value() ? &*pool : nullptr;
+
+	int error = 0;
+	try {
+		for (const ChangedDirectory &directory : directories) {
+			if (arguments.is_one_way()) {
+				MonodirectionalContext context(arguments, session);
+				MonodirectionalSynchronizer synchronizer(context, task_pool);
+				error = synchronizer.synchronize_changes(directory);
+			} else {
+				BidirectionalContext context(arguments, session);
+				BidirectionalSynchronizer synchronizer(context, task_pool);
+				error = synchronizer.synchronize_changes(directory);
+			}
+			if (error) break;
+		}
+	} catch (const fs::filesystem_error &exception) {
+		// e.g. a directory removed again while it was being synchronized
+		std::cerr << "Error: " << exception.what() << std::endl;
+		error = EXIT_CODE_FILESYSTEM_ERROR;
+	}
+
+	// only the records of the synchronized entries are replaced, the others are carried over
+	if (!error && (session.state != nullptr || session.manifest != nullptr) && !arguments.is_dry_run()) {
+		std::vector<std::string> scopes;
+		for (const ChangedDirectory &directory : directories) {
+			const std::string prefix = directory.relative_path.empty() ? "" : directory.relative_path + '/';
+			if (directory.all_entries) {
+				scopes.push_back(prefix);
+				continue;
+			}
+			for (const std::string &name : directory.names) scopes.push_back(prefix + name);
+		}
+
+		if (session.state != nullptr) {
+			if (const std::error_code state_error = session.state->save_partial(scopes)) {
+				std::cerr << "Error: Failed to write the synchronization state. " << state_error.message() << std::endl;
+				error = EXIT_CODE_FILESYSTEM_ERROR;
+			}
+		}
+		if (session.manifest != nullptr) {
+			if (const std::error_code manifest_error = session.manifest->save_partial(scopes)) {
+				std::cerr << "Error: Failed to write the target manifest. " << manifest_error.message() << std::endl;
+				error = EXIT_CODE_FILESYSTEM_ERROR;
+			}
+		}
 	}
 
+	finish_session(arguments, session);
 	return error;
 }
 
@@ -2,9 +2,22 @@
 #define DIRSYNC_SYNCHRONIZE_HPP
 
 #include <filesystem>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "arguments.hpp"
+#include "copy_engine.hpp"
+#include "directory_listing.hpp"
+#include "manifest.hpp"
+#include "statistics.hpp"
+#include "sync_state.hpp"
 #include "configuration/configuration.hpp"
+#include "configuration/configuration-cache.hpp"
 
 namespace fs = std::filesystem;
 using OptionalConfiguration = std::optional<DirectoryConfiguration>;
@@ -12,17 +25,89 @@ using OptionalConfiguration = std::optional<DirectoryConfiguration>;
 std::string get_formatted_time(const fs::file_time_type &time);
 std::chrono::file_time<std::chrono::seconds> reduce_precision_to_seconds(const fs::file_time_type &file_time);
 std::string insert_timestamp_to_filename(const fs::directory_entry &entry);
+std::string insert_timestamp_to_filename(const fs::path &path, const fs::file_time_type &last_write_time);
 
 int synchronize_directories(const ProgramArguments &arguments);
 
+/** Run-wide state of a single dirsync invocation. It is shared by every context,
+ * including context copies of parallel tasks and one-way contexts nested in two-way synchronization. */
+struct SynchronizationSession {
+	RunStatistics statistics;
+	std::unique_ptr<CopyEngine> copy_engine;
+	/** The target manifest, if enabled. */
+	std::unique_ptr<TargetManifest> manifest;
+	/** The cache of parsed directory configurations, if enabled. */
+	std::unique_ptr<ConfigurationCache> configuration_cache;
+	/** The state of the two-way synchronized directory pair, if enabled. */
+	std::unique_ptr<SynchronizationState> state;
+	/** Modification times of corresponding files closer than this are equal, see `compare_modification_times`.
+	 * The coarser timestamp granularity of the two roots, probed before the synchronization starts. */
+	fs::file_time_type::duration timestamp_tolerance = fs::file_time_type::duration(1);
+
+	explicit SynchronizationSession(const ProgramArguments &arguments)
+		: copy_engine(create_copy_engine(arguments, statistics)) {
+		if (arguments.uses_manifest())
+			manifest = std::make_unique<TargetManifest>(arguments.get_target_path());
+
+		if (arguments.uses_config_cache()) {
+			std::optional<fs::path> cache_path = ConfigurationCache::default_path();
+			if (!arguments.get_config_cache_path().empty()) cache_path = arguments.get_config_cache_path();
+			if (cache_path.has_value())
+				configuration_cache = std::make_unique<ConfigurationCache>(*cache_path);
+			else
+				std::cerr << "Warning: --config-cache is disabled, no cache directory was found (HOME is not set)." << std::endl;
+		}
+
+		if (arguments.uses_state()) {
+			std::optional<fs::path> state_path = SynchronizationState::default_path(
+				arguments.get_source_path(), arguments.get_target_path()
+			);
+			if (!arguments.get_state_path().empty()) state_path = arguments.get_state_path();
+			if (state_path.has_value()) {
+				state = std::make_unique<SynchronizationState>(
+					*state_path, arguments.get_source_path(), arguments.get_target_path()
+				);
+			} else {
+				std::cerr << "Warning: --state is disabled, no cache directory was found (HOME is not set)." << std::endl;
+			}
+		}
+	}
+};
+
+/** Performs the synchronization within an existing session, e.g. the first run of `--watch`,
+ * whose probed timestamp tolerance is kept by the following ones. */
+int synchronize_directories(const ProgramArguments &arguments, SynchronizationSession &session);
+
+/** A directory with changed entries, as reported by `--watch`. */
+struct ChangedDirectory {
+	/** Relative to the roots, in the generic format, empty for the roots themselves. */
+	std::string relative_path;
+	/** Whether every entry is synchronized, e.g. after the directory configuration changed. */
+	bool all_entries = false;
+	/** The names of the changed entries, including deleted ones. */
+	std::unordered_set<std::string> names;
+
+	bool contains(const std::string &name) const { return all_entries || names.contains(name); }
+};
+
+/** Synchronizes only the changed entries of the given directories (and the whole subtrees of changed
+ * subdirectories), as a full run would if nothing else changed. The directories must exist on both sides.
+ * @return An error code. If none occurs, defaults to zero. */
+int synchronize_changes(
+	const ProgramArguments &arguments,
+	SynchronizationSession &session,
+	const std::vector<ChangedDirectory> &directories
+);
+
 /** An abstract base class for synchronization contexts.
  * Descendants may include synchronizer-specific information. */
 class Context {
 	public:
 	const ProgramArguments &arguments;
+	SynchronizationSession &session;
 
 	protected:
-	explicit Context(const ProgramArguments &args): arguments(args) {}
+	Context(const ProgramArguments &args, SynchronizationSession &session): arguments(args), session(session) {}
 
 	public:
 	virtual ~Context() = 0;
@@ -42,34 +127,67 @@ class BinaryContext : public Context {
 
 	protected:
 	std::vector<ConfigurationPair> configuration_stack;
+	/** The combined filter of every stack level, updated together with the configuration stack. */
+	std::vector<ConfigurationFilter> filter_stack;
 	std::pair<fs::path, fs::path> root_paths;
 
-	explicit BinaryContext(const ProgramArguments &args)
-		: Context(args), root_paths(args.get_source_path(), args.get_target_path()) {}
+	BinaryContext(const ProgramArguments &args, SynchronizationSession &session)
+		: Context(args, session), root_paths(args.get_source_path(), args.get_target_path()) {}
 
 	public:
-	/** For both directory paths, tries to read the local configurations from supported files. */
-	int load_configuration_pair(const fs::path &path_first, const fs::path &path_second) {
+	/** For both directory paths, tries to read the local configurations from supported files.
+	 * If the listings of the directories are given, configuration files missing from them are not queried. */
+	int load_configuration_pair(
+		const fs::path &path_first,
+		const fs::path &path_second,
+		const DirectoryListing *listing_first = nullptr,
+		const DirectoryListing *listing_second = nullptr
+	) {
 		ConfigurationPair pair;
 
-		int error = get_directory_configuration(path_first, arguments, pair.first);
+		ConfigurationCache *cache = session.configuration_cache.get();
+		int error = get_directory_configuration(path_first, arguments, pair.first, cache, listing_first);
 		if (error) return error;
-		error = get_directory_configuration(path_second, arguments, pair.second);
+		error = get_directory_configuration(path_second, arguments, pair.second, cache, listing_second);
 		if (error) return error;
 
+		const ConfigurationFilter parent_filter = filter_stack.empty() ? ConfigurationFilter() : filter_stack.back();
+		filter_stack.push_back(parent_filter.extended_with(
+			path_first.filename().string(),
+			pair.first.has_value() ? &*pair.first : nullptr,
+			pair.second.has_value() ? &*pair.second : nullptr
+		));
+
 		configuration_stack.push_back(std::move(pair));
 		return 0;
 	}
 
+	/** The rules of the whole configuration stack, of the source and the target configurations. */
+	const ConfigurationFilter &get_effective_filter() const {
+		return filter_stack.back();
+	}
+
 	/** Getter for the most specific, most local configuration pair
 	 * (deepest in the file tree - leaf). */
 	const ConfigurationPair &get_leaf_configuration_pair() const {
 		return configuration_stack.back();
 	}
 
+	/** Starts with the configuration stack of another context, e.g. of a parent synchronization.
+	 * @param swapped whether the directories of this context are in the opposite order */
+	void inherit_configuration_stack(const BinaryContext &parent, const bool swapped) {
+		configuration_stack = parent.configuration_stack;
+		filter_stack = parent.filter_stack;
+		if (swapped) {
+			for (ConfigurationPair &pair : configuration_stack) std::swap(pair.first, pair.second);
+			for (ConfigurationFilter &filter : filter_stack) filter.swap_sides();
+		}
+	}
+
 	/** Discards the leaf configuration in the current configuration stack. */
 	void pop_configuration_pair() {
 		configuration_stack.pop_back();
+		filter_stack.pop_back();
 	}
 };
 
@@ -83,6 +201,10 @@ class Synchronizer {
 	 * by Synchronizer class descendants. Uses the provided context and program arguments. */
 	virtual int synchronize() = 0;
 
+	/** Synchronizes the changed entries of a directory, within the configurations of its parent directories,
+	 * which are loaded from the roots down. Used by `--watch` after the first run. */
+	virtual int synchronize_changes(const ChangedDirectory &directory) = 0;
+
 	virtual ~Synchronizer() = default;
 
 	// static bool supports_file_type(const fs::file_type type) {
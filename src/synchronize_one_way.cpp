@@ -1,152 +1,329 @@
 #include "synchronize_one_way.hpp"
 
+#include <compare>
 #include <filesystem>
 #include <iostream>
-#include <ranges>
-
+#include <optional>
+#include <syncstream>
+#include <utility>
+
+#include "checksum.hpp"
+#include "directory_listing.hpp"
+#include "file_metadata.hpp"
+#include "file_operation.hpp"
+#include "manifest.hpp"
+#include "pipeline.hpp"
 #include "synchronize.hpp"
+#include "task_pool.hpp"
 #include "configuration/configuration.hpp"
 
 namespace fs = std::filesystem;
 
-bool MonodirectionalContext::source_allows_to_copy(const fs::directory_entry &entry) const {
-	for (const auto &[source, _] : std::ranges::reverse_view(configuration_stack)) {
-		if (!source.has_value()) continue;
-		const DirectoryConfiguration &configuration = source.value();
-
-		if (!configuration.allows(entry)) return false;
+std::uint64_t MonodirectionalContext::get_configuration_fingerprint() const {
+	std::uint64_t fingerprint = 0;
+	const auto combine = [&fingerprint](const std::uint64_t value) {
+		fingerprint ^= value + 0x9e3779b97f4a7c15 + (fingerprint << 6) + (fingerprint >> 2);
+	};
+
+	combine(static_cast<std::uint64_t>(arguments.get_conflict_resolution_mode()));
+	combine(arguments.should_copy_configurations());
+	combine(arguments.should_delete_extra_target_files());
+	for (const auto &[source, target] : configuration_stack) {
+		combine(source.has_value() ? source->fingerprint() : 0);
+		combine(target.has_value() ? target->fingerprint() : 0);
 	}
-	return true;
+	return fingerprint;
 }
 
-bool MonodirectionalContext::target_accepts(const fs::directory_entry &entry) const {
-	for (const auto &[_, target] : std::ranges::reverse_view(configuration_stack)) {
-		if (!target.has_value()) continue;
-		const DirectoryConfiguration &configuration = target.value();
+std::string MonodirectionalContext::get_relative_source_path(const fs::path &source_path) const {
+	const fs::path relative = source_path.lexically_relative(get_source_root());
+	if (relative == ".") return {};
+	return relative.generic_string();
+}
 
-		if (!configuration.accepts(entry)) return false;
-	}
-	return true;
+int MonodirectionalSynchronizer::execute(FileOperation operation) const {
+	if (pipeline != nullptr) return pipeline->execute(std::move(operation));
+	return perform_file_operation(operation, *context.session.copy_engine);
 }
 
-int MonodirectionalSynchronizer::delete_extra_target_entries(
+DirectoryPairListing MonodirectionalSynchronizer::list_directories(
 	const fs::path &source_directory,
 	const fs::path &target_directory
 ) const {
-	for (const fs::directory_entry &target_entry : fs::directory_iterator(target_directory)) {
-		std::error_code err;
-		const fs::file_status status = target_entry.status(err);
+	if (pipeline != nullptr) return pipeline->take_listing(source_directory, target_directory);
+	// with a manifest, most files are decided without their targets, which are then queried on demand
+	return list_directory_pair(
+		source_directory,
+		target_directory,
+		context.session.manifest == nullptr
+	);
+}
 
-		const fs::file_status source_status = fs::status(
-			source_directory / target_entry.path().filename(),
-			err
-		);
+int MonodirectionalSynchronizer::delete_extra_target_entries(
+	const DirectoryListing &source_listing,
+	const DirectoryListing &target_listing
+) const {
+	const DirectoryIndex source_index(source_listing);
 
-		if (err) return EXIT_CODE_FILESYSTEM_ERROR;
+	for (const ListedEntry &listed : target_listing.entries) {
+		const fs::path &target_entry = listed.path;
+		if (is_own_manifest(target_entry)) continue;
 
-		// continue deleting only when the file does not exist in the source directory
-		if (fs::exists(source_status)) continue;
+		// continue deleting only when the file does not exist in the source directory,
+		// a broken symbolic link does not count as an existing source
+		const ListedEntry *source = source_index.find(target_entry.filename().string());
+		if (source != nullptr && source->metadata_error != std::errc::no_such_file_or_directory) continue;
 
 		if (context.arguments.is_verbose())
-			std::cout << "Deleting extra " << target_entry << "\n";
+			std::osyncstream(std::cout) << "Deleting extra " << target_entry << "\n";
 		if (context.arguments.is_dry_run()) continue;
-		fs::remove(target_entry, err);
-		if (err) return EXIT_CODE_FILESYSTEM_ERROR;
+		const int error = execute({FileOperation::Kind::remove, {}, target_entry});
+		if (error) return error;
 	}
 
 	return 0;
 }
 
 int MonodirectionalSynchronizer::synchronize_regular_file(
-	const fs::directory_entry &source_file,
-	const fs::path &target_path
+	const ListedEntry &source,
+	const fs::path &target_path,
+	const DirectoryIndex &target_index
 ) {
-	std::error_code err;
+	const fs::path &source_file = source.path;
 	fs::path result_target_path = target_path;
 
-	if (fs::exists(target_path)) {
-		const fs::directory_entry target_file(target_path);
+	TargetManifest *manifest = context.session.manifest.get();
+	std::string manifest_path;
+	if (manifest != nullptr) {
+		manifest_path = target_path.lexically_relative(context.get_target_root()).generic_string();
+
+		// the source has not changed since it was written, the target is not examined at all
+		const ManifestRecord *written = manifest->find(manifest_path);
+		if (written != nullptr
+			&& written->size == source.metadata.size
+			&& written->source_modified == to_nanoseconds(source.metadata.modified)) {
+			manifest->keep(std::move(manifest_path), *written);
+			context.session.statistics.manifest_unchanged_files.fetch_add(1, std::memory_order_relaxed);
+			return 0;
+		}
+	}
+
+	// an entry missing from the target listing does not exist, no system call is needed
+	FileMetadata target;
+	std::error_code target_error = std::make_error_code(std::errc::no_such_file_or_directory);
+	if (const ListedEntry *listed = target_index.find(target_path.filename().string()); listed != nullptr) {
+		target = listed->metadata;
+		target_error = listed->metadata_error;
+		// directories (and every entry of a listing without metadata) are known by their type only
+		if (!target_index.has_metadata() || target.is_directory())
+			target_error = read_file_metadata(target_path, target);
+	}
+	if (target_error && target_error != std::errc::no_such_file_or_directory) return EXIT_CODE_FILESYSTEM_ERROR;
+
+	if (!target_error) {
 		if (context.arguments.skips_conflicts()) return 0;
 
-		const fs::file_time_type source_written_at = source_file.last_write_time(err);
-		const fs::file_time_type target_written_at = target_file.last_write_time(err);
-		if (err) return EXIT_CODE_FILESYSTEM_ERROR;
+		if (context.arguments.uses_checksum()) {
+			bool equal = source.metadata.size == target.size;
+			if (equal && compare_file_contents(source_file, target_path, equal, context.session.statistics)) {
+				std::osyncstream(std::cerr) << "Failed to compare the contents of " << source_file << " and "
+					<< target_path << std::endl;
+				return EXIT_CODE_FILESYSTEM_ERROR;
+			}
+			// identical regardless of the times, e.g. touched
+			if (equal) {
+				if (manifest != nullptr) manifest->record(std::move(manifest_path), source.metadata);
+				return 0;
+			}
+		}
+
+		const fs::file_time_type source_written_at = source.metadata.modified;
+		const fs::file_time_type target_written_at = target.modified;
 
-		if (source_written_at == target_written_at) return 0;
-		if (source_written_at < target_written_at) {
+		// equal within the timestamp granularity of the roots, e.g. 2 s on FAT
+		const std::weak_ordering age = compare_modification_times(
+			source_written_at, target_written_at, context.session.timestamp_tolerance
+		);
+		// with --checksum, the contents differ although the times do not, the source wins
+		if (age == std::weak_ordering::equivalent && !context.arguments.uses_checksum()) {
+			if (manifest != nullptr) manifest->record(std::move(manifest_path), source.metadata);
+			return 0;
+		}
+		if (age == std::weak_ordering::less) {
 			// do not copy older versions, but inform the user
 			if (context.arguments.is_verbose())
-				std::cout << "Skipped copying older version of " << source_file << "\n";
+				std::osyncstream(std::cout) << "Skipped copying older version of " << source_file << "\n";
 			return 0;
 		}
 
 		if (context.arguments.overwrites_conflicts()) {
 			// no special treatment
 		} else if (context.arguments.renames_conflicts()) {
-			result_target_path = result_target_path.parent_path() / insert_timestamp_to_filename(target_file);
+			result_target_path = result_target_path.parent_path()
+				/ insert_timestamp_to_filename(target_path, target_written_at);
 		}
 	}
 
 final:
 	if (context.arguments.is_verbose())
-		std::cout << "Copying " << source_file << "\n";
+		std::osyncstream(std::cout) << "Copying " << source_file << "\n";
 	if (context.arguments.is_dry_run()) return 0;
 
-	fs::create_directories(result_target_path.parent_path(), err);
-	fs::copy_file(source_file, result_target_path, fs::copy_options::overwrite_existing, err);
-	if (err) return EXIT_CODE_FILESYSTEM_ERROR;
-	return 0;
+	// a renamed copy leaves the file at the target path as it was
+	if (manifest != nullptr && result_target_path == target_path)
+		manifest->record(std::move(manifest_path), source.metadata);
+
+	return execute({
+		FileOperation::Kind::copy,
+		source_file,
+		result_target_path,
+		fs::copy_options::overwrite_existing
+	});
 }
 
 int MonodirectionalSynchronizer::synchronize_config_file(
-	const fs::directory_entry &source_entry,
+	const fs::path &source_file,
 	const fs::path &target_path
 ) {
-	std::error_code err;
-
 	const bool target_directory_has_config = context.get_target_leaf_configuration().has_value();
 	if (target_directory_has_config || !context.arguments.should_copy_configurations())
 		return 0;
 
 	if (context.arguments.is_verbose())
-		std::cout << "Copying " << source_entry << "\n";
-	if (context.arguments.is_verbose()) return 0;
-
-	fs::create_directories(target_path.parent_path(), err);
-	fs::copy_file(source_entry, target_path, err);
-	if (err) return EXIT_CODE_FILESYSTEM_ERROR;
+		std::osyncstream(std::cout) << "Copying " << source_file << "\n";
+	if (context.arguments.is_dry_run()) return 0;
 
-	return 0;
+	return execute({FileOperation::Kind::copy, source_file, target_path});
 }
 
 int MonodirectionalSynchronizer::synchronize_directory_entry(
-	const fs::directory_entry &source_entry,
-	const fs::path &target_directory
+	const ListedEntry &source,
+	const fs::path &target_directory,
+	const DirectoryIndex &target_index,
+	TaskGroup *subdirectory_tasks
 ) {
-	std::error_code err;
-	const fs::file_status status = source_entry.status(err);
-	if (err) {
-		std::cerr << "Failed to check file status of " << source_entry << std::endl;
+	const fs::path &source_path = source.path;
+	if (source.metadata_error) {
+		std::osyncstream(std::cerr) << "Failed to check file status of " << source_path << std::endl;
 		return EXIT_CODE_FILESYSTEM_ERROR;
 	}
 
-	if (!context.should_synchronize(source_entry))
+	if (!context.should_synchronize(source))
 		return 0;
 
-	const fs::path matching_target_path = target_directory / source_entry.path().filename();
+	const fs::path matching_target_path = target_directory / source_path.filename();
+	if (is_own_manifest(matching_target_path)) return 0;
 
-	if (fs::is_directory(status))
-		return synchronize_directories_recursively(
-			source_entry,
-			matching_target_path
+	if (source.metadata.is_directory())
+		return synchronize_subdirectory(
+			source_path,
+			matching_target_path,
+			subdirectory_tasks
 		);
-	if (fs::is_regular_file(status)) {
-		if (is_config_file(source_entry))
-			return synchronize_config_file(source_entry, matching_target_path);
-		return synchronize_regular_file(source_entry, matching_target_path);
+	if (source.metadata.is_regular_file()) {
+		if (is_config_file(source_path))
+			return synchronize_config_file(source_path, matching_target_path);
+		return synchronize_regular_file(source, matching_target_path, target_index);
 	}
 
-	std::cerr << "Warning: unsupported file type of " << source_entry << std::endl;
+	std::osyncstream(std::cerr) << "Warning: unsupported file type of " << source_path << std::endl;
+	return 0;
+}
+
+int MonodirectionalSynchronizer::synchronize_subdirectory(
+	const fs::path &source_directory,
+	const fs::path &target_directory,
+	TaskGroup *subdirectory_tasks
+) {
+	if (subdirectory_tasks == nullptr)
+		return synchronize_directories_recursively(source_directory, target_directory);
+
+	// the task owns a snapshot of the configuration stack, so the parent may continue
+	subdirectory_tasks->run([
+		task_context = context,
+		source_directory,
+		target_directory,
+		pool = task_pool
+	]() mutable {
+		MonodirectionalSynchronizer synchronizer(task_context, pool);
+		return synchronizer.synchronize_directories_recursively(source_directory, target_directory);
+	});
+	return 0;
+}
+
+bool MonodirectionalSynchronizer::is_own_manifest(const fs::path &target_path) const {
+	return context.session.manifest != nullptr && is_manifest_file(target_path, context.get_target_root());
+}
+
+bool MonodirectionalSynchronizer::is_synchronized_subdirectory(const ListedEntry &listed) const {
+	if (listed.metadata_error || !listed.metadata.is_directory()) return false;
+	return context.should_synchronize(listed);
+}
+
+void MonodirectionalSynchronizer::prefetch_subdirectories(
+	const DirectoryListing &source_listing,
+	const fs::path &target_directory
+) const {
+	for (const ListedEntry &listed : source_listing.entries) {
+		if (!is_synchronized_subdirectory(listed)) continue;
+
+		// the subdirectory will probably be pruned, its configuration stack is checked later
+		FileMetadata metadata;
+		if (context.arguments.prunes_directories() && find_unchanged_directory(listed.path, metadata, 0) != nullptr)
+			continue;
+		pipeline->prefetch(listed.path, target_directory / listed.path.filename());
+	}
+}
+
+const DirectoryRecord *MonodirectionalSynchronizer::find_unchanged_directory(
+	const fs::path &source_directory,
+	FileMetadata &metadata,
+	const std::uint64_t fingerprint
+) const {
+	if (read_file_metadata(source_directory, metadata)) return nullptr;
+	if (context.arguments.is_full_scan()) return nullptr;
+
+	const DirectoryRecord *record = context.session.manifest->find_directory(
+		context.get_relative_source_path(source_directory)
+	);
+	if (record == nullptr) return nullptr;
+	if (record->modified != to_nanoseconds(metadata.modified) || record->changed != to_nanoseconds(metadata.changed))
+		return nullptr;
+	// a zero fingerprint only asks about the directory stamp
+	if (fingerprint != 0 && record->configuration_fingerprint != fingerprint) return nullptr;
+	return record;
+}
+
+int MonodirectionalSynchronizer::synchronize_unchanged_directory(
+	const fs::path &source_directory,
+	const fs::path &target_directory,
+	const DirectoryRecord &record
+) {
+	TargetManifest &manifest = *context.session.manifest;
+	manifest.keep_directory(context.get_relative_source_path(source_directory), record);
+	context.session.statistics.pruned_directories.fetch_add(1, std::memory_order_relaxed);
+	if (pipeline != nullptr) pipeline->discard_listing(source_directory);
+
+	std::optional<TaskGroup> subdirectory_tasks;
+	if (task_pool != nullptr) subdirectory_tasks.emplace(*task_pool);
+	TaskGroup *tasks = subdirectory_tasks.has_value() ? &*subdirectory_tasks : nullptr;
+
+	// the files were not examined, the subdirectories are checked one by one
+	for (const std::string_view child : manifest.children_of(record)) {
+		const int error = synchronize_subdirectory(
+			source_directory / child,
+			target_directory / child,
+			tasks
+		);
+		if (tasks != nullptr) {
+			tasks->add_result(error);
+			if (error) break;
+			continue;
+		}
+		if (error) return error;
+	}
+
+	if (tasks != nullptr) return tasks->wait();
 	return 0;
 }
 
@@ -154,17 +331,133 @@ int MonodirectionalSynchronizer::synchronize_directories_recursively(
 	const fs::path &source_directory,
 	const fs::path &target_directory
 ) {
-	int error = context.load_configuration_pair(source_directory, target_directory);
-	if (error) return error;
+	// the directory stamp is taken before the enumeration, so concurrent changes are noticed by the next run
+	const bool prunes = context.arguments.prunes_directories();
+	FileMetadata directory_metadata;
+	std::uint64_t fingerprint = 0;
+	int error = 0;
+	if (prunes) {
+		// the fingerprint decides whether to enumerate at all, so the configurations are queried directly
+		error = context.load_configuration_pair(source_directory, target_directory);
+		if (error) return error;
+
+		fingerprint = context.get_configuration_fingerprint();
+		const DirectoryRecord *unchanged = find_unchanged_directory(source_directory, directory_metadata, fingerprint);
+		if (unchanged != nullptr) {
+			error = synchronize_unchanged_directory(source_directory, target_directory, *unchanged);
+			context.pop_configuration_pair();
+			return error;
+		}
+	}
 
-	for (const fs::directory_entry &source_entry : fs::directory_iterator(source_directory)) {
-		error = synchronize_directory_entry(source_entry, target_directory);
+	std::optional<TaskGroup> subdirectory_tasks;
+	if (task_pool != nullptr) subdirectory_tasks.emplace(*task_pool);
+	TaskGroup *tasks = subdirectory_tasks.has_value() ? &*subdirectory_tasks : nullptr;
+
+	const DirectoryPairListing listing = list_directories(source_directory, target_directory);
+	if (!prunes) {
+		// the listings tell whether the configuration files exist, sparing a status query per directory
+		error = context.load_configuration_pair(source_directory, target_directory, &listing.source, &listing.target);
+		if (error) return error;
+	}
+	if (pipeline != nullptr) prefetch_subdirectories(listing.source, target_directory);
+	const DirectoryIndex target_index(listing.target);
+
+	for (const ListedEntry &source_entry : listing.source.entries) {
+		error = synchronize_directory_entry(source_entry, target_directory, target_index, tasks);
+		if (tasks != nullptr) {
+			// keep the inline result in entry order, so the first error matches the serial run
+			tasks->add_result(error);
+			if (error) break;
+			continue;
+		}
+		if (error) return error;
+	}
+
+	if (tasks != nullptr) {
+		error = tasks->wait();
 		if (error) return error;
 	}
 
 	if (context.arguments.should_delete_extra_target_files())
-		error = delete_extra_target_entries(source_directory, target_directory);
+		error = delete_extra_target_entries(listing.source, listing.target);
+
+	if (!error && prunes) {
+		std::vector<std::string> subdirectories;
+		for (const ListedEntry &listed : listing.source.entries) {
+			if (is_synchronized_subdirectory(listed))
+				subdirectories.push_back(listed.path.filename().string());
+		}
+		context.session.manifest->record_directory(
+			context.get_relative_source_path(source_directory),
+			directory_metadata,
+			fingerprint,
+			subdirectories
+		);
+	}
 
 	context.pop_configuration_pair();
 	return error;
 }
+
+int MonodirectionalSynchronizer::synchronize_changes(const ChangedDirectory &directory) {
+	fs::path source_directory = context.get_source_root();
+	fs::path target_directory = context.get_target_root();
+
+	// the configurations of the parent directories are loaded from the roots down, as by a full run
+	int error = context.load_configuration_pair(source_directory, target_directory);
+	if (error) return error;
+	std::size_t loaded_configurations = 1;
+	for (const fs::path &name : fs::path(directory.relative_path)) {
+		ListedEntry parent;
+		parent.path = source_directory / name;
+		parent.metadata_error = read_file_metadata(parent.path, parent.metadata);
+		if (!is_synchronized_subdirectory(parent)) {
+			// excluded, or removed since (which is a change of its parent directory)
+			while (loaded_configurations-- > 0) context.pop_configuration_pair();
+			return 0;
+		}
+
+		source_directory /= name;
+		target_directory /= name;
+		error = context.load_configuration_pair(source_directory, target_directory);
+		if (error) return error;
+		loaded_configurations++;
+	}
+
+	std::optional<TaskGroup> subdirectory_tasks;
+	if (task_pool != nullptr) subdirectory_tasks.emplace(*task_pool);
+	TaskGroup *tasks = subdirectory_tasks.has_value() ? &*subdirectory_tasks : nullptr;
+
+	const DirectoryPairListing listing = list_directories(source_directory, target_directory);
+	const DirectoryIndex target_index(listing.target);
+
+	for (const ListedEntry &source_entry : listing.source.entries) {
+		if (!directory.contains(source_entry.path.filename().string())) continue;
+
+		error = synchronize_directory_entry(source_entry, target_directory, target_index, tasks);
+		if (tasks != nullptr) {
+			tasks->add_result(error);
+			if (error) break;
+			continue;
+		}
+		if (error) return error;
+	}
+
+	if (tasks != nullptr) {
+		error = tasks->wait();
+		if (error) return error;
+	}
+
+	if (context.arguments.should_delete_extra_target_files()) {
+		// only the target entries of the changed names are examined
+		DirectoryListing changed_targets;
+		for (const ListedEntry &listed : listing.target.entries) {
+			if (directory.contains(listed.path.filename().string())) changed_targets.entries.push_back(listed);
+		}
+		error = delete_extra_target_entries(listing.source, changed_targets);
+	}
+
+	while (loaded_configurations-- > 0) context.pop_configuration_pair();
+	return error;
+}
@@ -1,9 +1,16 @@
 #ifndef DIRSYNC_SYNCHRONIZE_ONE_WAY_HPP
 #define DIRSYNC_SYNCHRONIZE_ONE_WAY_HPP
 
+#include <cstdint>
+#include <string>
 #include <vector>
 
+#include "directory_listing.hpp"
+#include "file_operation.hpp"
+#include "manifest.hpp"
+#include "pipeline.hpp"
 #include "synchronize.hpp"
+#include "task_pool.hpp"
 #include "configuration/configuration.hpp"
 
 namespace fs = std::filesystem;
@@ -13,7 +20,8 @@ namespace fs = std::filesystem;
  * Contains both source and target configurations, see public getters. */
 class MonodirectionalContext final : public BinaryContext {
 	public:
-	explicit MonodirectionalContext(const ProgramArguments &args) : BinaryContext(args) {}
+	MonodirectionalContext(const ProgramArguments &args, SynchronizationSession &session)
+		: BinaryContext(args, session) {}
 
 	const fs::path &get_source_root() const { return root_paths.first; }
 	const fs::path &get_target_root() const { return root_paths.second; }
@@ -22,23 +30,37 @@ class MonodirectionalContext final : public BinaryContext {
 		return get_leaf_configuration_pair().second;
 	}
 
-	bool should_synchronize(const fs::directory_entry &entry) const {
-		return source_allows_to_copy(entry) && target_accepts(entry);
+	/** Whether every source configuration allows the entry to be copied
+	 * and every target configuration accepts it, answered by the combined filter of the stack. */
+	bool should_synchronize(const ListedEntry &entry) const {
+		return get_effective_filter().accepts(entry.path, entry.metadata);
 	}
 
-	private:
-	bool source_allows_to_copy(const fs::directory_entry &entry) const;
-	bool target_accepts(const fs::directory_entry &entry) const;
+	/** Identifies the current configuration stack together with the arguments affecting
+	 * the synchronization decisions. Used to invalidate the pruning records of a subtree. */
+	std::uint64_t get_configuration_fingerprint() const;
+
+	/** The path relative to the source root in the generic format, empty for the root itself. */
+	std::string get_relative_source_path(const fs::path &source_path) const;
 };
 
 /** A final `Synchronizer` descendant. Provides implementation for one-way synchronization
- * and related helper functions. Uses `MonodirectionalContext` for specific behavior. */
+ * and related helper functions. Uses `MonodirectionalContext` for specific behavior.
+ * When given a task pool, subdirectories are synchronized as parallel tasks,
+ * each with its own copy of the context (and thus of the configuration stack).
+ * When given a pipeline, the synchronizer acts as its planning stage: listings come
+ * from the scanner threads and file operations are handed over to the executor threads. */
 class MonodirectionalSynchronizer final : public Synchronizer {
 	MonodirectionalContext &context;
+	TaskPool *task_pool;
+	SynchronizationPipeline *pipeline;
 
 	public:
-	explicit MonodirectionalSynchronizer(MonodirectionalContext &context)
-		: context(context) {}
+	explicit MonodirectionalSynchronizer(
+		MonodirectionalContext &context,
+		TaskPool *task_pool = nullptr,
+		SynchronizationPipeline *pipeline = nullptr
+	) : context(context), task_pool(task_pool), pipeline(pipeline) {}
 
 	int synchronize() override {
 		return synchronize_directories_recursively(
@@ -47,28 +69,72 @@ class MonodirectionalSynchronizer final : public Synchronizer {
 		);
 	}
 
+	int synchronize_changes(const ChangedDirectory &directory) override;
+
 	private:
 	int synchronize_directories_recursively(
 		const fs::path &source_directory,
 		const fs::path &target_directory
 	);
 	int synchronize_directory_entry(
-		const fs::directory_entry &source_entry,
-		const fs::path &target_directory
+		const ListedEntry &source_entry,
+		const fs::path &target_directory,
+		const DirectoryIndex &target_index,
+		TaskGroup *subdirectory_tasks
+	);
+	/** Synchronizes the subdirectories of a source directory which did not change since the last run,
+	 * as recorded in the manifest, without enumerating it. */
+	int synchronize_unchanged_directory(
+		const fs::path &source_directory,
+		const fs::path &target_directory,
+		const DirectoryRecord &record
+	);
+	/** Whether the directory is unchanged since the last run and its configuration stack matches,
+	 * so it can be pruned.
+	 * @param metadata output parameter of the directory metadata, read before it is enumerated */
+	const DirectoryRecord *find_unchanged_directory(
+		const fs::path &source_directory,
+		FileMetadata &metadata,
+		std::uint64_t fingerprint
+	) const;
+	int synchronize_subdirectory(
+		const fs::path &source_directory,
+		const fs::path &target_directory,
+		TaskGroup *subdirectory_tasks
 	);
 	int synchronize_config_file(
-		const fs::directory_entry &source_entry,
+		const fs::path &source_file,
 		const fs::path &target_path
 	);
+	/** Decides whether to copy the file, the target is looked up in the index of the target directory listing. */
 	int synchronize_regular_file(
-		const fs::directory_entry &source_file,
-		const fs::path &target_path
+		const ListedEntry &source,
+		const fs::path &target_path,
+		const DirectoryIndex &target_index
 	);
 
+	/** Deletes the target entries without a source counterpart, looked up in the source directory listing. */
 	int delete_extra_target_entries(
+		const DirectoryListing &source_listing,
+		const DirectoryListing &target_listing
+	) const;
+
+	/** Enumerates the directory pair, or takes the listing prepared by the pipeline scanners. */
+	DirectoryPairListing list_directories(
 		const fs::path &source_directory,
 		const fs::path &target_directory
 	) const;
+	/** Whether the target path is the manifest of this run, which is neither synchronized nor deleted. */
+	bool is_own_manifest(const fs::path &target_path) const;
+	/** Whether the listed entry is a subdirectory which is to be synchronized recursively. */
+	bool is_synchronized_subdirectory(const ListedEntry &listed) const;
+	/** Requests pipeline scanners to enumerate the subdirectories which will be synchronized. */
+	void prefetch_subdirectories(
+		const DirectoryListing &source_listing,
+		const fs::path &target_directory
+	) const;
+	/** Performs the operation inline, or enqueues it to the pipeline executors. */
+	int execute(FileOperation operation) const;
 };
 
 #endif //DIRSYNC_SYNCHRONIZE_ONE_WAY_HPP
@@ -1,41 +1,97 @@
 #include "synchronize_two_way.hpp"
 
 #include <filesystem>
+#include <algorithm>
+#include <compare>
 #include <optional>
-#include <set>
+#include <string>
+#include <syncstream>
 #include <utility>
 
+#include "checksum.hpp"
+#include "directory_listing.hpp"
+#include "file_metadata.hpp"
+#include "file_operation.hpp"
+#include "sync_state.hpp"
 #include "synchronize.hpp"
 #include "synchronize_one_way.hpp"
+#include "task_pool.hpp"
 #include "configuration/configuration.hpp"
 
+std::string BidirectionalContext::get_relative_path(const fs::path &left_path) const {
+	const fs::path relative = left_path.lexically_relative(get_root_first());
+	if (relative == ".") return {};
+	return relative.generic_string();
+}
+
 int BidirectionalSynchronizer::synchronize_files(
-	const fs::directory_entry &left,
-	const fs::directory_entry &right
+	const ChildEntryInfo &left,
+	const ChildEntryInfo &right
 ) const {
 	if (context.arguments.skips_conflicts()) return 0;
 
-	const std::chrono::time_point<std::chrono::file_clock, std::chrono::seconds>
-		left_write_time = reduce_precision_to_seconds(left.last_write_time()),
-		right_write_time = reduce_precision_to_seconds(right.last_write_time());
+	FileComparison comparison;
+	if (const int error = compare_files(left, right, comparison)) return error;
+	return synchronize_compared_files(left, right, comparison);
+}
+
+int BidirectionalSynchronizer::compare_files(
+	const ChildEntryInfo &left,
+	const ChildEntryInfo &right,
+	FileComparison &comparison
+) const {
+	const std::weak_ordering age = compare_modification_times(
+		left.metadata.modified, right.metadata.modified, context.session.timestamp_tolerance
+	);
+
+	if (context.arguments.uses_checksum()) {
+		bool equal = left.metadata.size == right.metadata.size;
+		if (equal && compare_file_contents(left.path, right.path, equal, context.session.statistics)) {
+			std::osyncstream(std::cerr) << "Failed to compare the contents of " << left.path << " and "
+				<< right.path << std::endl;
+			return EXIT_CODE_FILESYSTEM_ERROR;
+		}
+		if (equal) {
+			comparison = FileComparison::equal;
+			return 0;
+		}
+		if (age == std::weak_ordering::equivalent) {
+			comparison = FileComparison::undecided;
+			return 0;
+		}
+	}
+
+	if (age == std::weak_ordering::equivalent)
+		// considered equal, within the timestamp granularity of the roots
+		comparison = FileComparison::equal;
+	else
+		comparison = age == std::weak_ordering::less ? FileComparison::right_newer : FileComparison::left_newer;
+	return 0;
+}
 
-	if (left_write_time == right_write_time)
-		// considered equal
+int BidirectionalSynchronizer::synchronize_compared_files(
+	const ChildEntryInfo &left,
+	const ChildEntryInfo &right,
+	const FileComparison comparison
+) const {
+	if (context.arguments.skips_conflicts() || comparison == FileComparison::equal) return 0;
+	if (comparison == FileComparison::undecided) {
+		std::osyncstream(std::cerr) << "Warning: " << left.path << " and " << right.path
+			<< " differ, but have the same last write time; neither is copied\n";
 		return 0;
+	}
 
-	const fs::directory_entry *older, *newer;
-	if (left.last_write_time() < right.last_write_time()) {
+	const ChildEntryInfo *older, *newer;
+	if (comparison == FileComparison::right_newer) {
 		older = &left;
 		newer = &right;
 	} else {
 		older = &right;
 		newer = &left;
 	}
-	const fs::directory_entry *target = older;
+	const ChildEntryInfo *target = older;
 
-	fs::path target_path;
-	constexpr fs::copy_options options = fs::copy_options::overwrite_existing;
-	std::error_code err;
+	fs::path target_path = target->path;
 
 	// if config file, keep newer, do not rename
 	if (is_config_file(left) && is_config_file(right)) {
@@ -45,32 +101,42 @@ int BidirectionalSynchronizer::synchronize_files(
 
 	if (context.arguments.overwrites_conflicts()) {
 		// no special action
-		target_path = target->path();
 	} else if (context.arguments.renames_conflicts()) {
-		target_path = target->path().parent_path() / insert_timestamp_to_filename(*target);
+		target_path = target->path.parent_path() / insert_timestamp_to_filename(target->path, target->metadata.modified);
 	}
 
 final:
-	if (context.arguments.is_verbose()) std::cout << "Copying " << *newer << "\n";
+	if (context.arguments.is_verbose()) std::osyncstream(std::cout) << "Copying " << newer->path << "\n";
 	if (context.arguments.is_dry_run()) return 0;
 
-	fs::create_directories(target_path.parent_path(), err);
-	fs::copy_file(*newer, target_path, options, err);
-
-	if (err) return EXIT_CODE_FILESYSTEM_ERROR;
-	return 0;
+	return perform_file_operation(
+		{FileOperation::Kind::copy, newer->path, target_path, fs::copy_options::overwrite_existing},
+		*context.session.copy_engine
+	);
 }
 
-void BidirectionalSynchronizer::get_directory_entry_names(
-	const fs::path &directory,
-	const OptionalConfiguration &config,
-	std::set<std::string> &out_names
+int BidirectionalSynchronizer::get_sorted_entries(
+	const DirectoryListing &listing,
+	const ConfigurationRules &rules,
+	SortedListing &out_listing
 ) {
-	for (const auto &entry : fs::directory_iterator(directory)) {
-		const std::string filename = entry.path().filename().string();
-		if (config.has_value() && !config->allows(entry)) continue;
-		out_names.insert(filename);
+	out_listing.entries.reserve(listing.entries.size());
+
+	for (const ListedEntry &listed : listing.entries) {
+		if (listed.metadata_error) {
+			std::osyncstream(std::cerr) << "Failed to check file status of " << listed.path << std::endl;
+			return EXIT_CODE_FILESYSTEM_ERROR;
+		}
+		std::string name = listed.path.filename().string();
+		if (rules.accepts(name, listed.metadata))
+			out_listing.entries.push_back({std::move(name), listed.metadata});
+		else
+			out_listing.excluded_names.push_back(std::move(name));
 	}
+
+	std::ranges::sort(out_listing.entries, {}, &NamedEntry::name);
+	std::ranges::sort(out_listing.excluded_names);
+	return 0;
 }
 
 int BidirectionalSynchronizer::synchronize_partial_entries(
@@ -89,33 +155,32 @@ int BidirectionalSynchronizer::synchronize_partial_entries(
 	}
 
 	if (source->is_directory()) {
-		// TODO: is there loss of configuration data?
-		// Possible solution?: convert from recursive one-directional context to bidirectional one
-		// while keeping the loaded directory configurations
-
 		ProgramArgumentsBuilder builder(context.arguments);
 		builder.set_source_directory(source->path);
 		builder.set_target_directory(target->path);
 
-		MonodirectionalContext one_way_context(builder.build());
-		MonodirectionalSynchronizer one_way_synchronizer(one_way_context);
+		// the context keeps a reference, the arguments must outlive it
+		const ProgramArguments one_way_arguments = builder.build();
+		MonodirectionalContext one_way_context(one_way_arguments, context.session);
+		// the configurations of the parent directories stay in effect, only the new subtree is read
+		one_way_context.inherit_configuration_stack(context, source != &left);
+		MonodirectionalSynchronizer one_way_synchronizer(one_way_context, task_pool);
 		return one_way_synchronizer.synchronize();
 	}
 
-	if (fs::is_regular_file(source->status)) {
+	if (source->is_regular_file()) {
 		if (context.arguments.is_verbose())
-			std::cout << "Copying " << source->path << "\n";
+			std::osyncstream(std::cout) << "Copying " << source->path << "\n";
 		if (context.arguments.is_dry_run()) return 0;
 
-		constexpr fs::copy_options options = fs::copy_options::skip_existing;
-		std::error_code err;
-		fs::copy_file(*source, *target, options, err);
-		if (err) return EXIT_CODE_FILESYSTEM_ERROR;
-		return 0;
+		return perform_file_operation(
+			{FileOperation::Kind::copy, source->path, target->path, fs::copy_options::skip_existing},
+			*context.session.copy_engine
+		);
 	}
 
 	// report unsupported file type
-	std::cerr << "Incompatible file types at " << source->path << std::endl;
+	std::osyncstream(std::cerr) << "Incompatible file types at " << source->path << std::endl;
 	return EXIT_CODE_INCOMPATIBLE_ENTRIES;
 }
 
@@ -125,44 +190,396 @@ int BidirectionalSynchronizer::synchronize_existing_entries(
 ) const {
 	// both right and left exist
 	if (left.is_regular_file() && right.is_regular_file())
-		return synchronize_files(left.entry, right.entry);
+		return synchronize_files(left, right);
 	if (left.is_directory() && right.is_directory())
 		return synchronize_directories(left.path, right.path);
 
 	// incompatible types; symbolic links are not supported
-	std::cerr << "Incompatible directory entry types at " << left.path << " and " << right.path << "\n";
+	std::osyncstream(std::cerr) << "Incompatible directory entry types at " << left.path << " and " << right.path << "\n";
 	return EXIT_CODE_INCOMPATIBLE_ENTRIES;
 }
 
+void BidirectionalSynchronizer::report_conflict(const fs::path &path, const char *reason) const {
+	context.session.statistics.state_conflicts.fetch_add(1, std::memory_order_relaxed);
+	std::osyncstream(std::cerr) << "Conflict: " << path << " " << reason << "\n";
+}
+
+int BidirectionalSynchronizer::delete_entry(const ChildEntryInfo &entry) const {
+	if (context.arguments.is_verbose()) std::osyncstream(std::cout) << "Deleting " << entry.path << "\n";
+	if (context.arguments.is_dry_run()) return 0;
+
+	const int error = perform_file_operation(
+		{FileOperation::Kind::remove, {}, entry.path},
+		*context.session.copy_engine
+	);
+	if (!error) context.session.statistics.state_deletions.fetch_add(1, std::memory_order_relaxed);
+	return error;
+}
+
+int BidirectionalSynchronizer::restore_partial_entry(
+	const ChildEntryInfo &left,
+	const ChildEntryInfo &right,
+	const std::string &relative_path
+) const {
+	const int error = synchronize_partial_entries(left, right);
+	if (error || context.arguments.is_dry_run()) return error;
+
+	// entries missing on the other side after all (e.g. excluded ones) are left out upon saving
+	SynchronizationState &state = *context.session.state;
+	state.record_written(relative_path);
+
+	const ChildEntryInfo &source = left.exists ? left : right;
+	if (source.is_directory()) {
+		std::error_code iteration_error;
+		for (
+			fs::recursive_directory_iterator iterator(source.path, iteration_error), end;
+			!iteration_error && iterator != end;
+			iterator.increment(iteration_error)
+		) {
+			state.record_written(relative_path + '/' + iterator->path().lexically_relative(source.path).generic_string());
+		}
+	}
+	return 0;
+}
+
+int BidirectionalSynchronizer::reconcile_files(
+	const ChildEntryInfo &left,
+	const ChildEntryInfo &right,
+	std::string relative_path,
+	const StateRecord *record
+) const {
+	SynchronizationState &state = *context.session.state;
+	const fs::file_time_type::duration tolerance = context.session.timestamp_tolerance;
+
+	const bool left_unchanged = record != nullptr
+		&& SynchronizationState::is_unchanged(*record, left.metadata, true, tolerance);
+	const bool right_unchanged = record != nullptr
+		&& SynchronizationState::is_unchanged(*record, right.metadata, false, tolerance);
+
+	if (left_unchanged && right_unchanged) {
+		// untouched since the last run, there is nothing to compare
+		context.session.statistics.state_unchanged_entries.fetch_add(1, std::memory_order_relaxed);
+		state.keep(std::move(relative_path), *record);
+		return 0;
+	}
+
+	if (left_unchanged || right_unchanged) {
+		if (context.arguments.uses_checksum()) {
+			FileComparison comparison;
+			if (const int error = compare_files(left, right, comparison)) return error;
+			// touched, but identical
+			if (comparison == FileComparison::equal) {
+				state.record(std::move(relative_path), left.metadata, right.metadata);
+				return 0;
+			}
+		}
+
+		// only one side changed since the last run, it wins regardless of the times
+		const ChildEntryInfo &changed = left_unchanged ? right : left;
+		const ChildEntryInfo &unchanged = left_unchanged ? left : right;
+		if (context.arguments.skips_conflicts()) {
+			state.keep(std::move(relative_path), *record);
+			return 0;
+		}
+
+		if (context.arguments.is_verbose()) std::osyncstream(std::cout) << "Copying " << changed.path << "\n";
+		if (context.arguments.is_dry_run()) return 0;
+
+		const int error = perform_file_operation(
+			{FileOperation::Kind::copy, changed.path, unchanged.path, fs::copy_options::overwrite_existing},
+			*context.session.copy_engine
+		);
+		if (!error) state.record_written(std::move(relative_path));
+		return error;
+	}
+
+	// changed on both sides, or not synchronized yet
+	FileComparison comparison;
+	if (const int error = compare_files(left, right, comparison)) return error;
+	if (comparison == FileComparison::equal && left.metadata.size == right.metadata.size) {
+		state.record(std::move(relative_path), left.metadata, right.metadata);
+		return 0;
+	}
+
+	if (record != nullptr) report_conflict(left.path, "was modified on both sides");
+	const int error = synchronize_compared_files(left, right, comparison);
+	// a renamed, skipped or undecided conflict stays unresolved, it is compared again by the next run
+	const bool copied = comparison == FileComparison::left_newer || comparison == FileComparison::right_newer;
+	if (!error && copied && context.arguments.overwrites_conflicts() && !context.arguments.is_dry_run())
+		state.record_written(std::move(relative_path));
+	return error;
+}
+
+int BidirectionalSynchronizer::propagate_deletion(
+	const ChildEntryInfo &left,
+	const ChildEntryInfo &right,
+	std::string relative_path,
+	const StateRecord &record,
+	bool &removed
+) const {
+	removed = false;
+	const bool existing_left = left.exists;
+	const ChildEntryInfo &existing = existing_left ? left : right;
+
+	if (!SynchronizationState::is_unchanged(record, existing.metadata, existing_left, context.session.timestamp_tolerance)
+		|| !(existing.is_regular_file() || existing.is_directory())) {
+		// a changed entry is kept, the deletion is undone
+		if (existing.is_regular_file() || existing.is_directory())
+			report_conflict(existing.path, "was modified, but deleted on the other side; restoring it");
+		return restore_partial_entry(left, right, relative_path);
+	}
+
+	if (existing.is_regular_file()) {
+		const int error = delete_entry(existing);
+		removed = !error;
+		return error;
+	}
+
+	// a directory is deleted if its whole synchronized content is, its children are reconciled one by one
+	const DirectoryListing listing = list_directory(existing.path, true);
+	const DirectoryListing empty_listing;
+	int error = existing_left
+		? context.load_configuration_pair(left.path, right.path, &listing, &empty_listing)
+		: context.load_configuration_pair(left.path, right.path, &empty_listing, &listing);
+	if (error) return error;
+
+	// a copy, the stack grows while the children are reconciled
+	const ConfigurationFilter filter = context.get_effective_filter();
+	SortedListing sorted;
+	error = get_sorted_entries(listing, existing_left ? filter.get_first_rules() : filter.get_second_rules(), sorted);
+	if (error) return error;
+
+	// excluded entries were never synchronized, they keep the directory
+	bool kept = !sorted.excluded_names.empty();
+	for (const NamedEntry &entry : sorted.entries) {
+		const ChildEntryInfo child_left = existing_left
+			? ChildEntryInfo(left.path, entry)
+			: ChildEntryInfo(left.path, entry.name);
+		const ChildEntryInfo child_right = existing_left
+			? ChildEntryInfo(right.path, entry.name)
+			: ChildEntryInfo(right.path, entry);
+		const std::string child_relative = relative_path + '/' + entry.name;
+
+		if (is_config_file(entry.name) && !context.arguments.should_copy_configurations()) {
+			// configuration files are not synchronized, they go with their directory
+			continue;
+		}
+		const ConfigurationRules &missing_side_rules = existing_left ? filter.get_second_rules() : filter.get_first_rules();
+		if (!missing_side_rules.accepts(entry.name, entry.metadata)) {
+			// not accepted on the other side, so never synchronized there
+			kept = true;
+			continue;
+		}
+
+		const StateRecord *child_record = context.session.state->find(child_relative);
+		bool child_removed = false;
+		if (child_record != nullptr) {
+			error = propagate_deletion(child_left, child_right, child_relative, *child_record, child_removed);
+		} else {
+			report_conflict(
+				(existing_left ? child_left : child_right).path,
+				"was created, but its directory was deleted on the other side; restoring it"
+			);
+			error = restore_partial_entry(child_left, child_right, child_relative);
+		}
+		if (error) return error;
+		if (!child_removed) kept = true;
+	}
+	context.pop_configuration_pair();
+
+	if (kept) {
+		// the restored content recreated the directory on the other side
+		if (!context.arguments.is_dry_run()) context.session.state->record_written(std::move(relative_path));
+		return 0;
+	}
+
+	error = delete_entry(existing);
+	removed = !error;
+	return error;
+}
+
+int BidirectionalSynchronizer::synchronize_with_state(
+	const ChildEntryInfo &left,
+	const ChildEntryInfo &right
+) const {
+	SynchronizationState &state = *context.session.state;
+	std::string relative_path = context.get_relative_path(left.path);
+	const StateRecord *record = state.find(relative_path);
+
+	if (left.exists && right.exists) {
+		if (left.is_regular_file() && right.is_regular_file())
+			return reconcile_files(left, right, std::move(relative_path), record);
+		if (left.is_directory() && right.is_directory()) {
+			const int error = synchronize_directories(left.path, right.path);
+			if (error) return error;
+			state.record(std::move(relative_path), left.metadata, right.metadata);
+			return 0;
+		}
+		return synchronize_existing_entries(left, right);
+	}
+
+	// missing on one side: created there since the last run, or deleted on the other side
+	if (record == nullptr) return restore_partial_entry(left, right, relative_path);
+
+	bool removed;
+	return propagate_deletion(left, right, std::move(relative_path), *record, removed);
+}
+
+int BidirectionalSynchronizer::synchronize_entry_pair(
+	const ChildEntryInfo &left,
+	const ChildEntryInfo &right
+) const {
+	// configuration files are only compared by the conflict strategy, they are not part of the state
+	if (context.session.state != nullptr
+		&& (context.arguments.should_copy_configurations() || !is_config_file(left.path)))
+		return synchronize_with_state(left, right);
+
+	if (left.exists ^ right.exists)
+		return synchronize_partial_entries(left, right);
+	return synchronize_existing_entries(left, right);
+}
+
 int BidirectionalSynchronizer::synchronize_directories(
 	const fs::path &source_left,
 	const fs::path &source_right
 ) const {
-	context.load_configuration_pair(source_left, source_right);
-	BinaryContext::ConfigurationPair pair = context.get_leaf_configuration_pair();
+	// both directories are enumerated once, which also tells whether their configuration files exist
+	const DirectoryListing left_listing = list_directory(source_left, true);
+	const DirectoryListing right_listing = list_directory(source_right, true);
+
+	int error = context.load_configuration_pair(source_left, source_right, &left_listing, &right_listing);
+	if (error) return error;
+	const ConfigurationFilter &filter = context.get_effective_filter();
+
+	// each side is filtered by its own configurations
+	SortedListing left_sorted, right_sorted;
+	error = get_sorted_entries(left_listing, filter.get_first_rules(), left_sorted);
+	if (error) return error;
+	error = get_sorted_entries(right_listing, filter.get_second_rules(), right_sorted);
+	if (error) return error;
 
-	std::set<std::string> left_names, right_names;
-	std::set<std::string> all_entry_names;
+	error = synchronize_sorted_entries(source_left, source_right, left_sorted, right_sorted, nullptr);
+	if (error) return error;
 
-	get_directory_entry_names(source_left, pair.first, left_names);
-	get_directory_entry_names(source_right, pair.second, right_names);
+	context.pop_configuration_pair();
+	return 0;
+}
+
+int BidirectionalSynchronizer::synchronize_sorted_entries(
+	const fs::path &source_left,
+	const fs::path &source_right,
+	const SortedListing &left_listing,
+	const SortedListing &right_listing,
+	const ChangedDirectory *changed
+) const {
+	const SortedEntries &left_entries = left_listing.entries;
+	const SortedEntries &right_entries = right_listing.entries;
+	int error = 0;
+	std::optional<TaskGroup> directory_tasks;
+	if (task_pool != nullptr) directory_tasks.emplace(*task_pool);
 
-	all_entry_names.insert_range(left_names);
-	all_entry_names.insert_range(right_names);
+	// merge-join of both sorted listings, the names are visited in order like in a set union
+	// a copy, the stack grows while the subdirectories are synchronized
+	const ConfigurationFilter filter = context.get_effective_filter();
+	auto left_iterator = left_entries.cbegin();
+	auto right_iterator = right_entries.cbegin();
+	while (left_iterator != left_entries.cend() || right_iterator != right_entries.cend()) {
+		int order;
+		if (left_iterator == left_entries.cend()) order = 1;
+		else if (right_iterator == right_entries.cend()) order = -1;
+		else order = left_iterator->name.compare(right_iterator->name);
 
-	for (const std::string &name : all_entry_names) {
-		ChildEntryInfo left(source_left, left_names, name);
-		ChildEntryInfo right(source_right, right_names, name);
-		int error = 0;
+		const std::string &name = order <= 0 ? left_iterator->name : right_iterator->name;
+		const ChildEntryInfo left = order <= 0
+			? ChildEntryInfo(source_left, *left_iterator)
+			: ChildEntryInfo(source_left, name);
+		const ChildEntryInfo right = order >= 0
+			? ChildEntryInfo(source_right, *right_iterator)
+			: ChildEntryInfo(source_right, name);
+		if (order <= 0) ++left_iterator;
+		if (order >= 0) ++right_iterator;
+		if (changed != nullptr && !changed->contains(name)) continue;
 
-		if (left.exists ^ right.exists) {
-			error = synchronize_partial_entries(left, right);
-		} else {
-			error = synchronize_existing_entries(left, right);
+		// an entry excluded on the other side is not missing there: nothing is deleted, the record is kept
+		if ((order < 0 && right_listing.excludes(name)) || (order > 0 && left_listing.excludes(name))) {
+			if (context.session.state != nullptr)
+				context.session.state->keep_subtree(context.get_relative_path(left.path));
+			continue;
 		}
 
+		// an entry of one side only is not brought to the other side if the configurations there do not accept it
+		if (order < 0 && !filter.get_second_rules().accepts(name, left.metadata)) continue;
+		if (order > 0 && !filter.get_first_rules().accepts(name, right.metadata)) continue;
+
+		if (directory_tasks.has_value() && (left.is_directory() || right.is_directory())) {
+			// the task owns a snapshot of the configuration stack, so the parent may continue
+			directory_tasks->run([task_context = context, left, right, pool = task_pool]() mutable {
+				const BidirectionalSynchronizer synchronizer(task_context, pool);
+				return synchronizer.synchronize_entry_pair(left, right);
+			});
+			continue;
+		}
+
+		error = synchronize_entry_pair(left, right);
+		if (directory_tasks.has_value()) {
+			// keep the inline result in name order, so the first error is deterministic
+			directory_tasks->add_result(error);
+			if (error) break;
+			continue;
+		}
 		if (error) return error;
 	}
 
+	if (directory_tasks.has_value()) return directory_tasks->wait();
+	return 0;
+}
+
+int BidirectionalSynchronizer::synchronize_changes(const ChangedDirectory &directory) {
+	fs::path source_left = context.get_root_first();
+	fs::path source_right = context.get_root_second();
+
+	// the configurations of the parent directories are loaded from the roots down, as by a full run
+	std::size_t loaded_configurations = 0;
+	for (const fs::path &name : fs::path(directory.relative_path)) {
+		const int error = context.load_configuration_pair(source_left, source_right);
+		if (error) return error;
+		loaded_configurations++;
+
+		const ConfigurationFilter &filter = context.get_effective_filter();
+		const fs::path left = source_left / name;
+		const fs::path right = source_right / name;
+		FileMetadata left_metadata, right_metadata;
+		const bool synchronized = !read_file_metadata(left, left_metadata)
+			&& !read_file_metadata(right, right_metadata)
+			&& left_metadata.is_directory() && right_metadata.is_directory()
+			&& filter.get_first_rules().accepts(name.string(), left_metadata)
+			&& filter.get_second_rules().accepts(name.string(), right_metadata);
+		if (!synchronized) {
+			// excluded, or removed from one side since (which is a change of its parent directory)
+			while (loaded_configurations-- > 0) context.pop_configuration_pair();
+			return 0;
+		}
+
+		source_left = left;
+		source_right = right;
+	}
+
+	const DirectoryListing left_listing = list_directory(source_left, true);
+	const DirectoryListing right_listing = list_directory(source_right, true);
+	int error = context.load_configuration_pair(source_left, source_right, &left_listing, &right_listing);
+	if (error) return error;
+	loaded_configurations++;
+	const ConfigurationFilter &filter = context.get_effective_filter();
+
+	SortedListing left_sorted, right_sorted;
+	error = get_sorted_entries(left_listing, filter.get_first_rules(), left_sorted);
+	if (error) return error;
+	error = get_sorted_entries(right_listing, filter.get_second_rules(), right_sorted);
+	if (error) return error;
+
+	error = synchronize_sorted_entries(source_left, source_right, left_sorted, right_sorted, &directory);
+	if (error) return error;
+
+	while (loaded_configurations-- > 0) context.pop_configuration_pair();
 	return 0;
 }
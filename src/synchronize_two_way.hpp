@@ -1,11 +1,17 @@
 #ifndef DIRSYNC_SYNCHRONIZE_TWO_WAY_HPP
 #define DIRSYNC_SYNCHRONIZE_TWO_WAY_HPP
 
+#include <algorithm>
 #include <filesystem>
-#include <set>
+#include <string>
 #include <utility>
+#include <vector>
 
+#include "directory_listing.hpp"
+#include "file_metadata.hpp"
+#include "sync_state.hpp"
 #include "synchronize.hpp"
+#include "task_pool.hpp"
 #include "configuration/configuration.hpp"
 
 namespace fs = std::filesystem;
@@ -14,49 +20,76 @@ namespace fs = std::filesystem;
  * Provides information for and stores state of `BidirectionalSynchronizer`. */
 class BidirectionalContext final : public BinaryContext {
 	public:
-	explicit BidirectionalContext(const ProgramArguments &args) : BinaryContext(args) {}
+	BidirectionalContext(const ProgramArguments &args, SynchronizationSession &session)
+		: BinaryContext(args, session) {}
 
 	const fs::path &get_root_first() const { return root_paths.first; }
 	const fs::path &get_root_second() const { return root_paths.second; }
+
+	/** The path of an entry relative to the left root, in the generic format, as used by the synchronization state. */
+	std::string get_relative_path(const fs::path &left_path) const;
+};
+
+/** A synchronized directory entry name with its metadata from the directory listing. */
+struct NamedEntry {
+	std::string name;
+	FileMetadata metadata;
 };
 
-/** Helper structure to store the directory entry with its file status and boolean existence.
+/** The synchronized entries of a directory, sorted by name for the merge-join of both sides. */
+using SortedEntries = std::vector<NamedEntry>;
+
+/** The listing of one side of a directory pair, split by the configurations of the side. */
+struct SortedListing {
+	/** The accepted entries. */
+	SortedEntries entries;
+	/** The names of the entries which exist, but are excluded, sorted. */
+	std::vector<std::string> excluded_names;
+
+	bool excludes(const std::string &name) const { return std::ranges::binary_search(excluded_names, name); }
+};
+
+/** The outcome of comparing the two copies of a file. */
+enum class FileComparison {
+	equal,
+	left_newer,
+	right_newer,
+	/** Different contents with the same last write time (`--checksum`), neither copy is preferred. */
+	undecided,
+};
+
+/** Helper structure to store the directory entry path with its metadata and boolean existence.
  * It is constructed by an algorithm's state, the files are not guaranteed to exist. */
 struct ChildEntryInfo {
 	bool exists;
 	fs::path path;
-	fs::directory_entry entry;
-	fs::file_status status;
-
-	ChildEntryInfo(
-		const fs::path &parent,
-		const std::set<std::string> &collection,
-		const std::string &name
-	) {
-		const auto iterator = collection.find(name);
-
-		exists = iterator != collection.end();
-		path = parent / name;
-		if (!exists) return;
-
-		entry = fs::directory_entry(parent / name);
-		status = fs::status(path);
-	}
+	FileMetadata metadata;
+
+	/** An entry present in the listing of the parent directory. */
+	ChildEntryInfo(const fs::path &parent, const NamedEntry &entry)
+		: exists(true), path(parent / entry.name), metadata(entry.metadata) {}
 
-	bool is_regular_file() const noexcept { return fs::is_regular_file(status); }
-	bool is_directory() const noexcept { return fs::is_directory(status); }
+	/** A missing counterpart of an entry present on the other side. */
+	ChildEntryInfo(const fs::path &parent, const std::string &name)
+		: exists(false), path(parent / name) {}
+
+	bool is_regular_file() const noexcept { return metadata.is_regular_file(); }
+	bool is_directory() const noexcept { return metadata.is_directory(); }
 
 	operator const fs::path &() const { return path; }
 };
 
 /** A final `Synchronizer` descendant. Provides implementation for two-way synchronization
- * and related helper functions. Uses `BidirectionalContext` for specific behavior. */
+ * and related helper functions. Uses `BidirectionalContext` for specific behavior.
+ * When given a task pool, child directory pairs and one-way fallbacks run as parallel tasks,
+ * each with its own copy of the context. */
 class BidirectionalSynchronizer final : public Synchronizer {
 	BidirectionalContext &context;
+	TaskPool *task_pool;
 
 	public:
-	explicit BidirectionalSynchronizer(BidirectionalContext &context)
-		: context(context) {}
+	explicit BidirectionalSynchronizer(BidirectionalContext &context, TaskPool *task_pool = nullptr)
+		: context(context), task_pool(task_pool) {}
 
 	int synchronize() override {
 		return synchronize_directories(
@@ -65,17 +98,35 @@ class BidirectionalSynchronizer final : public Synchronizer {
 		);
 	}
 
+	int synchronize_changes(const ChangedDirectory &directory) override;
+
 	private:
 	/** Performs a two-way synchronization recursively.
-	* For each common directory in the input tree,
-	* list all files and directories, store in a std::map<std::string>
-	* and perform symmetric synchronization.
+	* For each common directory in the input tree, list all files and directories
+	* into vectors sorted by name, merge-join them in a single pass
+	* and perform symmetric synchronization of every name.
 	* Uses BidirectionalContext instance to store configuration pairs in a stack. */
 	int synchronize_directories(
 		const fs::path &source_left,
 		const fs::path &source_right
 	) const;
 
+	/** Merge-joins the sorted entries of a directory pair and synchronizes every name,
+	 * or only the changed ones if `changed` is given. */
+	int synchronize_sorted_entries(
+		const fs::path &source_left,
+		const fs::path &source_right,
+		const SortedListing &left_listing,
+		const SortedListing &right_listing,
+		const ChangedDirectory *changed
+	) const;
+
+	/** Dispatches to partial or existing entry synchronization. */
+	int synchronize_entry_pair(
+		const ChildEntryInfo &left,
+		const ChildEntryInfo &right
+	) const;
+
 	/** Synchronizes two directory entries, only one of which exists. */
 	int synchronize_partial_entries(
 		const ChildEntryInfo &left,
@@ -87,6 +138,47 @@ class BidirectionalSynchronizer final : public Synchronizer {
 		const ChildEntryInfo &right
 	) const;
 
+	/** Three-way reconciliation of an entry pair with the state of the last run (`--state`).
+	 * The side which changed since the last run wins, an entry missing on one side was deleted there
+	 * if it is recorded and created on the other side otherwise. When both sides changed,
+	 * the conflict is reported and resolved by the conflict strategy as without the state. */
+	int synchronize_with_state(
+		const ChildEntryInfo &left,
+		const ChildEntryInfo &right
+	) const;
+
+	/** Reconciles two existing files with their record of the last run, if any. */
+	int reconcile_files(
+		const ChildEntryInfo &left,
+		const ChildEntryInfo &right,
+		std::string relative_path,
+		const StateRecord *record
+	) const;
+
+	/** Deletes a recorded entry which exists on one side only, unless it changed since the last run.
+	 * A changed file, or a directory with changed or new content, is a conflict and is restored on the other side.
+	 * @param removed output parameter, whether the entry was (or in a dry run, would be) deleted */
+	int propagate_deletion(
+		const ChildEntryInfo &left,
+		const ChildEntryInfo &right,
+		std::string relative_path,
+		const StateRecord &record,
+		bool &removed
+	) const;
+
+	/** Deletes a file or a directory with its contents. */
+	int delete_entry(const ChildEntryInfo &entry) const;
+
+	/** Copies an entry present on one side only, and records every copied entry in the state. */
+	int restore_partial_entry(
+		const ChildEntryInfo &left,
+		const ChildEntryInfo &right,
+		const std::string &relative_path
+	) const;
+
+	/** Reports an entry changed on both sides since the last run. */
+	void report_conflict(const fs::path &path, const char *reason) const;
+
 	/** Syncs the files if the program arguments and local directory configuration allow it.
 	 * Uses the specified filename conflict strategy. Determines which file content is newer
 	 * by file's last written time. \n\n
@@ -94,15 +186,34 @@ class BidirectionalSynchronizer final : public Synchronizer {
 	 * Example 2: b/common.txt gets copied to a/common.txt (already existed)
 	 * because we use the default time-based conflict strategy and a/common.txt is newer. */
 	int synchronize_files(
-		const fs::directory_entry &left,
-		const fs::directory_entry &right
+		const ChildEntryInfo &left,
+		const ChildEntryInfo &right
+	) const;
+
+	/** Compares two existing files by their last write times; with `--checksum`, by their sizes
+	 * and contents first, so files are equal only if their contents are.
+	 * @param comparison output parameter */
+	int compare_files(
+		const ChildEntryInfo &left,
+		const ChildEntryInfo &right,
+		FileComparison &comparison
+	) const;
+
+	/** Copies the newer of two compared files by the conflict strategy, see `synchronize_files`. */
+	int synchronize_compared_files(
+		const ChildEntryInfo &left,
+		const ChildEntryInfo &right,
+		FileComparison comparison
 	) const;
 
-	/** Iterates all synchronizable entries and saves as strings to the output set. */
-	static void get_directory_entry_names(
-		const fs::path &directory,
-		const OptionalConfiguration &config,
-		std::set<std::string> &out_names
+	/** Selects all entries of the listing (with metadata) accepted by the configurations of its side
+	 * along the whole path, sorted by name, and the names of the excluded ones.
+	 * @param rules the rules of the side the listing belongs to
+	 * @return an error code, e.g. when the metadata of an entry cannot be read */
+	static int get_sorted_entries(
+		const DirectoryListing &listing,
+		const ConfigurationRules &rules,
+		SortedListing &out_listing
 	);
 };
 
@@ -0,0 +1,152 @@
+#include "task_pool.hpp"
+
+#include <thread>
+#include <utility>
+
+namespace {
+	// identifies the pool and deque owned by the current worker thread
+	thread_local const TaskPool *current_pool = nullptr;
+	thread_local std::size_t current_index = 0;
+}
+
+TaskPool::TaskPool(const std::size_t worker_count) {
+	for (std::size_t i = 0; i <= worker_count; i++)
+		queues.push_back(std::make_unique<TaskQueue>());
+
+	for (std::size_t i = 0; i < worker_count; i++)
+		workers.emplace_back(&TaskPool::worker_loop, this, i);
+}
+
+TaskPool::~TaskPool() {
+	{
+		std::lock_guard lock(sleep_mutex);
+		stopping = true;
+	}
+	wake_up.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+std::size_t TaskPool::current_queue_index() const {
+	if (current_pool == this) return current_index;
+	return queues.size() - 1; // the injection deque
+}
+
+void TaskPool::submit(Task task) {
+	TaskQueue &queue = *queues[current_queue_index()];
+	{
+		std::lock_guard lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	queued_count.fetch_add(1);
+
+	bool waiters_blocked;
+	{
+		// taking the lock prevents a lost wake-up of a worker about to sleep
+		std::lock_guard lock(sleep_mutex);
+		waiters_blocked = blocked_waiter_count > 0;
+	}
+	wake_up.notify_one();
+	if (waiters_blocked) progress.notify_all();
+}
+
+bool TaskPool::try_pop(const std::size_t own_index, Task &task) {
+	{
+		// own tasks are taken LIFO, so a subtree is finished before its siblings
+		TaskQueue &own = *queues[own_index];
+		std::lock_guard lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			queued_count.fetch_sub(1);
+			return true;
+		}
+	}
+
+	// steal the oldest task (usually the largest remaining subtree) from other deques
+	for (std::size_t offset = 1; offset < queues.size(); offset++) {
+		TaskQueue &victim = *queues[(own_index + offset) % queues.size()];
+		std::lock_guard lock(victim.mutex);
+		if (victim.tasks.empty()) continue;
+
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		queued_count.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+bool TaskPool::try_run_pending_task() {
+	Task task;
+	if (!try_pop(current_queue_index(), task)) return false;
+	task();
+	return true;
+}
+
+void TaskPool::wait_for_progress(const std::atomic<std::size_t> &pending_count) {
+	std::unique_lock lock(sleep_mutex);
+	blocked_waiter_count++;
+	progress.wait(lock, [this, &pending_count] { return pending_count.load() == 0 || queued_count.load() > 0; });
+	blocked_waiter_count--;
+}
+
+void TaskPool::notify_task_finished() {
+	{
+		std::lock_guard lock(sleep_mutex);
+		if (blocked_waiter_count == 0) return;
+	}
+	progress.notify_all();
+}
+
+void TaskPool::worker_loop(const std::size_t index) {
+	current_pool = this;
+	current_index = index;
+
+	while (true) {
+		Task task;
+		if (try_pop(index, task)) {
+			task();
+			continue;
+		}
+
+		std::unique_lock lock(sleep_mutex);
+		wake_up.wait(lock, [this] { return stopping || queued_count.load() > 0; });
+		if (stopping && queued_count.load() == 0) return;
+	}
+}
+
+void TaskGroup::run(std::function<int()> task) {
+	Slot &slot = slots.emplace_back();
+	pending_count.fetch_add(1);
+
+	// the group may be destroyed as soon as the pending count drops, only the pool is used afterwards
+	pool.submit([this, &pool = pool, &slot, task = std::move(task)] {
+		try {
+			slot.result = task();
+		} catch (...) {
+			slot.exception = std::current_exception();
+		}
+		pending_count.fetch_sub(1);
+		pool.notify_task_finished();
+	});
+}
+
+void TaskGroup::wait_for_pending() {
+	while (pending_count.load() > 0) {
+		// help instead of blocking, otherwise nested groups could exhaust the workers;
+		// with nothing to help with, the remaining tasks are running elsewhere
+		if (!pool.try_run_pending_task())
+			pool.wait_for_progress(pending_count);
+	}
+}
+
+int TaskGroup::wait() {
+	wait_for_pending();
+
+	for (const Slot &slot : slots) {
+		if (slot.exception) std::rethrow_exception(slot.exception);
+		if (slot.result) return slot.result;
+	}
+	return 0;
+}
@@ -0,0 +1,109 @@
+#ifndef DIRSYNC_TASK_POOL_HPP
+#define DIRSYNC_TASK_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A fixed-size work-stealing thread pool. Every worker owns a task deque:
+ * it pushes and pops its own tasks at the back (depth-first, cache-friendly)
+ * and steals from the front of other deques when its own is empty.
+ * Threads that are not workers of the pool submit to a separate injection deque
+ * and may help executing tasks while waiting, see `TaskGroup::wait`. */
+class TaskPool {
+	public:
+	using Task = std::function<void()>;
+
+	private:
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	// one deque per worker, the last one is shared by external threads
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> workers;
+
+	std::mutex sleep_mutex;
+	std::condition_variable wake_up;
+	std::atomic<std::size_t> queued_count = 0;
+	bool stopping = false;
+
+	// threads blocked in `TaskGroup::wait`, woken when a task is queued or a task of a group finishes
+	std::condition_variable progress;
+	std::size_t blocked_waiter_count = 0;
+
+	public:
+	/** Starts the given number of worker threads. Zero workers are allowed,
+	 * in which case tasks are executed only by threads waiting in `TaskGroup::wait`. */
+	explicit TaskPool(std::size_t worker_count);
+	~TaskPool();
+
+	TaskPool(const TaskPool &) = delete;
+	TaskPool &operator=(const TaskPool &) = delete;
+
+	/** Enqueues the task. When called from a worker, the task is pushed
+	 * to its own deque, otherwise to the injection deque. */
+	void submit(Task task);
+
+	/** Executes one pending task on the calling thread, preferring the thread's own deque.
+	 * @return false if no task was found */
+	bool try_run_pending_task();
+
+	/** Blocks the calling thread until a task is queued (which it may help executing)
+	 * or the pending count of the group reaches zero. */
+	void wait_for_progress(const std::atomic<std::size_t> &pending_count);
+
+	/** Wakes the threads blocked in `wait_for_progress`, called after a task of a group has finished. */
+	void notify_task_finished();
+
+	private:
+	std::size_t current_queue_index() const;
+	bool try_pop(std::size_t own_index, Task &task);
+	void worker_loop(std::size_t index);
+};
+
+/** A set of tasks whose integer results (program-wide error codes) are collected
+ * in submission order. The first error is therefore deterministic, regardless
+ * of which task finishes first. */
+class TaskGroup {
+	struct Slot {
+		int result = 0;
+		std::exception_ptr exception;
+	};
+
+	TaskPool &pool;
+	// deque keeps references to slots valid while new ones are appended
+	std::deque<Slot> slots;
+	std::atomic<std::size_t> pending_count = 0;
+
+	public:
+	explicit TaskGroup(TaskPool &pool) : pool(pool) {}
+	// tasks write to the slots, so they must not outlive the group
+	~TaskGroup() { wait_for_pending(); }
+
+	TaskGroup(const TaskGroup &) = delete;
+	TaskGroup &operator=(const TaskGroup &) = delete;
+
+	/** Submits the task to the pool, its result occupies the next slot. */
+	void run(std::function<int()> task);
+
+	/** Records an already computed result (e.g. of work done inline) in the next slot. */
+	void add_result(const int result) { slots.emplace_back().result = result; }
+
+	/** Blocks until every task of this group has finished, executing pending pool tasks meanwhile.
+	 * Rethrows the first captured exception, if any.
+	 * @return the first non-zero result in submission order, otherwise zero */
+	int wait();
+
+	private:
+	void wait_for_pending();
+};
+
+#endif //DIRSYNC_TASK_POOL_HPP
@@ -1,15 +1,32 @@
 #include "tests.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <compare>
+#include <cstddef>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <span>
 #include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#endif
 
 #include "arguments.hpp"
+#include "checksum.hpp"
+#include "file_metadata.hpp"
 #include "json.hpp"
+#include "manifest.hpp"
 #include "synchronize.hpp"
+#include "wildcards.hpp"
+#include "configuration/configuration-json.hpp"
+#include "configuration/configuration-json-stream.hpp"
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
@@ -46,6 +63,16 @@ bool file_content_equals(const fs::path &file, const std::string &content) {
 	return file_stream.eof() && str_stream.eof();
 }
 
+#if defined(__unix__) || defined(__APPLE__)
+/** The disk space allocated to the file, less than its size if it has holes. */
+std::uintmax_t allocated_size(const fs::path &path) {
+	struct stat status {};
+	const int result = ::stat(path.c_str(), &status);
+	assert(result == 0);
+	return static_cast<std::uintmax_t>(status.st_blocks) * 512;
+}
+#endif
+
 void remove_recursively(const fs::path &path) {
 	std::error_code ec;
 	fs::remove_all(path, ec);
@@ -302,29 +329,1302 @@ class MaxFileSizeTest final : public Test {
 	}
 };
 
-void perform_single_test(Test &test) {
-	test.prepare();
-	test.perform();
-	test.assert_validity();
-	test.cleanup();
-}
+class ParallelOneWayTest final : public Test {
+	static constexpr int directory_count = 8;
 
-int run_tests() {
-	std::cout << "Test 1: simple one-way synchronization with default settings" << std::endl;
-	SimpleOneWayTest test;
-	perform_single_test(test);
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
 
-	std::cout << "Test 2: simple two-way synchronization with default settings" << std::endl;
-	SimpleTwoWayTest test2;
-	perform_single_test(test2);
+		for (int i = 0; i < directory_count; i++) {
+			const fs::path directory = source / ("directory-" + std::to_string(i));
+			create_file(directory / "file.txt", std::to_string(i));
+			create_file(directory / "nested" / "deeper" / "file.txt", std::to_string(i));
+			create_file(directory / "nested" / "excluded.tmp");
+		}
 
-	std::cout << "Test 3: one-way synchronization with conflict renaming" << std::endl;
-	ConflictRenamingTest test3;
-	perform_single_test(test3);
+		const json nested_config = {
+			{
+				"configVersion", {
+					{"major", 0},
+					{"minor", 0},
+					{"patch", 0},
+				}
+			},
+			{"exclusionPatterns", {"*.tmp"}},
+		};
+		std::ofstream file(source / "directory-0" / ".dirsync.json");
+		file << nested_config;
+		file.close();
+	}
 
-	std::cout << "Test 4: too large files are not accepted in target" << std::endl;
-	MaxFileSizeTest test4;
-	perform_single_test(test4);
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_job_count(4);
+
+		const ProgramArguments args = builder.build();
+		result = synchronize_directories(args);
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		for (int i = 0; i < directory_count; i++) {
+			const fs::path directory = target / ("directory-" + std::to_string(i));
+			assert(file_content_equals(directory / "file.txt", std::to_string(i)));
+			assert(file_content_equals(directory / "nested" / "deeper" / "file.txt", std::to_string(i)));
+
+			// the configuration applies only to its own subtree, also when run by another thread
+			assert(fs::exists(directory / "nested" / "excluded.tmp") == (i != 0));
+		}
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class ParallelTwoWayTest final : public Test {
+	static constexpr int directory_count = 8;
+
+	static fs::path directory_name(const int i) {
+		return "directory-" + std::to_string(i);
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		for (int i = 0; i < directory_count; i++) {
+			// common directories with one-sided files and one-sided directories
+			create_file(source / directory_name(i) / "left.txt", "left");
+			create_file(target / directory_name(i) / "right.txt", "right");
+			create_file(source / directory_name(i) / "left-only" / "file.txt", std::to_string(i));
+			create_file(target / directory_name(i) / "right-only" / "file.txt", std::to_string(i));
+		}
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_two_way()
+			.set_job_count(4);
+
+		const ProgramArguments args = builder.build();
+		result = synchronize_directories(args);
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		for (int i = 0; i < directory_count; i++) {
+			for (const fs::path &root : {source, target}) {
+				const fs::path directory = root / directory_name(i);
+				assert(file_content_equals(directory / "left.txt", "left"));
+				assert(file_content_equals(directory / "right.txt", "right"));
+				assert(file_content_equals(directory / "left-only" / "file.txt", std::to_string(i)));
+				assert(file_content_equals(directory / "right-only" / "file.txt", std::to_string(i)));
+			}
+		}
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class PipelinedOneWayTest final : public Test {
+	static constexpr int directory_count = 8;
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		for (int i = 0; i < directory_count; i++) {
+			const fs::path directory = source / ("directory-" + std::to_string(i));
+			create_file(directory / "file.txt", std::to_string(i));
+			create_file(directory / "nested" / "file.txt", std::to_string(i));
+		}
+		create_file(target / "extra.txt");
+		create_file(target / "extra" / "file.txt");
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_pipelined(true)
+			.set_delete_extra(true)
+			.set_job_count(2);
+
+		const ProgramArguments args = builder.build();
+		result = synchronize_directories(args);
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		for (int i = 0; i < directory_count; i++) {
+			const fs::path directory = target / ("directory-" + std::to_string(i));
+			assert(file_content_equals(directory / "file.txt", std::to_string(i)));
+			assert(file_content_equals(directory / "nested" / "file.txt", std::to_string(i)));
+		}
+		assert(!fs::exists(target / "extra.txt"));
+		assert(!fs::exists(target / "extra"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class DeltaTransferTest final : public Test {
+	const fs::path source_file = source / "large.bin";
+	const fs::path target_file = target / "large.bin";
+
+	static std::string pseudo_random_content(const std::size_t size) {
+		std::string content(size, '\0');
+		std::uint32_t state = 12345;
+		for (char &c : content) {
+			state = state * 1103515245 + 12345;
+			c = static_cast<char>(state >> 24);
+		}
+		return content;
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		std::string content = pseudo_random_content(1 << 20);
+		create_file(target_file, content);
+
+		// change, insert and remove a few bytes, so blocks match at shifted offsets
+		content.replace(1000, 10, "changed!!!");
+		content.insert(300000, "inserted");
+		content.erase(700000, 100);
+		std::this_thread::sleep_for(std::chrono::seconds(2));
+		create_file(source_file, content);
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_delta_transfer(true);
+
+		const ProgramArguments args = builder.build();
+		result = synchronize_directories(args);
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+		assert(fs::file_size(source_file) == fs::file_size(target_file));
+		assert(file_equals(source_file, target_file));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class SparseFileTest final : public Test {
+	const fs::path source_file = source / "disk.img";
+	const fs::path target_file = target / "disk.img";
+	static constexpr std::uintmax_t size = 16 * 1024 * 1024;
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+		fs::create_directories(source);
+
+		// data at the start and in the middle, holes in between and at the end
+		{
+			std::ofstream file(source_file, std::ios::binary);
+			file << "boot sector";
+			file.seekp(5 * 1024 * 1024);
+			file << "partition data";
+		}
+		fs::resize_file(source_file, size);
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target);
+
+		const ProgramArguments args = builder.build();
+		result = synchronize_directories(args);
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+		assert(fs::file_size(target_file) == size);
+		assert(file_equals(source_file, target_file));
+#if defined(__unix__) || defined(__APPLE__)
+		// a dense copy would allocate the whole size
+		assert(allocated_size(target_file) < size / 2);
+#endif
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class SparseDeltaTransferTest final : public Test {
+	const fs::path source_file = source / "disk.img";
+	const fs::path target_file = target / "disk.img";
+	static constexpr std::uintmax_t size = 16 * 1024 * 1024;
+
+	void write_image(const std::string &boot_sector) const {
+		{
+			std::ofstream file(source_file, std::ios::binary);
+			file << boot_sector;
+			file.seekp(5 * 1024 * 1024);
+			file << "partition data";
+		}
+		fs::resize_file(source_file, size);
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+		fs::create_directories(source);
+
+		write_image("boot sector");
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target);
+		assert(synchronize_directories(builder.build()) == 0);
+
+		write_image("new boot sector");
+		fs::last_write_time(source_file, fs::last_write_time(target_file) + std::chrono::hours(1));
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_delta_transfer(true);
+
+		const ProgramArguments args = builder.build();
+		result = synchronize_directories(args);
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+		assert(fs::file_size(target_file) == size);
+		assert(file_equals(source_file, target_file));
+#if defined(__unix__) || defined(__APPLE__)
+		// the holes survive the update
+		assert(allocated_size(target_file) < size / 2);
+#endif
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class ManifestTest final : public Test {
+	int second_result = 0;
+	std::uintmax_t first_unchanged_files = 0;
+	std::uintmax_t second_unchanged_files = 0;
+
+	int synchronize_with_manifest(std::uintmax_t &manifest_unchanged_files) const {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_delete_extra(true)
+			.set_manifest(true);
+
+		const ProgramArguments args = builder.build();
+		SynchronizationSession session(args);
+		const int code = synchronize_directories(args, session);
+		manifest_unchanged_files = session.statistics.manifest_unchanged_files.load();
+		return code;
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		create_file(source / "unchanged.txt", "unchanged");
+		create_file(source / "nested" / "changed.txt", "old content");
+	}
+
+	void perform() override {
+		result = synchronize_with_manifest(first_unchanged_files);
+
+		std::this_thread::sleep_for(std::chrono::seconds(2));
+		create_file(source / "nested" / "changed.txt", "new content");
+		// the manifest is trusted, so a target changed out of band is not even looked at
+		create_file(target / "unchanged.txt", "changed out of band");
+		second_result = synchronize_with_manifest(second_unchanged_files);
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+		assert(second_result == 0);
+		assert(fs::exists(target / ".dirsync-manifest"));
+		assert(first_unchanged_files == 0);
+		assert(second_unchanged_files == 1);
+		assert(file_content_equals(target / "unchanged.txt", "changed out of band"));
+		assert(file_equals(source / "nested" / "changed.txt", target / "nested" / "changed.txt"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class DirectoryPruningTest final : public Test {
+	int second_result = 0;
+
+	void write_config(const std::uintmax_t max_file_size) const {
+		const json config = {
+			{
+				"configVersion", {
+					{"major", 0},
+					{"minor", 0},
+					{"patch", 0},
+				}
+			},
+			{"maxFileSize", max_file_size},
+			{"exclusionPatterns", json::array()},
+		};
+		// rewritten in place, the modification time of the directory does not change
+		std::ofstream file(source / ".dirsync.json");
+		file << config;
+	}
+
+	int synchronize_with_pruning() const {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_prune_directories(true);
+
+		const ProgramArguments args = builder.build();
+		return synchronize_directories(args);
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		fs::create_directories(source);
+		write_config(10);
+		create_large_file(source / "nested" / "large.txt", 100);
+		create_file(source / "nested" / "deeper" / "file.txt", "file");
+	}
+
+	void perform() override {
+		result = synchronize_with_pruning();
+
+		// a new entry changes the directory, a changed configuration invalidates the whole subtree
+		create_file(source / "nested" / "deeper" / "new.txt", "new");
+		write_config(1000);
+		second_result = synchronize_with_pruning();
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+		assert(second_result == 0);
+		assert(file_equals(source / "nested" / "deeper" / "new.txt", target / "nested" / "deeper" / "new.txt"));
+		assert(file_equals(source / "nested" / "large.txt", target / "nested" / "large.txt"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class ExclusionPatternTest final : public Test {
+	const std::string long_name = std::string(200, 'a');
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		for (const char *name : {"keep.txt", "debug.log", "tmp-1", "abXcdYab", "abcdab", "abab", "aba"})
+			create_file(source / name, name);
+		create_file(source / "node_modules" / "module.js");
+		create_file(source / long_name);
+
+		const json source_config = {
+			{
+				"configVersion", {
+					{"major", 0},
+					{"minor", 0},
+					{"patch", 0},
+				}
+			},
+			// the last pattern would need exponential backtracking on the long name
+			{"exclusionPatterns", {"*.log", "tmp-*", "node_modules", "ab*cd*ab", "ab*ab", "*a*a*a*a*a*a*a*a*a*a*b"}},
+		};
+		std::ofstream file(source / ".dirsync.json");
+		file << source_config;
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source);
+		builder.set_target_directory(target);
+
+		result = synchronize_directories(builder.build());
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		assert(fs::exists(target / "keep.txt"));
+		assert(fs::exists(target / "aba"));
+		assert(fs::exists(target / long_name));
+		for (const char *name : {"debug.log", "tmp-1", "node_modules", "abXcdYab", "abcdab", "abab"})
+			assert(!fs::exists(target / name));
+
+		assert(wildcard_matches("", ""));
+		assert(!wildcard_matches("", "a"));
+		assert(wildcard_matches("*", ""));
+		assert(wildcard_matches("**", "x"));
+		assert(wildcard_matches("a*", "a"));
+		assert(!wildcard_matches("*a", ""));
+		assert(wildcard_matches("*aab", "aaab"));
+		assert(!wildcard_matches("a*a", "a"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class GitignorePatternTest final : public Test {
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		for (const char *path : {
+			"build/cache/a", "build/x/cache/b", "build/x/kept.txt",
+			"sub/debug.log", "sub/keep.log", "tmp/c", "sub/tmp", "top.txt", "sub/top.txt"
+		})
+			create_file(source / path, path);
+
+		const json source_config = {
+			{
+				"configVersion", {
+					{"major", 0},
+					{"minor", 0},
+					{"patch", 0},
+				}
+			},
+			{"patternSyntax", "gitignore"},
+			{"exclusionPatterns", {"# build caches", "build/**/cache", "*.log", "!keep.log", "tmp/", "/top.txt"}},
+		};
+		std::ofstream file(source / ".dirsync.json");
+		file << source_config;
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source);
+		builder.set_target_directory(target);
+
+		result = synchronize_directories(builder.build());
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		for (const char *path : {"build/x/kept.txt", "sub/keep.log", "sub/tmp", "sub/top.txt"})
+			assert(fs::exists(target / path));
+		for (const char *path : {"build/cache", "build/x/cache", "sub/debug.log", "tmp", "top.txt"})
+			assert(!fs::exists(target / path));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class OpposingConfigurationsTest final : public Test {
+	static json gitignore_configuration(const std::vector<std::string> &patterns) {
+		return {
+			{
+				"configVersion", {
+					{"major", 0},
+					{"minor", 0},
+					{"patch", 0},
+				}
+			},
+			{"patternSyntax", "gitignore"},
+			{"exclusionPatterns", patterns},
+		};
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		for (const char *name : {"keep.log", "keep.tmp", "other.txt"})
+			create_file(source / name, name);
+		fs::create_directories(target);
+
+		// a negation on one side must not override an exclusion on the other
+		std::ofstream source_file(source / ".dirsync.json");
+		source_file << gitignore_configuration({"*.log", "!keep.tmp"});
+		std::ofstream target_file(target / ".dirsync.json");
+		target_file << gitignore_configuration({"*.tmp", "!keep.log"});
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source);
+		builder.set_target_directory(target);
+
+		result = synchronize_directories(builder.build());
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		assert(fs::exists(target / "other.txt"));
+		assert(!fs::exists(target / "keep.log"));
+		assert(!fs::exists(target / "keep.tmp"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class TwoWayGitignorePatternTest final : public Test {
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		create_file(source / "build" / "x" / "cache" / "left");
+		create_file(source / "build" / "x" / "kept.txt", "kept");
+		create_file(target / "build" / "x" / "cache" / "right");
+
+		// the pattern of the root configuration applies to the directories below as well
+		const json source_config = {
+			{
+				"configVersion", {
+					{"major", 0},
+					{"minor", 0},
+					{"patch", 0},
+				}
+			},
+			{"patternSyntax", "gitignore"},
+			{"exclusionPatterns", {"build/**/cache"}},
+		};
+		std::ofstream file(source / ".dirsync.json");
+		file << source_config;
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_two_way();
+
+		result = synchronize_directories(builder.build());
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		assert(file_content_equals(target / "build" / "x" / "kept.txt", "kept"));
+		assert(!fs::exists(target / "build" / "x" / "cache" / "left"));
+		assert(!fs::exists(source / "build" / "x" / "cache" / "right"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class ConfigurationCacheTest final : public Test {
+	const fs::path cache_file = common_parent / "configuration-cache";
+
+	void write_config(const std::string &excluded) const {
+		const json config = {
+			{
+				"configVersion", {
+					{"major", 0},
+					{"minor", 0},
+					{"patch", 0},
+				}
+			},
+			{"exclusionPatterns", {excluded}},
+		};
+		std::ofstream file(source / "nested" / ".dirsync.json");
+		file << config;
+	}
+
+	int synchronize_with_cache() const {
+		remove_recursively(target);
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source);
+		builder.set_target_directory(target);
+		builder.set_config_cache(true, cache_file.string());
+		return synchronize_directories(builder.build());
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+		remove_recursively(cache_file);
+
+		create_file(source / "nested" / "first.txt", "first");
+		create_file(source / "nested" / "second.txt", "second");
+		write_config("first.txt");
+	}
+
+	void perform() override {
+		result = synchronize_with_cache();
+		assert(result == 0);
+		assert(fs::exists(cache_file));
+		assert(!fs::exists(target / "nested" / "first.txt"));
+
+		// served from the cache
+		result = synchronize_with_cache();
+		assert(result == 0);
+		assert(!fs::exists(target / "nested" / "first.txt"));
+
+		// a changed configuration is parsed again
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		write_config("second.txt");
+		result = synchronize_with_cache();
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+		assert(fs::exists(target / "nested" / "first.txt"));
+		assert(!fs::exists(target / "nested" / "second.txt"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+		remove_recursively(cache_file);
+	}
+};
+
+class StreamingConfigurationReaderTest final : public Test {
+	const fs::path config_file = common_parent / ".dirsync.json";
+
+	/** Reads the document with both readers and compares the results, including the parsed configurations. */
+	static bool readers_agree(const fs::path &file_path) {
+		const ProgramArguments arguments = ProgramArgumentsBuilder().build();
+		const DirectoryConfigurationReadResult expected = JsonDirConfigReader().read_from_file(file_path, arguments);
+		const DirectoryConfigurationReadResult actual = StreamingJsonDirConfigReader().read_from_file(file_path, arguments);
+		if (expected.index() != actual.index()) return false;
+
+		const DirectoryConfiguration *expected_config = std::get_if<DirectoryConfiguration>(&expected);
+		if (expected_config == nullptr) return true;
+		std::string expected_encoding, actual_encoding;
+		expected_config->encode(expected_encoding);
+		std::get<DirectoryConfiguration>(actual).encode(actual_encoding);
+		return expected_encoding == actual_encoding;
+	}
+
+	public:
+	void prepare() override {
+		fs::create_directories(common_parent);
+	}
+
+	void perform() override {
+		const char *version = R"("configVersion": {"major": 0, "minor": 0, "patch": 0})";
+		const std::vector<std::string> documents = {
+			std::string("{") + version + R"(, "exclusionPatterns": ["*.log", "caf\u00e9"], "maxFileSize": 100})",
+			std::string("{") + version + R"(, "exclusionPatterns": ["build/"], "patternSyntax": "gitignore", "other": [{}, null]})",
+			std::string("{") + version + R"(, "exclusionPatterns": ["a"], "exclusionPatterns": ["b"], "maxFileSize": 1.5})",
+			R"({"exclusionPatterns": [], "configVersion": {"major": 1, "minor": 0, "patch": 0}})",
+			R"({"configVersion": {"major": 0, "minor": 0, "patch": true}, "exclusionPatterns": []})",
+			std::string("{") + version + R"(, "exclusionPatterns": [1]})",
+			std::string("{") + version + R"(, "exclusionPatterns": [], "patternSyntax": "regex"})",
+			std::string("{") + version + R"(, "exclusionPatterns": ["\ud800"]})",
+			std::string("{") + version + R"(, "exclusionPatterns": []} [])",
+			std::string("{") + version + "}",
+			"",
+		};
+
+		result = 0;
+		for (const std::string &document : documents) {
+			create_file(config_file, document);
+			if (!readers_agree(config_file)) result = 1;
+		}
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+	}
+
+	void cleanup() override {
+		remove_recursively(config_file);
+	}
+};
+
+class PreservedModificationTimeTest final : public Test {
+	const fs::path source_file = source / "nested" / "file.txt";
+	const fs::path target_file = target / "nested" / "file.txt";
+	// whole seconds are kept by any filesystem
+	const fs::file_time_type written_at =
+		std::chrono::floor<std::chrono::seconds>(fs::file_time_type::clock::now() - std::chrono::hours(1));
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		create_file(source_file, old_version_content);
+		fs::last_write_time(source_file, written_at);
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source);
+		builder.set_target_directory(target);
+		result = synchronize_directories(builder.build());
+		assert(result == 0);
+		assert(fs::last_write_time(target_file) == written_at);
+
+		// the copy compares equal, so a two-way run leaves both files alone
+		create_file(target_file, new_version_content);
+		fs::last_write_time(target_file, written_at);
+		builder.set_two_way();
+		result = synchronize_directories(builder.build());
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+		assert(file_content_equals(source_file, old_version_content));
+		assert(file_content_equals(target_file, new_version_content));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class TimestampGranularityTest final : public Test {
+	static fs::file_time_type at(const std::chrono::nanoseconds since_epoch) {
+		const std::chrono::sys_time<std::chrono::nanoseconds> time{since_epoch};
+		return std::chrono::file_clock::from_sys(std::chrono::time_point_cast<fs::file_time_type::duration>(time));
+	}
+
+	fs::file_time_type::duration probed {};
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		fs::create_directories(source);
+	}
+
+	void perform() override {
+		probed = probe_timestamp_granularity(source, true);
+	}
+
+	void assert_validity() override {
+		using namespace std::chrono_literals;
+		assert(probed > fs::file_time_type::duration::zero() && probed <= 2s);
+		// the probe file is removed
+		assert(fs::is_empty(source));
+
+		assert(timestamp_granularity_of(at(1700000000s)) == 2s);
+		assert(timestamp_granularity_of(at(1700000001s)) == 1s);
+		assert(timestamp_granularity_of(at(1700000001s + 990ms)) == 10ms);
+		assert(timestamp_granularity_of(at(1700000001s + 999999900ns)) == 100ns);
+
+		// a FAT copy of a file is equal to its source, but not a file written 2 seconds later
+		const fs::file_time_type written = at(1700000001s + 500ms);
+		assert(compare_modification_times(written, at(1700000000s), 2s) == std::weak_ordering::equivalent);
+		assert(compare_modification_times(at(1700000002s), written, 2s) == std::weak_ordering::equivalent);
+		assert(compare_modification_times(at(1700000004s), written, 2s) == std::weak_ordering::greater);
+		assert(compare_modification_times(written, written + 1ns, 1ns) == std::weak_ordering::less);
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+	}
+};
+
+class WholeSecondSourceTest final : public Test {
+	// e.g. extracted from an archive, which keeps whole seconds
+	const fs::file_time_type whole_second = fs::file_time_type(
+		std::chrono::duration_cast<fs::file_time_type::duration>(
+			std::chrono::floor<std::chrono::seconds>(fs::file_time_type::clock::now().time_since_epoch())
+		)
+	) - std::chrono::hours(1);
+
+	int synchronize() const {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target);
+		return synchronize_directories(builder.build());
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		for (int i = 0; i < 20; i++) {
+			const fs::path file = source / ("file-" + std::to_string(i) + ".txt");
+			create_file(file, "old");
+			fs::last_write_time(file, whole_second);
+		}
+		fs::last_write_time(source, whole_second);
+		assert(synchronize() == 0);
+
+		// the target copy is edited, then the source one a moment later, both within the same second
+		create_file(target / "file-0.txt", "edited");
+		fs::last_write_time(target / "file-0.txt", whole_second + std::chrono::milliseconds(300));
+		create_file(source / "file-0.txt", "new");
+		fs::last_write_time(source / "file-0.txt", whole_second + std::chrono::seconds(1));
+		fs::last_write_time(source, whole_second);
+	}
+
+	void perform() override {
+		result = synchronize();
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		// the tolerance follows the target filesystem, not the coarse times of the source
+		assert(file_content_equals(target / "file-0.txt", "new"));
+		assert(file_content_equals(target / "file-1.txt", "old"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class SynchronizationStateTest final : public Test {
+	const fs::path state_file = common_parent / "state";
+
+	int synchronize() const {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_two_way()
+			.set_state(true, state_file);
+		return synchronize_directories(builder.build());
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+		remove_recursively(state_file);
+
+		create_file(source / "deleted.txt", "deleted on the right");
+		create_file(source / "directory" / "file.txt", "deleted with its directory on the left");
+		create_file(source / "edited.txt", old_version_content);
+		create_file(target / "kept.txt", "kept");
+		assert(synchronize() == 0);
+
+		fs::remove(target / "deleted.txt");
+		remove_recursively(source / "directory");
+
+		// the edit wins although its time is older than the last write time of the other copy
+		create_file(target / "edited.txt", new_version_content);
+		fs::last_write_time(target / "edited.txt", fs::last_write_time(source / "edited.txt") - std::chrono::hours(1));
+	}
+
+	void perform() override {
+		result = synchronize();
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		for (const fs::path &root : {source, target}) {
+			assert(!fs::exists(root / "deleted.txt"));
+			assert(!fs::exists(root / "directory"));
+			assert(file_content_equals(root / "edited.txt", new_version_content));
+			assert(file_content_equals(root / "kept.txt", "kept"));
+		}
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+		remove_recursively(state_file);
+	}
+};
+
+class StateExclusionTest final : public Test {
+	const fs::path state_file = common_parent / "state";
+
+	int synchronize() const {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_two_way()
+			.set_state(true, state_file);
+		return synchronize_directories(builder.build());
+	}
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+		remove_recursively(state_file);
+
+		const json source_config = {
+			{
+				"configVersion", {
+					{"major", 0},
+					{"minor", 0},
+					{"patch", 0},
+				}
+			},
+			{"exclusionPatterns", json::array()},
+			{"maxFileSize", 100},
+		};
+		fs::create_directories(source);
+		std::ofstream file(source / ".dirsync.json");
+		file << source_config;
+		file.close();
+
+		create_file(source / "file.txt", "small");
+		fs::create_directories(target);
+		assert(synchronize() == 0);
+		assert(file_content_equals(target / "file.txt", "small"));
+
+		// excluded on the left by its size from now on, which is not a deletion
+		create_large_file(source / "file.txt", 300);
+	}
+
+	void perform() override {
+		result = synchronize();
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		assert(fs::file_size(source / "file.txt") == 300);
+		assert(file_content_equals(target / "file.txt", "small"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+		remove_recursively(state_file);
+	}
+};
+
+class ChangedEntriesTest final : public Test {
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		create_file(source / "changed.txt", "changed");
+		create_file(source / "unchanged.txt", "unchanged");
+		create_file(source / "new-directory" / "file.txt", "new");
+		create_file(source / "directory" / "changed.txt", "changed");
+		create_file(source / "directory" / "unchanged.txt", "unchanged");
+		fs::create_directories(target / "directory");
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source);
+		builder.set_target_directory(target);
+		const ProgramArguments args = builder.build();
+
+		ChangedDirectory root;
+		root.names = {"changed.txt", "new-directory"};
+		ChangedDirectory directory;
+		directory.relative_path = "directory";
+		directory.names = {"changed.txt"};
+
+		SynchronizationSession session(args);
+		result = synchronize_changes(args, session, {root, directory});
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+
+		assert(file_content_equals(target / "changed.txt", "changed"));
+		assert(file_content_equals(target / "new-directory" / "file.txt", "new"));
+		assert(file_content_equals(target / "directory" / "changed.txt", "changed"));
+		// only the changed entries are synchronized
+		assert(!fs::exists(target / "unchanged.txt"));
+		assert(!fs::exists(target / "directory" / "unchanged.txt"));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class ChangedEntriesManifestTest final : public Test {
+	int changes_result = 0;
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		create_file(source / "unchanged.txt", "unchanged");
+		create_file(source / "directory" / "changed.txt", "old");
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_manifest(true);
+		const ProgramArguments args = builder.build();
+		result = synchronize_directories(args);
+
+		create_file(source / "directory" / "changed.txt", "new content");
+		ChangedDirectory directory;
+		directory.relative_path = "directory";
+		directory.names = {"changed.txt"};
+
+		SynchronizationSession session(args);
+		changes_result = synchronize_changes(args, session, {directory});
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+		assert(changes_result == 0);
+
+		// the record of the changed file is replaced, the others are carried over
+		const TargetManifest manifest(target);
+		const ManifestRecord *changed = manifest.find("directory/changed.txt");
+		assert(changed != nullptr && changed->size == fs::file_size(source / "directory" / "changed.txt"));
+		assert(manifest.find("unchanged.txt") != nullptr);
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+class ChecksumComparisonTest final : public Test {
+	// whole seconds are kept by any filesystem
+	const fs::file_time_type written_at =
+		std::chrono::floor<std::chrono::seconds>(fs::file_time_type::clock::now() - std::chrono::hours(1));
+	std::uintmax_t comparisons = 0;
+
+	public:
+	void prepare() override {
+		remove_recursively(source);
+		remove_recursively(target);
+
+		// touched, the newer source is identical
+		create_file(source / "touched.txt", old_version_content);
+		create_file(target / "touched.txt", old_version_content);
+		fs::last_write_time(source / "touched.txt", written_at + std::chrono::minutes(1));
+		fs::last_write_time(target / "touched.txt", written_at);
+
+		// changed keeping the size and the last write time
+		create_file(source / "same-time.txt", new_version_content);
+		create_file(target / "same-time.txt", old_version_content);
+		fs::last_write_time(source / "same-time.txt", written_at);
+		fs::last_write_time(target / "same-time.txt", written_at);
+
+		// differing in the last byte only, after several chunks
+		create_large_file(source / "large.txt", 3 << 20);
+		create_large_file(target / "large.txt", 3 << 20);
+		{
+			std::fstream file(source / "large.txt", std::ios::in | std::ios::out | std::ios::binary);
+			file.seekp(-1, std::ios::end);
+			file.put('y');
+		}
+		fs::last_write_time(source / "large.txt", written_at);
+		fs::last_write_time(target / "large.txt", written_at);
+	}
+
+	void perform() override {
+		ProgramArgumentsBuilder builder;
+		builder.set_source_directory(source)
+			.set_target_directory(target)
+			.set_checksum(true);
+		const ProgramArguments args = builder.build();
+
+		SynchronizationSession session(args);
+		result = synchronize_directories(args, session);
+		comparisons = session.statistics.checksum_comparisons.load();
+	}
+
+	void assert_validity() override {
+		assert(result == 0);
+		assert(comparisons == 3);
+
+		assert(fs::last_write_time(target / "touched.txt") == written_at);
+		assert(file_content_equals(target / "same-time.txt", new_version_content));
+		assert(file_equals(source / "large.txt", target / "large.txt"));
+
+		// the digest does not depend on how the data is split
+		const std::string content = "a string longer than a single stripe of sixty-four bytes, in several parts";
+		const std::span<const std::byte> bytes = std::as_bytes(std::span(content));
+		ContentHasher whole, parts;
+		whole.update(bytes);
+		for (std::size_t i = 0; i < bytes.size(); i += 5)
+			parts.update(bytes.subspan(i, std::min<std::size_t>(5, bytes.size() - i)));
+		assert(whole.digest() == parts.digest());
+		assert(whole.has_equal_state(parts));
+	}
+
+	void cleanup() override {
+		remove_recursively(source);
+		remove_recursively(target);
+	}
+};
+
+void perform_single_test(Test &test) {
+	test.prepare();
+	test.perform();
+	test.assert_validity();
+	test.cleanup();
+}
+
+int run_tests() {
+	std::cout << "Test 1: simple one-way synchronization with default settings" << std::endl;
+	SimpleOneWayTest test;
+	perform_single_test(test);
+
+	std::cout << "Test 2: simple two-way synchronization with default settings" << std::endl;
+	SimpleTwoWayTest test2;
+	perform_single_test(test2);
+
+	std::cout << "Test 3: one-way synchronization with conflict renaming" << std::endl;
+	ConflictRenamingTest test3;
+	perform_single_test(test3);
+
+	std::cout << "Test 4: too large files are not accepted in target" << std::endl;
+	MaxFileSizeTest test4;
+	perform_single_test(test4);
+
+	std::cout << "Test 5: parallel one-way synchronization" << std::endl;
+	ParallelOneWayTest test5;
+	perform_single_test(test5);
+
+	std::cout << "Test 6: parallel two-way synchronization" << std::endl;
+	ParallelTwoWayTest test6;
+	perform_single_test(test6);
+
+	std::cout << "Test 7: pipelined one-way synchronization" << std::endl;
+	PipelinedOneWayTest test7;
+	perform_single_test(test7);
+
+	std::cout << "Test 8: delta transfer of a modified large file" << std::endl;
+	DeltaTransferTest test8;
+	perform_single_test(test8);
+
+	std::cout << "Test 9: sparse file copying" << std::endl;
+	SparseFileTest test9;
+	perform_single_test(test9);
+
+	std::cout << "Test 10: incremental run with a target manifest" << std::endl;
+	ManifestTest test10;
+	perform_single_test(test10);
+
+	std::cout << "Test 11: pruning of unchanged source directories" << std::endl;
+	DirectoryPruningTest test11;
+	perform_single_test(test11);
+
+	std::cout << "Test 12: exclusion patterns with wildcards" << std::endl;
+	ExclusionPatternTest test12;
+	perform_single_test(test12);
+
+	std::cout << "Test 13: exclusion patterns in the gitignore syntax" << std::endl;
+	GitignorePatternTest test13;
+	perform_single_test(test13);
+
+	std::cout << "Test 14: cache of parsed directory configurations" << std::endl;
+	ConfigurationCacheTest test14;
+	perform_single_test(test14);
+
+	std::cout << "Test 15: streaming reader of directory configurations" << std::endl;
+	StreamingConfigurationReaderTest test15;
+	perform_single_test(test15);
+
+	std::cout << "Test 16: modification times are preserved by copying" << std::endl;
+	PreservedModificationTimeTest test16;
+	perform_single_test(test16);
+
+	std::cout << "Test 17: timestamp granularity of the filesystem" << std::endl;
+	TimestampGranularityTest test17;
+	perform_single_test(test17);
+
+	std::cout << "Test 18: two-way synchronization with the state of the last run" << std::endl;
+	SynchronizationStateTest test18;
+	perform_single_test(test18);
+
+	std::cout << "Test 19: synchronization of the changed entries only" << std::endl;
+	ChangedEntriesTest test19;
+	perform_single_test(test19);
+
+	std::cout << "Test 20: comparison of file contents by checksums" << std::endl;
+	ChecksumComparisonTest test20;
+	perform_single_test(test20);
+
+	std::cout << "Test 21: delta update of a sparse file" << std::endl;
+	SparseDeltaTransferTest test21;
+	perform_single_test(test21);
+
+	std::cout << "Test 22: two-way synchronization with exclusion patterns in the gitignore syntax" << std::endl;
+	TwoWayGitignorePatternTest test22;
+	perform_single_test(test22);
+
+	std::cout << "Test 23: synchronization of the changed entries with a target manifest" << std::endl;
+	ChangedEntriesManifestTest test23;
+	perform_single_test(test23);
+
+	std::cout << "Test 24: exclusion by the source configuration despite a negation in the target one" << std::endl;
+	OpposingConfigurationsTest test24;
+	perform_single_test(test24);
+
+	std::cout << "Test 25: two-way synchronization with a state of a file excluded on one side" << std::endl;
+	StateExclusionTest test25;
+	perform_single_test(test25);
+
+	std::cout << "Test 26: one-way synchronization of a source with whole-second last write times" << std::endl;
+	WholeSecondSourceTest test26;
+	perform_single_test(test26);
 
 	return 0;
 }
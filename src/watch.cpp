@@ -0,0 +1,349 @@
+#include "watch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "file_descriptor.hpp"
+#endif
+
+#include "constants.hpp"
+#include "synchronize.hpp"
+#include "configuration/configuration.hpp"
+
+namespace fs = std::filesystem;
+
+#if defined(__linux__)
+namespace {
+	constexpr std::uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+		| IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+	/** A batch of changes is closed after this many debounce windows, even if the changes keep coming. */
+	constexpr int MAXIMUM_DEBOUNCE_WINDOWS = 10;
+
+	constexpr std::size_t EVENT_BUFFER_SIZE = 64 * 1024;
+
+	/** The changed entries by their directory. Parent directories are sorted before their subdirectories. */
+	using ChangeSet = std::map<std::string, ChangedDirectory>;
+
+	std::string join(const std::string &directory, const std::string &name) {
+		if (directory.empty()) return name;
+		return directory + '/' + name;
+	}
+
+	ChangedDirectory &changed_directory(ChangeSet &changes, const std::string &relative_path) {
+		ChangedDirectory &directory = changes[relative_path];
+		directory.relative_path = relative_path;
+		return directory;
+	}
+
+	/** Watches directory trees by inotify, collecting the changed entries by their paths relative to the roots,
+	 * so the changes of both trees of two-way synchronization are merged. */
+	class TreeWatcher {
+		struct WatchedDirectory {
+			std::size_t root;
+			std::string relative_path;
+		};
+
+		UniqueDescriptor fd;
+		std::error_code initialization_error;
+		std::vector<fs::path> roots;
+		std::unordered_map<int, WatchedDirectory> watched;
+
+		std::error_code add_directory(const std::size_t root, const std::string &relative_path) {
+			const fs::path path = relative_path.empty() ? roots[root] : roots[root] / relative_path;
+			const int watch_descriptor = ::inotify_add_watch(fd.get(), path.c_str(), WATCH_MASK);
+			if (watch_descriptor < 0) return last_error();
+			// a moved directory keeps its watch descriptor, the path is updated
+			watched[watch_descriptor] = {root, relative_path};
+			return {};
+		}
+
+		/** Watches the directory and every directory below it. Subdirectories which cannot be watched
+		 * (e.g. removed in the meantime) are skipped, unless the watch limit was reached. */
+		std::error_code add_tree(const std::size_t root, const std::string &relative_path) {
+			std::error_code error = add_directory(root, relative_path);
+			if (error) return error;
+
+			const fs::path directory = relative_path.empty() ? roots[root] : roots[root] / relative_path;
+			std::error_code iteration_error;
+			for (
+				fs::recursive_directory_iterator iterator(directory, fs::directory_options::skip_permission_denied, iteration_error), end;
+				!iteration_error && iterator != end;
+				iterator.increment(iteration_error)
+			) {
+				std::error_code status_error;
+				if (iterator->symlink_status(status_error).type() != fs::file_type::directory) continue;
+
+				const std::string subdirectory = join(relative_path, iterator->path().lexically_relative(directory).generic_string());
+				error = add_directory(root, subdirectory);
+				if (error == std::errc::no_space_on_device) return error;
+			}
+			return {};
+		}
+
+		std::error_code handle_event(const inotify_event &event, ChangeSet &changes) {
+			if (event.mask & IN_Q_OVERFLOW) {
+				// events were lost, everything is synchronized
+				changed_directory(changes, "").all_entries = true;
+				return {};
+			}
+
+			const auto found = watched.find(event.wd);
+			if (found == watched.end()) return {};
+			const WatchedDirectory directory = found->second;
+
+			if (event.mask & IN_IGNORED) {
+				watched.erase(found);
+				return {};
+			}
+			if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+				// other directories are reported as changed entries of their parents
+				if (directory.relative_path.empty()) return std::make_error_code(std::errc::no_such_file_or_directory);
+				return {};
+			}
+			// an event of the watched directory itself, e.g. changed attributes
+			if (event.len == 0) return {};
+
+			const std::string name = event.name;
+			ChangedDirectory &changed = changed_directory(changes, directory.relative_path);
+			changed.names.insert(name);
+			// the rules of the whole directory may have changed
+			if (is_config_file(name)) changed.all_entries = true;
+
+			if ((event.mask & IN_ISDIR) && (event.mask & (IN_CREATE | IN_MOVED_TO))) {
+				const std::error_code error = add_tree(directory.root, join(directory.relative_path, name));
+				if (error == std::errc::no_space_on_device) return error;
+			}
+			return {};
+		}
+
+		public:
+		TreeWatcher() : fd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {
+			if (!fd.valid()) initialization_error = last_error();
+		}
+
+		int descriptor() const { return fd.get(); }
+
+		/** Watches the root directory tree. */
+		std::error_code add_root(const fs::path &root) {
+			if (initialization_error) return initialization_error;
+			roots.push_back(root);
+			return add_tree(roots.size() - 1, "");
+		}
+
+		/** Reads the pending events into the change set.
+		 * @return an error, e.g. when a root was removed or the watch limit was reached */
+		std::error_code read_events(ChangeSet &changes) {
+			alignas(inotify_event) static thread_local char buffer[EVENT_BUFFER_SIZE];
+			while (true) {
+				const ssize_t length = ::read(fd.get(), buffer, sizeof(buffer));
+				if (length < 0) {
+					if (errno == EINTR) continue;
+					if (errno == EAGAIN) return {};
+					return last_error();
+				}
+
+				for (ssize_t offset = 0; offset < length;) {
+					const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+					offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+					const std::error_code error = handle_event(*event, changes);
+					if (error) return error;
+				}
+			}
+		}
+	};
+
+	/** Waits for the first change, then collects changes until none arrives within the debounce window.
+	 * @param interrupted output parameter, whether SIGINT or SIGTERM was received instead */
+	std::error_code wait_for_changes(
+		TreeWatcher &watcher,
+		const int signal_descriptor,
+		const std::chrono::milliseconds debounce,
+		ChangeSet &changes,
+		bool &interrupted
+	) {
+		using clock = std::chrono::steady_clock;
+		std::optional<clock::time_point> first_change, last_change;
+
+		while (true) {
+			int timeout = -1;
+			if (first_change.has_value()) {
+				const clock::time_point deadline = std::min(
+					*last_change + debounce,
+					*first_change + MAXIMUM_DEBOUNCE_WINDOWS * debounce
+				);
+				const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now());
+				if (remaining.count() <= 0) return {};
+				timeout = static_cast<int>(remaining.count());
+			}
+
+			pollfd descriptors[2] = {{watcher.descriptor(), POLLIN, 0}, {signal_descriptor, POLLIN, 0}};
+			if (::poll(descriptors, 2, timeout) < 0) {
+				if (errno == EINTR) continue;
+				return last_error();
+			}
+
+			if (descriptors[1].revents & POLLIN) {
+				interrupted = true;
+				return {};
+			}
+			if (descriptors[0].revents & POLLIN) {
+				const std::error_code error = watcher.read_events(changes);
+				if (error) return error;
+				// e.g. only attribute changes of the watched directories themselves
+				if (changes.empty()) continue;
+
+				last_change = clock::now();
+				if (!first_change.has_value()) first_change = last_change;
+			}
+		}
+	}
+
+	/** Whether the directory exists in both roots. */
+	bool exists_in_roots(const std::vector<fs::path> &roots, const std::string &relative_path) {
+		std::error_code error;
+		return std::ranges::all_of(roots, [&](const fs::path &root) {
+			return fs::is_directory(root / relative_path, error);
+		});
+	}
+
+	/** Whether the directory is synchronized as (a part of) a changed entry of one of its parents. */
+	bool is_within_changed_entry(const ChangeSet &changes, const std::string &relative_path) {
+		for (std::size_t start = 0;;) {
+			const std::size_t slash = relative_path.find('/', start);
+			const std::string parent = start == 0 ? std::string() : relative_path.substr(0, start - 1);
+			const std::string name = relative_path.substr(start, slash == std::string::npos ? slash : slash - start);
+
+			const auto found = changes.find(parent);
+			if (found != changes.end() && found->second.contains(name)) return true;
+			if (slash == std::string::npos) return false;
+			start = slash + 1;
+		}
+	}
+
+	/** Turns the collected changes into the directories to synchronize, parents first. A changed directory
+	 * missing on one side becomes a changed entry of its nearest parent existing on both sides.
+	 * @param skip_nested whether directories within a changed entry of their parent are left out,
+	 * since the parent synchronizes their whole subtree (not with `--prune`, which may skip them) */
+	std::vector<ChangedDirectory> resolve_changes(
+		const ChangeSet &changes,
+		const std::vector<fs::path> &roots,
+		const bool skip_nested
+	) {
+		ChangeSet resolved;
+		for (const auto &[relative_path, directory] : changes) {
+			ChangedDirectory current = directory;
+			while (!current.relative_path.empty() && !exists_in_roots(roots, current.relative_path)) {
+				const fs::path path(current.relative_path);
+				ChangedDirectory parent;
+				parent.relative_path = path.parent_path().generic_string();
+				parent.names.insert(path.filename().string());
+				current = std::move(parent);
+			}
+
+			ChangedDirectory &merged = changed_directory(resolved, current.relative_path);
+			merged.all_entries = merged.all_entries || current.all_entries;
+			merged.names.insert(current.names.begin(), current.names.end());
+		}
+
+		std::vector<ChangedDirectory> directories;
+		for (const auto &[relative_path, directory] : resolved) {
+			if (skip_nested && !relative_path.empty() && is_within_changed_entry(resolved, relative_path)) continue;
+			directories.push_back(directory);
+		}
+		return directories;
+	}
+}
+#endif
+
+int watch_directories(const ProgramArguments &arguments) {
+#if defined(__linux__)
+	const fs::path source_path = arguments.get_source_path();
+	const fs::path target_path = arguments.get_target_path();
+
+	// the trees are watched before the first run, so no change made during it is missed
+	TreeWatcher watcher;
+	std::error_code watch_error = watcher.add_root(source_path);
+	if (!watch_error && !arguments.is_one_way()) watch_error = watcher.add_root(target_path);
+	if (watch_error) {
+		std::cerr << "Error: Failed to watch the directories. " << watch_error.message() << std::endl;
+		if (watch_error == std::errc::no_such_file_or_directory || watch_error == std::errc::not_a_directory)
+			return EXIT_CODE_NONEXISTENT_SOURCE_DIRECTORY;
+		return EXIT_CODE_FILESYSTEM_ERROR;
+	}
+
+	fs::file_time_type::duration timestamp_tolerance;
+	{
+		SynchronizationSession session(arguments);
+		const int error = synchronize_directories(arguments, session);
+		if (error) return error;
+		// the roots are not probed again, the probe files would be reported as changes
+		timestamp_tolerance = session.timestamp_tolerance;
+	}
+
+	// the signals are received by the loop, so a synchronization of changes is never interrupted halfway
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	if (::pthread_sigmask(SIG_BLOCK, &signals, nullptr) != 0) return EXIT_CODE_FILESYSTEM_ERROR;
+	const UniqueDescriptor signal_descriptor(::signalfd(-1, &signals, SFD_CLOEXEC));
+	if (!signal_descriptor.valid()) {
+		std::cerr << "Error: Failed to watch the directories. " << last_error().message() << std::endl;
+		return EXIT_CODE_FILESYSTEM_ERROR;
+	}
+
+	const std::chrono::milliseconds debounce(arguments.get_watch_debounce_milliseconds());
+	const std::vector<fs::path> roots = {source_path, target_path};
+	if (arguments.is_verbose()) std::cout << "Watching for changes" << std::endl;
+
+	while (true) {
+		ChangeSet changes;
+		bool interrupted = false;
+		watch_error = wait_for_changes(watcher, signal_descriptor.get(), debounce, changes, interrupted);
+		if (watch_error == std::errc::no_such_file_or_directory) {
+			std::cerr << "Error: A synchronized directory was removed or moved." << std::endl;
+			return EXIT_CODE_NONEXISTENT_SOURCE_DIRECTORY;
+		}
+		if (watch_error == std::errc::no_space_on_device) {
+			std::cerr << "Error: Failed to watch new directories, the inotify watch limit"
+				<< " (fs.inotify.max_user_watches) was reached." << std::endl;
+			return EXIT_CODE_FILESYSTEM_ERROR;
+		}
+		if (watch_error) {
+			std::cerr << "Error: Failed to watch the directories. " << watch_error.message() << std::endl;
+			return EXIT_CODE_FILESYSTEM_ERROR;
+		}
+		if (interrupted) return 0;
+
+		const std::vector<ChangedDirectory> directories = resolve_changes(
+			changes, roots, !arguments.prunes_directories()
+		);
+		if (directories.empty()) continue;
+
+		SynchronizationSession session(arguments);
+		session.timestamp_tolerance = timestamp_tolerance;
+		if (synchronize_changes(arguments, session, directories) != 0)
+			std::cerr << "Warning: The changes were not synchronized completely, watching continues." << std::endl;
+	}
+#else
+	std::cerr << "Error: --watch is only supported on Linux." << std::endl;
+	return EXIT_CODE_INCORRECT_USAGE;
+#endif
+}
@@ -0,0 +1,13 @@
+#ifndef DIRSYNC_WATCH_HPP
+#define DIRSYNC_WATCH_HPP
+
+#include "arguments.hpp"
+
+/** Synchronizes the directories, then keeps them synchronized until interrupted (`--watch`).
+ * The source tree (and the target tree in two-way mode) is watched by inotify from before the first run,
+ * changes are collected until none arrives within the debounce window, and only the changed entries
+ * are synchronized, see `synchronize_changes`. Linux only.
+ * @return An error code of the first run or of the watch itself; zero after SIGINT or SIGTERM. */
+int watch_directories(const ProgramArguments &arguments);
+
+#endif //DIRSYNC_WATCH_HPP
@@ -1,58 +1,84 @@
 #include "wildcards.hpp"
 
 #include <string>
+#include <string_view>
 
-template<typename PatternIterator, typename TextIterator>
-	requires (
-		std::forward_iterator<PatternIterator>
-		&& std::forward_iterator<TextIterator>
-	)
-bool wildcard_matches_impl(
-	PatternIterator pattern_it,
-	const PatternIterator &pattern_end,
-	TextIterator text_it,
-	const TextIterator &text_end
-) {
-	// or use string iterator type aliases in function signature???
-
-	while (pattern_it != pattern_end && text_it != text_end) {
-		if (*pattern_it == '*') {
-			++pattern_it;
-			if (pattern_it == pattern_end)
-				// trailing wildcard
-				return true;
-
-			// try every possible match for the wildcard, starting with zero characters
-			while (text_it != text_end) {
-				if (wildcard_matches_impl(pattern_it, pattern_end, text_it, text_end))
-					return true;
-				++text_it;
-			}
-
-			return false;
-		}
+CompiledWildcard::CompiledWildcard(const std::string_view pattern) : pattern(pattern) {
+	const std::size_t first_star = pattern.find('*');
+	if (first_star == std::string_view::npos) {
+		prefix = pattern;
+		return;
+	}
+
+	has_wildcard = true;
+	const std::size_t last_star = pattern.rfind('*');
+	prefix = pattern.substr(0, first_star);
+	suffix = pattern.substr(last_star + 1);
+
+	std::string_view remaining = pattern.substr(first_star + 1, last_star - first_star);
+	while (!remaining.empty()) {
+		const std::size_t star = remaining.find('*');
+		const std::string_view literal = remaining.substr(0, star);
+		remaining.remove_prefix(star == std::string_view::npos ? remaining.size() : star + 1);
+		// consecutive asterisks are equivalent to a single one
+		if (literal.empty()) continue;
 
-		// handle fixed letters in the pattern
-		if (*pattern_it == *text_it) {
-			++pattern_it;
-			++text_it;
-			continue;
+		Segment &segment = middle.emplace_back();
+		segment.literal = literal;
+		segment.failure.assign(literal.size(), 0);
+		for (std::size_t i = 1, border = 0; i < literal.size(); i++) {
+			while (border > 0 && literal[i] != literal[border]) border = segment.failure[border - 1];
+			if (literal[i] == literal[border]) border++;
+			segment.failure[i] = border;
 		}
+	}
+}
 
-		return false;
+std::size_t CompiledWildcard::find_end(const Segment &segment, const std::string_view text) {
+	const std::string &literal = segment.literal;
+	std::size_t matched = 0;
+	for (std::size_t i = 0; i < text.size(); i++) {
+		while (matched > 0 && text[i] != literal[matched]) matched = segment.failure[matched - 1];
+		if (text[i] == literal[matched]) matched++;
+		if (matched == literal.size()) return i + 1;
 	}
+	return std::string_view::npos;
+}
+
+bool CompiledWildcard::matches(std::string_view text) const {
+	if (!has_wildcard) return text == prefix;
 
-	// skip remaining '*'s in the pattern
-	while (pattern_it != pattern_end && *pattern_it == '*') ++pattern_it;
+	if (text.size() < prefix.size() + suffix.size()) return false;
+	if (!text.starts_with(prefix) || !text.ends_with(suffix)) return false;
 
-	return pattern_it == pattern_end && text_it == text_end;
+	// the anchored segments must not overlap, the rest is matched by the asterisks and middle segments
+	text = text.substr(prefix.size(), text.size() - prefix.size() - suffix.size());
+	for (const Segment &segment : middle) {
+		const std::size_t end = find_end(segment, text);
+		if (end == std::string_view::npos) return false;
+		text.remove_prefix(end);
+	}
+	return true;
+}
+
+std::string_view CompiledWildcard::longest_literal() const {
+	std::string_view longest = prefix.size() >= suffix.size() ? prefix : suffix;
+	for (const Segment &segment : middle) {
+		if (segment.literal.size() > longest.size()) longest = segment.literal;
+	}
+	return longest;
+}
+
+WildcardShape CompiledWildcard::shape() const {
+	if (!has_wildcard) return WildcardShape::exact;
+	if (middle.empty()) {
+		if (prefix.empty()) return suffix.empty() ? WildcardShape::anything : WildcardShape::suffix;
+		if (suffix.empty()) return WildcardShape::prefix;
+	}
+	if (middle.size() == 1 && prefix.empty() && suffix.empty()) return WildcardShape::contains;
+	return WildcardShape::general;
 }
 
 bool wildcard_matches(const std::string &pattern, const std::string &str) {
-	return wildcard_matches_impl(
-		pattern.begin(),
-		pattern.end(),
-		str.begin(),
-		str.end()
-	);
+	return CompiledWildcard(pattern).matches(str);
 }
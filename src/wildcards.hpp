@@ -1,8 +1,65 @@
 #ifndef DIRSYNC_WILDCARDS_HPP
 #define DIRSYNC_WILDCARDS_HPP
 
+#include <cstddef>
 #include <string>
+#include <string_view>
+#include <vector>
 
+/** The literal class of a wildcard pattern, allowing faster matching than the general algorithm. */
+enum class WildcardShape {
+	/** no asterisk, e.g. `node_modules` */
+	exact,
+	/** e.g. `tmp-*` */
+	prefix,
+	/** e.g. `*.log` */
+	suffix,
+	/** e.g. `*cache*` */
+	contains,
+	/** only asterisks, matching any text */
+	anything,
+	general,
+};
+
+/** A wildcard pattern with asterisks '*' (matching any sequence of characters, also empty),
+ * compiled once into literal segments. Matching runs in time linear in the pattern and text length:
+ * the first and last segments are anchored, the segments in between are searched for left to right
+ * with Knuth-Morris-Pratt, taking the leftmost occurrence - which is always a valid choice,
+ * so there is no backtracking. Matching does not allocate. */
+class CompiledWildcard {
+	struct Segment {
+		std::string literal;
+		/** The KMP failure function: the length of the longest proper border of each prefix. */
+		std::vector<std::size_t> failure;
+	};
+
+	std::string pattern;
+	bool has_wildcard = false;
+	/** The literal text before the first and after the last asterisk. */
+	std::string prefix;
+	std::string suffix;
+	/** The non-empty literal segments between asterisks. */
+	std::vector<Segment> middle;
+
+	/** Finds the segment in the text.
+	 * @return the position right after the leftmost occurrence, or npos */
+	static std::size_t find_end(const Segment &segment, std::string_view text);
+
+	public:
+	explicit CompiledWildcard(std::string_view pattern);
+
+	bool matches(std::string_view text) const;
+
+	/** The longest literal segment, which occurs in every matching text. Empty for e.g. `*`.
+	 * For all shapes except `general`, this is the only literal of the pattern. */
+	std::string_view longest_literal() const;
+
+	WildcardShape shape() const;
+
+	const std::string &get_pattern() const { return pattern; }
+};
+
+/** Matches the whole string against the wildcard pattern, see `CompiledWildcard`. */
 bool wildcard_matches(const std::string &pattern, const std::string &str);
 
 #endif //DIRSYNC_WILDCARDS_HPP